@@ -52,6 +52,10 @@ DifferentialADC::DifferentialADC(int16_t data_ptr[ADC_BUFFER_LEN]) : data(data_p
 	// Make sure :GPIOs are high-impedance, no pullups etc
 	adc_gpio_init(26);
 	adc_gpio_init(27);
+#if RX_BUSES > 1
+	adc_gpio_init(28);
+	adc_gpio_init(29);
+#endif
 
 	// Select ADC input 0 (GPIO26)
 	adc_select_input(0);
@@ -65,7 +69,11 @@ DifferentialADC::DifferentialADC(int16_t data_ptr[ADC_BUFFER_LEN]) : data(data_p
 	);
 
 	adc_set_clkdiv(48000000 / (UART_BAUD_RATE * ADC_OVERSAMPLING_RATE));
+#if RX_BUSES > 1
+	adc_set_round_robin(0xf); // Sample ADC0 - ADC3 in RR
+#else
 	adc_set_round_robin(0x3); // Sample ADC0 + ADC1 in RR
+#endif
 
 	// Load the PIO.
 	// It converts the uint8_t to int16_t and
@@ -164,6 +172,11 @@ void DifferentialADC::Start(void) {
 
 	// This one wakes the CPU on WFE
 	twos_complement_enable_irq0(this->pio, this->sm);
+#if RX_BUSES > 1
+	// The round robin sequence must start with the first bus
+	adc_select_input(0);
+	this->split.Reset();
+#endif
 	adc_run(true);
 }
 
@@ -200,11 +213,15 @@ void DifferentialADC::Reset(void) {
 
 // Update returns false if no new data is available.
 // Update returns true if new data has been placed in out.
-// out holds the sampled voltage in mV
-bool DifferentialADC::Update(int32_t *out) {
+// out holds the sampled voltage in mV, bus the bus it was sampled on.
+bool DifferentialADC::Update(int32_t *out, uint8_t *bus) {
 	uint32_t tc_hw;
+#if RX_BUSES > 1
+	int32_t sample;
+#else
 	int16_t x1, x2, y;
 	int16_t diff;
+#endif
 	int32_t timeout = 100000;
 
 	tc_hw = dma_channel_hw_addr(this->channel2)->transfer_count;
@@ -239,6 +256,18 @@ bool DifferentialADC::Update(int32_t *out) {
 
 	this->tc--;
 
+#if RX_BUSES > 1
+	// Every sample belongs to one of the buses
+	this->split.Update(this->data[this->off], &sample, bus);
+
+	// Intentionally overflows.
+	this->off++;
+
+	// Apply gain to convert DAC value to mV
+	*out = (sample * this->gain) >> 8;
+#else
+	*bus = 0;
+
 	// Compensate phase shift. Use the last 3 samples. Intentionally overflows.
 	x1 = this->data[(uint8_t)(this->off - 0)];
 	x2 = this->data[(uint8_t)(this->off - 2)];
@@ -254,6 +283,7 @@ bool DifferentialADC::Update(int32_t *out) {
 
 	// Apply gain to convert DAC value to mV
 	*out = (diff * this->gain) >> 8;
+#endif
 
 	return true;
 }
@@ -1,6 +1,8 @@
 #pragma once
 #include "hardware/adc.h"
 #include "hardware/pio.h"
+#include "defines.hpp"
+#include "dual_bus_split.hpp"
 
 using namespace std;
 
@@ -21,7 +23,7 @@ class DifferentialADC
 
 		void Reset(void);
 
-		bool Update(int32_t *out);
+		bool Update(int32_t *out, uint8_t *bus);
 		bool Error(void);
 		void SetGain(uint16_t gain);
 		void Start(void);
@@ -39,6 +41,9 @@ class DifferentialADC
 	
 		uint8_t off;
 		bool error;
+#if RX_BUSES > 1
+		DualBusSplit split;
+#endif
 		int32_t gain;
 		// PIO
 		PIO pio;
@@ -6,6 +6,10 @@
 #include "pico/platform.h"
 #include "defines.hpp"
 
+#if RX_BUSES > 1
+#error The software ADC supports a single bus only
+#endif
+
 // Error returns true if there was an error since the last check
 bool DifferentialADC_SW::Error(void) {
 	bool val = this->error;
@@ -114,8 +118,8 @@ void DifferentialADC_SW::Reset(void) {
 
 // Update returns false if no new data is available.
 // Update returns true if new data has been placed in out.
-// out holds the sampled voltage in mV
-bool DifferentialADC_SW::Update(int32_t *out) {
+// out holds the sampled voltage in mV. Only a single bus is supported.
+bool DifferentialADC_SW::Update(int32_t *out, uint8_t *bus) {
 	int32_t x1, x2, y;
 	volatile uint16_t *next_ptr;
 	int16_t diff;
@@ -144,6 +148,7 @@ bool DifferentialADC_SW::Update(int32_t *out) {
 
 	// Apply gain to convert DAC value to mV
 	*out = (diff * this->gain) >> 8;
+	*bus = 0;
 
 	return true;
 }
@@ -22,7 +22,7 @@ class DifferentialADC_SW
 
 		void Reset(void);
 
-		bool Update(int32_t *out);
+		bool Update(int32_t *out, uint8_t *bus);
 		bool Error(void);
 		void SetGain(uint16_t gain);
 		void Start(void);
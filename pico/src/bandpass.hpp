@@ -0,0 +1,73 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+#include <array>
+
+#include "fir_design.hpp"
+#include "shiftreg.hpp"
+
+// Band pass filter and decimator in one stage.
+// The FIR low pass removes the high frequency noise captured by the ADC. It
+// is only evaluated for the samples kept after decimation. A first order
+// high pass at the decimated rate removes the DC offset, which appears when
+// the resistors don't properly match each others value.
+//
+// N is the number of FIR taps and M the decimation factor. LOW_HZ and
+// HIGH_HZ are the band edges, RATE_HZ is the input sample rate. W is the
+// window of the FIR design.
+// Introduces a delay of (N - 1) / 2 input samples.
+template <size_t N, size_t M, uint32_t LOW_HZ, uint32_t HIGH_HZ, uint32_t RATE_HZ,
+	FIRDesign::WINDOW W = FIRDesign::HAMMING>
+class BandPassDecimator
+{
+	static_assert(N % 2 == 1, "Number of taps must be odd");
+	static_assert(M >= 1, "Invalid decimation factor");
+	static_assert(LOW_HZ < HIGH_HZ && HIGH_HZ < RATE_HZ / 2, "Invalid band edges");
+
+	public:
+		// Group delay in input samples
+		static constexpr size_t DELAY = (N - 1) / 2;
+		static constexpr std::array<int32_t, N> TAPS = FIRDesign::LowPass<N>(HIGH_HZ, RATE_HZ, W);
+		static constexpr int32_t POLE = FIRDesign::HighPassPole(LOW_HZ, RATE_HZ / M);
+		static_assert(POLE > 0 && POLE < 256, "Low band edge out of range");
+
+		BandPassDecimator(int32_t buffer[N * 2]) :
+		reg(buffer),
+		phase(0),
+		x(0),
+		y(0)
+		{
+		}
+
+		// Update returns false if no new data is available.
+		// Update returns true if new data has been placed in out.
+		bool Update(const int32_t in, int32_t *out) {
+			int32_t acc, xn, tmp;
+			const bool keep = this->phase == 0;
+
+			// Shift in new value
+			this->reg.Update(in);
+			if (++this->phase == M)
+				this->phase = 0;
+			if (!keep)
+				return false;
+
+			// Low pass
+			acc = this->reg.ConvoluteSymmetric(TAPS.data());
+
+			// DC block
+			xn = acc >> 7;
+			tmp = xn - this->x + ((POLE * this->y) >> 8);
+			this->x = xn;
+			this->y = tmp;
+
+			*out = tmp >> 8;
+			return true;
+		}
+
+	private:
+		ShiftReg<int32_t, N> reg;
+		size_t phase;
+		int32_t x;
+		int32_t y;
+};
@@ -0,0 +1,117 @@
+#include "bus_schedule.hpp"
+#include "uart.hpp"
+
+// Source of the packets of the main controller
+#define MAIN_CONTROLLER_SRC 0x00
+
+BusSchedule::BusSchedule(void) :
+	table{}, used(0), replace(0), last{}, last_end(0), last_valid(false)
+{
+}
+
+// Frame is called for every packet received. Timestamp and Duration of m
+// hold the start and the length in micro seconds.
+void BusSchedule::Frame(const Message& m) {
+	const bool valid = (m.Status == Message::STATUS_OK || m.Status == Message::STATUS_REPAIRED) &&
+			   m.Length >= 3;
+
+	// Learn the gap between the last packet and the next request
+	if (valid && this->last_valid && m.Data[0] == MAIN_CONTROLLER_SRC) {
+		const uint32_t gap = m.Timestamp - this->last_end;
+		Entry *e = this->find(this->last);
+
+		if (!e) {
+			if (this->used < BUS_SCHEDULE_LEN)
+				e = &this->table[this->used++];
+			else {
+				e = &this->table[this->replace];
+				this->replace = (this->replace + 1) % BUS_SCHEDULE_LEN;
+			}
+			e->header[0] = this->last[0];
+			e->header[1] = this->last[1];
+			e->header[2] = this->last[2];
+			e->count = 0;
+			e->gap = gap;
+		}
+		if (gap < e->gap)
+			e->gap = gap;
+		if (e->count < 0xff)
+			e->count++;
+	}
+
+	// A packet with errors might be anything, i.e. a collision
+	this->last_valid = valid;
+	this->last_end = m.Timestamp + m.Duration;
+	if (valid) {
+		this->last[0] = m.Data[0];
+		this->last[1] = m.Data[1];
+		this->last[2] = m.Data[2];
+	}
+}
+
+// Returns the entry of header or nullptr
+BusSchedule::Entry *BusSchedule::find(const uint8_t *header) {
+	for (size_t i = 0; i < this->used; i++) {
+		Entry *e = &this->table[i];
+
+		if (e->header[0] == header[0] && e->header[1] == header[1] &&
+		    e->header[2] == header[2])
+			return e;
+	}
+	return nullptr;
+}
+
+// Returns true if the gap after header is known. Falls back to the shortest
+// gap after the same source and type.
+bool BusSchedule::gap(const uint8_t *header, uint32_t *out) {
+	const Entry *e = this->find(header);
+	bool found = false;
+
+	if (e && e->count >= BUS_SCHEDULE_MIN_COUNT) {
+		*out = e->gap;
+		return true;
+	}
+	for (size_t i = 0; i < this->used; i++) {
+		e = &this->table[i];
+		if (e->count < BUS_SCHEDULE_MIN_COUNT || e->header[0] != header[0] ||
+		    e->header[2] != header[2])
+			continue;
+		if (!found || e->gap < *out)
+			*out = e->gap;
+		found = true;
+	}
+	return found;
+}
+
+// Next returns true if the start of the next packet of the main controller
+// is predicted. at is set to its time then.
+bool BusSchedule::Next(uint32_t *at) {
+	uint32_t gap;
+
+	if (!this->last_valid || !this->gap(this->last, &gap))
+		return false;
+	*at = this->last_end + gap;
+	return true;
+}
+
+// Fits returns true if a packet of length bytes started at start ends
+// before the next packet of the main controller, or if there's no
+// prediction.
+bool BusSchedule::Fits(const uint32_t start, const size_t length) {
+	uint32_t at;
+
+	if (!this->Next(&at))
+		return true;
+	const uint32_t end = start + length * UART_BITS_PARITY * 1000000 / UART_BAUD_RATE +
+			     BUS_SCHEDULE_MARGIN_US;
+	return (int32_t)(at - end) >= 0;
+}
+
+// Returns the number of headers learned
+size_t BusSchedule::Learned(void) {
+	size_t n = 0;
+
+	for (size_t i = 0; i < this->used; i++)
+		n += this->table[i].count >= BUS_SCHEDULE_MIN_COUNT;
+	return n;
+}
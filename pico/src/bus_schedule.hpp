@@ -0,0 +1,65 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "message.hpp"
+
+// Number of packet headers the schedule keeps track of
+#define BUS_SCHEDULE_LEN 64
+// Observations of a gap needed before it's used for a prediction
+#define BUS_SCHEDULE_MIN_COUNT 2
+// Idle time kept between the end of a transmission and the predicted start
+// of the next packet of the main controller
+#define BUS_SCHEDULE_MARGIN_US 2000
+
+// Learns when the Daikin main controller transmits. The main controller
+// doesn't check the bus, it sends its next request after a fixed delay
+// depending on the packet before.
+//
+// The schedule stores the shortest gap from the end of a packet to the start
+// of the next request per header (source, destination, type) of the packet
+// before. Headers without observations fall back to the gap of the same
+// source and type to any destination, i.e. the answer timeout of 35h is the
+// same for all external controller addresses.
+class BusSchedule
+{
+	public:
+		BusSchedule(void);
+
+		// Frame is called for every packet received. Timestamp and
+		// Duration of m hold the start and the length in micro seconds.
+		void Frame(const Message& m);
+
+		// Next returns true if the start of the next packet of the main
+		// controller is predicted. at is set to its time then.
+		bool Next(uint32_t *at);
+
+		// Fits returns true if a packet of length bytes started at start
+		// ends before the next packet of the main controller, or if
+		// there's no prediction.
+		bool Fits(const uint32_t start, const size_t length);
+
+		// Returns the number of headers learned
+		size_t Learned(void);
+
+	private:
+		struct Entry {
+			uint8_t header[3];
+			uint8_t count;
+			uint32_t gap;
+		};
+
+		// Returns the entry of header or nullptr
+		Entry *find(const uint8_t *header);
+		// Returns true if the gap after header is known
+		bool gap(const uint8_t *header, uint32_t *out);
+
+		Entry table[BUS_SCHEDULE_LEN];
+		size_t used;
+		// Next entry replaced when the table is full
+		size_t replace;
+		// Header and end of the last packet, valid if last_valid
+		uint8_t last[3];
+		uint32_t last_end;
+		bool last_valid;
+};
@@ -0,0 +1,156 @@
+#include <string.h>
+#include "collision_detect.hpp"
+
+CollisionDetect::CollisionDetect(void) :
+	state(IDLE), data{}, length(0), byte(0), bit(0), t(0), polarity(0),
+	next_polarity(0), n_expected(0), n_other(0), sync_max(0), sync_t(0),
+	timeout(0), collision_bit(0)
+{
+}
+
+// Arm loads the packet being transmitted. Must be called before
+// the first start bit is on the bus.
+void CollisionDetect::Arm(const uint8_t *data, const size_t len) {
+	this->length = len < sizeof(this->data) ? len : sizeof(this->data);
+	memcpy(this->data, data, this->length);
+	this->byte = 0;
+	this->bit = 0;
+	this->timeout = COLLISION_START_TIMEOUT;
+	this->state = this->length ? WAIT_FOR_START : IDLE;
+}
+
+// Disarm stops the comparison
+void CollisionDetect::Disarm(void) {
+	this->state = IDLE;
+}
+
+// Returns true while the packet is being compared
+bool CollisionDetect::Armed(void) {
+	return this->state != IDLE;
+}
+
+// Bit returns the position of the collision in the packet
+uint16_t CollisionDetect::Bit(void) {
+	return this->collision_bit;
+}
+
+// Returns the expected symbol of bit b of the current byte.
+bool CollisionDetect::ExpectPulse(const uint8_t b) {
+	const uint8_t d = this->data[this->byte];
+
+	if (b == 0)
+		return true;
+	if (b <= 8)
+		return !(d & (1 << (b - 1)));
+	if (b == 9)
+		// Even parity
+		return !(__builtin_popcount(d) & 1);
+	return false;
+}
+
+void CollisionDetect::Collision(void) {
+	this->collision_bit = this->byte * COLLISION_BITS_PER_BYTE + this->bit;
+	this->state = IDLE;
+}
+
+// Evaluates the window of the current bit. Returns true on collision.
+bool CollisionDetect::CheckBit(void) {
+	bool collision;
+
+	if (this->ExpectPulse(this->bit)) {
+		collision = this->n_expected < COLLISION_MIN_SAMPLES ||
+			this->n_other >= COLLISION_MIN_SAMPLES;
+		this->next_polarity = -this->next_polarity;
+	} else {
+		collision = this->n_expected + this->n_other >= COLLISION_MIN_SAMPLES;
+	}
+	this->n_expected = 0;
+	this->n_other = 0;
+
+	return collision;
+}
+
+// Update compares one UARTBit sample against the expected symbol.
+// Returns true once when a collision was detected.
+bool CollisionDetect::Update(const int32_t bit) {
+	switch (this->state) {
+	case IDLE:
+		return false;
+	case WAIT_FOR_START:
+		if (bit == 0) {
+			if (--this->timeout == 0)
+				this->state = IDLE;
+			return false;
+		}
+		this->polarity = bit > 0 ? 1 : -1;
+		this->next_polarity = this->polarity;
+		this->t = -COLLISION_PEAK_OFFSET;
+		this->n_expected = 0;
+		this->n_other = 0;
+		this->state = BITS;
+		break;
+	case SYNC:
+		if (bit != 0) {
+			if ((bit > 0 ? 1 : -1) == this->polarity) {
+				this->n_expected++;
+				// Use the strongest sample as peak of the start bit
+				if (bit * this->polarity > this->sync_max) {
+					this->sync_max = bit * this->polarity;
+					this->sync_t = this->t;
+				}
+			} else {
+				this->n_other++;
+			}
+		}
+		if (this->t++ < COLLISION_START_WINDOW)
+			return false;
+
+		this->next_polarity = this->polarity;
+		if (this->CheckBit()) {
+			this->Collision();
+			return true;
+		}
+		// Continue relative to the peak of the start bit
+		this->t -= this->sync_t;
+		this->bit = 1;
+		this->state = BITS;
+		return false;
+	case BITS:
+		break;
+	}
+
+	// Position relative to the expected peak of the current bit
+	const int32_t pos = this->t - this->bit * UART_OVERSAMPLING_RATE;
+
+	if (pos >= -COLLISION_WINDOW && pos <= COLLISION_WINDOW && bit != 0) {
+		if ((bit > 0 ? 1 : -1) == this->next_polarity)
+			this->n_expected++;
+		else
+			this->n_other++;
+	}
+	this->t++;
+
+	if (pos < COLLISION_WINDOW)
+		return false;
+
+	if (this->CheckBit()) {
+		this->Collision();
+		return true;
+	}
+
+	this->bit++;
+	if (this->bit == COLLISION_BITS_PER_BYTE) {
+		this->bit = 0;
+		this->byte++;
+		if (this->byte == this->length) {
+			this->state = IDLE;
+			return false;
+		}
+		// Search the start bit of the next byte around its expected peak
+		this->t -= COLLISION_BITS_PER_BYTE * UART_OVERSAMPLING_RATE;
+		this->sync_max = 0;
+		this->sync_t = 0;
+		this->state = SYNC;
+	}
+	return false;
+}
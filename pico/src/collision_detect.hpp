@@ -0,0 +1,87 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "defines.hpp"
+#include "message.hpp"
+
+#define COLLISION_BITS_PER_BYTE 11
+// The UARTBit output of a pulse starts 3 samples before its peak
+#define COLLISION_PEAK_OFFSET 3
+// Samples around the expected peak evaluated for every bit
+#define COLLISION_WINDOW 3
+// Samples around the expected peak searched for the start bit of the next byte
+#define COLLISION_START_WINDOW 6
+// Minimum number of samples in the window to detect a pulse
+#define COLLISION_MIN_SAMPLES 3
+// Give up if the first start bit isn't seen within 2 bytes
+#define COLLISION_START_TIMEOUT (2 * COLLISION_BITS_PER_BYTE * UART_OVERSAMPLING_RATE)
+
+// Detects bus collisions while transmitting on bit level.
+// Compares the output of UARTBit against the symbols of the packet being
+// transmitted. A '0' must be a pulse with alternating polarity, a '1' must
+// have no pulse. Detects a collision about one bit time after the bit
+// started on the bus instead of after the whole byte has been decoded.
+class CollisionDetect
+{
+	public:
+		CollisionDetect(void);
+
+		// Arm loads the packet being transmitted. Must be called before
+		// the first start bit is on the bus.
+		void Arm(const uint8_t *data, const size_t len);
+
+		// Disarm stops the comparison
+		void Disarm(void);
+
+		// Returns true while the packet is being compared
+		bool Armed(void);
+
+		// Update compares one UARTBit sample against the expected symbol.
+		// Returns true once when a collision was detected. Disarms itself
+		// on collision or after the last stop bit.
+		bool Update(const int32_t bit);
+
+		// Bit returns the position of the collision in the packet:
+		// byte * 11 + bit, where bit 0 is the start bit, 1-8 are the data
+		// bits, 9 is the parity bit and 10 is the stop bit.
+		uint16_t Bit(void);
+
+	private:
+		enum STATE {
+			IDLE = 0,
+			// Wait for the first start bit of the packet
+			WAIT_FOR_START,
+			// Compare the bits of the current byte
+			BITS,
+			// Search the start bit of the next byte
+			SYNC,
+		};
+
+		// Returns the expected symbol of bit b of the current byte.
+		// true for a pulse ('0'), false for no pulse ('1').
+		bool ExpectPulse(const uint8_t b);
+		bool CheckBit(void);
+		void Collision(void);
+
+		enum STATE state;
+		uint8_t data[MAX_PACKET_SIZE];
+		size_t length;
+		// Current byte and bit
+		size_t byte;
+		uint8_t bit;
+		// Samples since the expected peak of the start bit of the current byte
+		int32_t t;
+		// Polarity of the first start bit
+		int8_t polarity;
+		// Polarity of the next expected pulse
+		int8_t next_polarity;
+		// Samples in the current window with and against the expected polarity
+		uint8_t n_expected;
+		uint8_t n_other;
+		// Strongest sample found while searching the start bit
+		int32_t sync_max;
+		int32_t sync_t;
+		uint32_t timeout;
+		uint16_t collision_bit;
+};
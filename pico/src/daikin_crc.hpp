@@ -0,0 +1,54 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+#include <array>
+
+// CRC-8 at the end of every Daikin packet: poly 0xd9, LSB first, init 0.
+// The table is generated by the compiler. As the CRC is only 8 bits wide
+// one table lookup per byte replaces the 8 shifts of the bitwise loop.
+namespace DaikinCRC
+{
+    constexpr uint8_t POLY = 0xd9;
+
+    // Updates crc by one byte, one bit at a time. Reference implementation
+    // for the table.
+    constexpr uint8_t UpdateBitwise(const uint8_t crc, const uint8_t data) {
+        uint32_t r = crc ^ data;
+
+        for (size_t i = 0; i < 8; i++) {
+            if (r & 0x01)
+                r = (r >> 1) ^ POLY;
+            else
+                r = r >> 1;
+        }
+        return r;
+    }
+
+    constexpr std::array<uint8_t, 256> MakeTable(void) {
+        std::array<uint8_t, 256> t{};
+
+        for (size_t i = 0; i < t.size(); i++)
+            t[i] = UpdateBitwise(0, i);
+        return t;
+    }
+
+    inline constexpr std::array<uint8_t, 256> TABLE = MakeTable();
+
+    // Updates crc by one byte
+    inline uint8_t Update(const uint8_t crc, const uint8_t data) {
+        return TABLE[crc ^ data];
+    }
+
+    // Calculates the CRC over data[0]..data[len - 1]. crc continues the
+    // CRC of the bytes before data.
+    inline uint8_t Calc(const uint8_t *data, const size_t len, uint8_t crc = 0) {
+        for (size_t i = 0; i < len; i++)
+            crc = TABLE[crc ^ data[i]];
+        return crc;
+    }
+
+    // Valid returns true if the last byte is the CRC of the bytes before
+    inline bool Valid(const uint8_t *data, const size_t len) {
+        return len > 1 && Calc(data, len - 1) == data[len - 1];
+    }
+}
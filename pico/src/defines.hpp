@@ -4,10 +4,40 @@
 
 // Oversample the signal by 16 times
 #define UART_OVERSAMPLING_RATE 16
+// The ADC samples all channels in round robin mode at twice the UART rate
+#define ADC_OVERSAMPLING_RATE (UART_OVERSAMPLING_RATE * 2)
+
+// Define RX_DUAL_BUS to decode a second P1P2 bus on ADC2/ADC3 (GPIO28/29).
+// The ADC can't sample four channels any faster, thus every bus gets half of
+// the samples and the FIR filter doesn't reduce the sample rate.
+#ifdef RX_DUAL_BUS
+#define RX_BUSES 2
+#define FIR_OVERSAMPLING_RATE UART_OVERSAMPLING_RATE
+#else
+#define RX_BUSES 1
 // FIR filtered reduces samplerate by 0.5
 #define FIR_OVERSAMPLING_RATE (UART_OVERSAMPLING_RATE * 2)
-// ADC operates on the FIR filter input sample rate
-#define ADC_OVERSAMPLING_RATE FIR_OVERSAMPLING_RATE
+#endif
+
+// Define RX_SPLIT_CORES to run the UART and the end of frame detection on
+// core0. Core1 then only runs the signal processing and hands the output of
+// the bit detector over in blocks of RX_SPLIT_BLOCK samples, which leaves
+// room for a higher oversampling rate or longer filters.
+// The blocks add up to RX_SPLIT_BLOCK samples of latency.
+#define RX_SPLIT_BLOCK UART_OVERSAMPLING_RATE
+// Samples buffered per bus until core0 decodes them. Must be a power of two.
+#define RX_SPLIT_RING_LEN 1024
+
+// Receive band pass filter. The taps are designed at compile time.
+// More taps and a wider window improve the noise rejection but need more
+// cycles per sample. Symmetric taps need (RX_FILTER_TAPS + 1) / 2
+// multiplications per sample.
+#define RX_FILTER_TAPS 15
+#define RX_FILTER_WINDOW FIRDesign::HAMMING
+// Removes the DC offset
+#define RX_FILTER_LOW_HZ 190
+// Removes the high frequency noise captured by the ADC
+#define RX_FILTER_HIGH_HZ 67500
 
 // P1P2 bus settings
 #define UART_BAUD_RATE 9600
@@ -26,8 +56,26 @@
 // Tests showed that a minimum of 5msec is sufficient between packets.
 
 #define TX_POWERON_TIMEOUT_US 32000
+// Time the line driver stays powered after a transmission when more packets
+// are expected. Must cover the gap between two 3xh requests.
+#define TX_WARM_HOLD_US 200000
+// Minimum idle time between two packets queued for transmission
+#define TX_PACKET_GAP_US 5000
+// Minimum idle time from the end of a received packet to a transmission
+// started with the line driver already powered
+#define TX_TURNAROUND_US 5000
 #define TX_ONE_CHAR_TIMEOUT_US 2000
 #define TX_RX_TIMEOUT_US 2000
 
+// Baud rate of the hardware UART connected to the host.
+// The UART is fed by DMA, rates up to 921600 are supported.
+#define HOST_UART_BAUD_RATE 115200
+
+// Interval to check if the previous packet has been sent by the PIO
+#define TX_IDLE_POLL_US 100
+
+// Interval to retry writing to USB CDC when the host doesn't read fast enough
+#define HOST_TX_RETRY_US 1000
+
 // Max line busy time in milli seconds
 #define LINE_BUSY_TIMEOUT_MS 500
\ No newline at end of file
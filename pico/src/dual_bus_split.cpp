@@ -0,0 +1,34 @@
+#include <string.h>
+#include "dual_bus_split.hpp"
+
+DualBusSplit::DualBusSplit(void) : x{}, y{}, channel(0)
+{
+}
+
+void DualBusSplit::Reset(void) {
+	memset(this->x, 0, sizeof(this->x));
+	memset(this->y, 0, sizeof(this->y));
+	this->channel = 0;
+}
+
+// Bus b is sampled at t = 4k + 2b (x) and t = 4k + 2b + 1 (y). Its samples
+// are placed at t = 4k + 2b + 0.5 and t = 4k + 2b + 2.5.
+void DualBusSplit::Update(const int32_t in, int32_t *out, uint8_t *bus) {
+	const uint8_t b = this->channel >> 1;
+	int32_t *x = this->x[b];
+	int32_t *y = this->y[b];
+
+	if (this->channel & 1) {
+		// y(k + 1) completes the sample at 4k + 2b + 2.5
+		*out = (3 * x[1] + 5 * x[0] + 5 * y[0] + 3 * in) / 8;
+		y[1] = y[0];
+		y[0] = in;
+	} else {
+		// x(k + 1) completes the sample at 4k + 2b + 0.5
+		*out = (7 * (x[0] + y[0]) + in + y[1]) / 8;
+		x[1] = x[0];
+		x[0] = in;
+	}
+	*bus = b;
+	this->channel = (this->channel + 1) & 3;
+}
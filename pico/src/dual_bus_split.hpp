@@ -0,0 +1,29 @@
+#pragma once
+#include <inttypes.h>
+
+// Splits the samples of two differential pairs captured by the ADC in round
+// robin mode (ADC0, ADC1, ADC2, ADC3) into the signals of both buses.
+// The samples of the even channels have already been negated by the PIO.
+//
+// Both channels of a pair are linear interpolated to the same points in time,
+// which are evenly spaced at half of the ADC sample rate. Every ADC sample
+// completes one sample of the bus it belongs to. Adds a delay of about one
+// sample at the bus sample rate.
+class DualBusSplit
+{
+	public:
+		DualBusSplit(void);
+
+		// Update takes the next ADC sample. Places the differential sample
+		// in out and the bus it belongs to in bus.
+		void Update(const int32_t in, int32_t *out, uint8_t *bus);
+
+		// Reset restarts with ADC0 as next sample
+		void Reset(void);
+
+	private:
+		// Last two samples of every channel. [0] is the latest.
+		int32_t x[2][2];
+		int32_t y[2][2];
+		uint8_t channel;
+};
@@ -0,0 +1,205 @@
+#include <string.h>
+#include "daikin_crc.hpp"
+#include "end_of_frame.hpp"
+
+// Packet lengths known from the external controller emulation. They apply
+// to both external controller addresses, see SameType. All other lengths
+// are learned.
+static const uint8_t known_lengths[][4] = {
+	{0x40, 0xf0, 0x30, 18},
+	{0x40, 0xf0, 0x31, 16},
+	{0x40, 0xf0, 0x35, 22},
+	{0x40, 0xf0, 0x36, 24},
+	{0x40, 0xf0, 0x37, 24},
+	{0x40, 0xf0, 0x38, 22},
+	{0x40, 0xf0, 0x39, 22},
+	{0x40, 0xf0, 0x3a, 22},
+	{0x40, 0xf0, 0x3b, 24},
+	{0x40, 0xf0, 0x3c, 24},
+	{0x40, 0xf0, 0x3d, 22},
+};
+
+// Starts busy to signal a free line once the bus is idle after startup
+EndOfFrame::EndOfFrame(void) :
+	state(BUSY), table{}, next_entry(0), hdr{}, length(0), expected(0), crc(0),
+	crc_prev(0), last(0), error(false), complete(false), idle(0), gap_max_frame(0),
+	gap_max(0), timeout(EOF_MAX_IDLE), last_fast(false), last_hdr{}, fast_count(0)
+{
+	for (size_t i = 0; i < sizeof(known_lengths) / sizeof(known_lengths[0]); i++)
+		this->Learn(known_lengths[i], known_lengths[i][3]);
+}
+
+// Returns true while a packet is being received
+bool EndOfFrame::Busy(void) {
+	return this->state == BUSY;
+}
+
+// Returns the current idle timeout in samples
+uint32_t EndOfFrame::IdleTimeout(void) {
+	return this->timeout;
+}
+
+// Returns the number of packets closed by length and CRC
+uint32_t EndOfFrame::FastCount(void) {
+	return this->fast_count;
+}
+
+// Returns true if the headers a and b are of the same packet type. Packets
+// to and from the external controller addresses 0xF0 and 0xF1 have the same
+// length.
+static bool SameType(const uint8_t a[3], const uint8_t b[3]) {
+	if (a[0] != b[0] || a[2] != b[2])
+		return false;
+	return a[1] == b[1] || ((a[1] & 0xfe) == 0xf0 && (b[1] & 0xfe) == 0xf0);
+}
+
+struct EndOfFrame::Entry *EndOfFrame::Find(const uint8_t hdr[3]) {
+	for (size_t i = 0; i < EOF_TABLE_SIZE; i++) {
+		struct Entry *e = &this->table[i];
+		if (e->len && SameType(e->hdr, hdr))
+			return e;
+	}
+	return nullptr;
+}
+
+// Learn sets the length of a packet type. hdr are the first three bytes.
+void EndOfFrame::Learn(const uint8_t hdr[3], const uint8_t len) {
+	struct Entry *e = this->Find(hdr);
+
+	if (e == nullptr) {
+		// Replace the oldest entry
+		e = &this->table[this->next_entry];
+		this->next_entry = (this->next_entry + 1) % EOF_TABLE_SIZE;
+		memcpy(e->hdr, hdr, sizeof(e->hdr));
+	}
+	e->len = len;
+}
+
+// Returns the learned length of the packet type or 0 if unknown
+uint8_t EndOfFrame::Length(const uint8_t hdr[3]) {
+	struct Entry *e = this->Find(hdr);
+
+	return e ? e->len : 0;
+}
+
+void EndOfFrame::Forget(const uint8_t hdr[3]) {
+	struct Entry *e = this->Find(hdr);
+
+	if (e)
+		e->len = 0;
+}
+
+// Byte passes every byte decoded by the UART
+void EndOfFrame::Byte(const uint8_t data, const bool err) {
+	if (this->state != BUSY)
+		return;
+
+	if (err)
+		this->error = true;
+	if (this->length < sizeof(this->hdr))
+		this->hdr[this->length] = data;
+	this->crc_prev = this->crc;
+	this->crc = DaikinCRC::Update(this->crc, data);
+	this->last = data;
+	if (this->length < 0xff)
+		this->length++;
+
+	if (this->length == sizeof(this->hdr))
+		this->expected = this->Length(this->hdr);
+	if (!this->error && this->length == this->expected && this->crc_prev == data)
+		this->complete = true;
+}
+
+// Correction marks the last byte as invalid, the UART found its stop bit
+// broken after passing it
+void EndOfFrame::Correction(void) {
+	if (this->state != BUSY)
+		return;
+
+	this->error = true;
+	this->complete = false;
+}
+
+enum EndOfFrame::EVENT EndOfFrame::Close(const bool fast) {
+	const bool valid = !this->error && this->length > sizeof(this->hdr) &&
+		this->crc_prev == this->last;
+
+	if (valid) {
+		if (!fast)
+			this->Learn(this->hdr, this->length);
+
+		// Slowly forget large gaps
+		this->gap_max -= this->gap_max / 16;
+		if (this->gap_max_frame > this->gap_max)
+			this->gap_max = this->gap_max_frame;
+		this->timeout = 2 * this->gap_max + UART_OVERSAMPLING_RATE;
+		if (this->timeout < EOF_MIN_IDLE)
+			this->timeout = EOF_MIN_IDLE;
+		if (this->timeout > EOF_MAX_IDLE)
+			this->timeout = EOF_MAX_IDLE;
+	}
+
+	this->last_fast = fast;
+	memcpy(this->last_hdr, this->hdr, sizeof(this->hdr));
+	if (fast)
+		this->fast_count++;
+
+	return EVENT_FREE;
+}
+
+// Update is called for every sample with the state of the UART
+// receiver. stop_pending holds back closing a packet by its length until
+// the UART has checked the stop bit of the last byte. Returns the change of
+// the line state.
+enum EndOfFrame::EVENT EndOfFrame::Update(const bool receiving, const bool stop_pending) {
+	switch (this->state) {
+	case IDLE:
+		if (!receiving) {
+			if (this->idle < EOF_MAX_IDLE)
+				this->idle++;
+			return EVENT_NONE;
+		}
+		// More data right after a packet closed by its length. The
+		// learned length is wrong.
+		if (this->last_fast && this->idle < this->timeout)
+			this->Forget(this->last_hdr);
+		this->last_fast = false;
+
+		this->length = 0;
+		this->expected = 0;
+		this->crc = 0;
+		this->crc_prev = 0;
+		this->error = false;
+		this->complete = false;
+		this->idle = 0;
+		this->gap_max_frame = 0;
+		this->state = BUSY;
+		return EVENT_BUSY;
+	case CLOSING:
+		// Wait for the UART to finish the stop bit
+		if (!receiving)
+			this->state = IDLE;
+		return EVENT_NONE;
+	case BUSY:
+		break;
+	}
+
+	if (this->complete && !stop_pending) {
+		this->state = receiving ? CLOSING : IDLE;
+		this->idle = 0;
+		return this->Close(true);
+	}
+
+	if (receiving) {
+		if (this->idle > this->gap_max_frame)
+			this->gap_max_frame = this->idle;
+		this->idle = 0;
+		return EVENT_NONE;
+	}
+
+	if (++this->idle < this->timeout)
+		return EVENT_NONE;
+
+	this->state = IDLE;
+	return this->Close(false);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "defines.hpp"
+
+// Number of packet types with known length
+#define EOF_TABLE_SIZE 32
+// Idle time in samples before a packet of unknown length is closed.
+// Used until inter-byte gaps have been learned.
+#define EOF_MAX_IDLE (11 * UART_OVERSAMPLING_RATE)
+// Lower limit of the learned idle time
+#define EOF_MIN_IDLE (3 * UART_OVERSAMPLING_RATE)
+
+// Detects the end of a packet on the P1P2 bus.
+// Daikin packets have a fixed length per packet type and end with a CRC.
+// A packet is closed right after the stop bit of its last byte when the
+// length is known from the table and the CRC is valid. Otherwise the packet is closed after
+// the bus has been idle for twice the largest gap seen between two bytes of
+// valid packets.
+// Packet lengths are learned from valid packets closed by the idle timeout.
+class EndOfFrame
+{
+	public:
+		enum EVENT {
+			EVENT_NONE = 0,
+			// A packet started
+			EVENT_BUSY,
+			// The packet ended
+			EVENT_FREE,
+		};
+
+		EndOfFrame(void);
+
+		// Update is called for every sample with the state of the UART
+		// receiver. stop_pending holds back closing a packet by its length
+		// until the UART has checked the stop bit of the last byte.
+		// Returns the change of the line state.
+		enum EVENT Update(const bool receiving, const bool stop_pending);
+
+		// Byte passes every byte decoded by the UART
+		void Byte(const uint8_t data, const bool err);
+
+		// Correction marks the last byte as invalid, the UART found its
+		// stop bit broken after passing it
+		void Correction(void);
+
+		// Returns true while a packet is being received
+		bool Busy(void);
+
+		// Learn sets the length of a packet type. hdr are the first three bytes.
+		void Learn(const uint8_t hdr[3], const uint8_t len);
+
+		// Returns the learned length of the packet type or 0 if unknown
+		uint8_t Length(const uint8_t hdr[3]);
+
+		// Returns the current idle timeout in samples
+		uint32_t IdleTimeout(void);
+
+		// Returns the number of packets closed by length and CRC
+		uint32_t FastCount(void);
+
+	private:
+		enum STATE {
+			// Line is idle
+			IDLE = 0,
+			// Receiving a packet
+			BUSY,
+			// Packet has been closed before the UART finished the last byte
+			CLOSING,
+		};
+
+		struct Entry {
+			uint8_t hdr[3];
+			uint8_t len;
+		};
+
+		struct Entry *Find(const uint8_t hdr[3]);
+		void Forget(const uint8_t hdr[3]);
+		enum EVENT Close(const bool fast);
+
+		enum STATE state;
+		struct Entry table[EOF_TABLE_SIZE];
+		size_t next_entry;
+
+		// Current packet
+		uint8_t hdr[3];
+		uint8_t length;
+		uint8_t expected;
+		uint8_t crc;
+		uint8_t crc_prev;
+		uint8_t last;
+		bool error;
+		bool complete;
+
+		// Samples since the UART finished the last byte
+		uint32_t idle;
+		// Largest gap between two bytes of the current packet
+		uint32_t gap_max_frame;
+		// Largest gap of the previous valid packets
+		uint32_t gap_max;
+		uint32_t timeout;
+
+		// The last packet was closed by length and CRC
+		bool last_fast;
+		uint8_t last_hdr[3];
+		uint32_t fast_count;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+#include <array>
+
+// Compile time design of FIR filter coefficients.
+// The RP2040 has no FPU, all floating point math is done by the compiler.
+namespace FIRDesign
+{
+    constexpr double PI = 3.14159265358979323846;
+
+    // Sine evaluated by the compiler. x is reduced to [-pi, pi] first.
+    constexpr double Sin(double x) {
+        while (x > PI)
+            x -= 2 * PI;
+        while (x < -PI)
+            x += 2 * PI;
+
+        double term = x, sum = x;
+        for (int i = 1; i < 12; i++) {
+            term *= -x * x / ((2 * i) * (2 * i + 1));
+            sum += term;
+        }
+        return sum;
+    }
+
+    constexpr double Cos(const double x) {
+        return Sin(x + PI / 2);
+    }
+
+    constexpr int32_t Round(const double x) {
+        return (int32_t)(x < 0 ? x - 0.5 : x + 0.5);
+    }
+
+    // Window applied to the sinc. A wider window has a larger stop band
+    // attenuation but a wider transition band for the same number of taps.
+    enum WINDOW {
+        RECTANGULAR = 0,
+        HAMMING,
+        BLACKMAN,
+    };
+
+    // Returns the window value of tap i out of N
+    constexpr double Window(const enum WINDOW w, const size_t i, const size_t N) {
+        const double x = 2 * PI * i / (N - 1);
+
+        switch (w) {
+        case HAMMING:
+            return 0.54 - 0.46 * Cos(x);
+        case BLACKMAN:
+            return 0.42 - 0.5 * Cos(x) + 0.08 * Cos(2 * x);
+        default:
+            return 1;
+        }
+    }
+
+    // LowPass returns the N taps of a windowed sinc low pass filter in Q15.
+    // cutoff and rate are in Hz. The taps are scaled for a DC gain of
+    // exactly 1 << 15 and are symmetric.
+    template <size_t N>
+    constexpr std::array<int32_t, N> LowPass(const uint32_t cutoff, const uint32_t rate,
+                                             const enum WINDOW w = HAMMING) {
+        std::array<double, N> h{};
+        std::array<int32_t, N> taps{};
+        const double fc = (double)cutoff / rate;
+        double sum = 0;
+        int32_t qsum = 0;
+
+        // Only the first half is calculated to get exactly symmetric taps
+        for (size_t i = 0; i < (N + 1) / 2; i++) {
+            const double n = i - (N - 1) / 2.0;
+            h[i] = n == 0 ? 2 * fc : Sin(2 * PI * fc * n) / (PI * n);
+            h[i] *= Window(w, i, N);
+            h[N - 1 - i] = h[i];
+        }
+        for (size_t i = 0; i < N; i++)
+            sum += h[i];
+        for (size_t i = 0; i < (N + 1) / 2; i++) {
+            taps[i] = Round(h[i] / sum * (1 << 15));
+            taps[N - 1 - i] = taps[i];
+        }
+        for (size_t i = 0; i < N; i++)
+            qsum += taps[i];
+        // Put the rounding error into the center tap
+        if (N % 2)
+            taps[(N - 1) / 2] += (1 << 15) - qsum;
+        return taps;
+    }
+
+    // HighPassPole returns the pole of a first order DC block filter in Q8.
+    // cutoff and rate are in Hz.
+    constexpr int32_t HighPassPole(const uint32_t cutoff, const uint32_t rate) {
+        return 256 - Round(2 * PI * cutoff / rate * 256);
+    }
+}
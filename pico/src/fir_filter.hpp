@@ -1,15 +1,41 @@
 #pragma once
 #include <inttypes.h>
+#include <array>
+
+#include "fir_design.hpp"
 #include "shiftreg.hpp"
 
+// Low pass FIR filter with N taps designed at compile time.
+// CUTOFF_HZ is the cutoff frequency and RATE_HZ the sample rate.
+// Longer filters and wider windows have a better stop band attenuation, but
+// need more cycles per sample. Introduces a delay of (N - 1) / 2 samples.
+template <size_t N, uint32_t CUTOFF_HZ, uint32_t RATE_HZ, FIRDesign::WINDOW W = FIRDesign::HAMMING>
 class FIRFilter
 {
+	static_assert(CUTOFF_HZ < RATE_HZ / 2, "Cutoff above the Nyquist frequency");
+
 	public:
-		FIRFilter(int32_t buffer_a[7 * 2], int32_t buffer_b[7 * 2]);
+		// Coefficients in Q15
+		static constexpr std::array<int32_t, N> TAPS = FIRDesign::LowPass<N>(CUTOFF_HZ, RATE_HZ, W);
+		// Multiplications per output sample, the taps are symmetric
+		static constexpr size_t MULTIPLICATIONS = (N + 1) / 2;
+
+		FIRFilter(int32_t buffer[N * 2]) :
+		reg(buffer)
+		{
+		}
+
+		// Update returns false if no new data is available.
+		// Update returns true if new data has been placed in out.
+		bool Update(const int32_t in, int32_t *out) {
+			// Shift in new value
+			this->reg.Update(in);
 
-		bool Update(const int32_t in, int32_t *out);
+			// Apply the filter
+			*out = this->reg.ConvoluteSymmetric(TAPS.data()) >> 15;
+			return true;
+		}
 
 	private:
-		ShiftReg<int32_t, 7> reg;
-		ShiftReg<int32_t, 7> coeff;
-};
\ No newline at end of file
+		ShiftReg<int32_t, N> reg;
+};
@@ -0,0 +1,249 @@
+#include <string.h>
+#include "frame.hpp"
+
+// Calculates the CRC16-CCITT (poly 0x1021, init 0xffff) over data[0]..data[len - 1]
+uint16_t Frame::CRC16(const uint8_t *data, size_t len) {
+	uint32_t crc = 0xffff;
+	for (size_t j = 0; j < len; j++) {
+		crc ^= (uint32_t)data[j] << 8;
+		for (size_t i = 0; i < 8; i++) {
+			if (crc & 0x8000)
+				crc = (crc << 1) ^ 0x1021;
+			else
+				crc = crc << 1;
+		}
+	}
+	return crc & 0xffff;
+}
+
+// Consistent Overhead Byte Stuffing. Removes all 0x00 from the data.
+// Returns the number of bytes written or 0 if out is too small.
+size_t Frame::CobsEncode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len) {
+	size_t code_off = 0;
+	size_t off = 1;
+	uint8_t code = 1;
+
+	if (out_len == 0)
+		return 0;
+
+	for (size_t i = 0; i < len; i++) {
+		if (off >= out_len)
+			return 0;
+		if (in[i] != 0) {
+			out[off++] = in[i];
+			code++;
+		}
+		if (in[i] == 0 || code == 0xff) {
+			out[code_off] = code;
+			code = 1;
+			code_off = off;
+			if (off >= out_len)
+				return 0;
+			off++;
+		}
+	}
+	out[code_off] = code;
+
+	return off;
+}
+
+// Reverts the COBS encoding.
+// Returns the number of bytes written or 0 on invalid input.
+size_t Frame::CobsDecode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len) {
+	size_t off = 0;
+	size_t i = 0;
+
+	while (i < len) {
+		uint8_t code = in[i++];
+		if (code == 0)
+			return 0;
+		for (uint8_t j = 1; j < code; j++) {
+			if (i >= len || in[i] == 0 || off >= out_len)
+				return 0;
+			out[off++] = in[i++];
+		}
+		if (code != 0xff && i < len) {
+			if (off >= out_len)
+				return 0;
+			out[off++] = 0;
+		}
+	}
+
+	return off;
+}
+
+// Encode writes the COBS encoded frame including the 0x00 delimiter to out.
+// Returns the number of bytes written or 0 if out is too small.
+size_t Frame::Encode(const Message& m, uint8_t *out, size_t len) {
+	uint8_t raw[FRAME_MAX_RAW_SIZE];
+	size_t off, ret;
+	uint16_t crc;
+
+	raw[0] = m.Status;
+	raw[1] = m.Length | (m.Bus ? FRAME_LENGTH_BUS : 0);
+	raw[2] = m.Timestamp;
+	raw[3] = m.Timestamp >> 8;
+	raw[4] = m.Timestamp >> 16;
+	raw[5] = m.Timestamp >> 24;
+	// Packets on the bus are much shorter than 65 msec
+	raw[6] = m.Duration < 0xffff ? m.Duration : 0xffff;
+	raw[7] = m.Duration < 0xffff ? m.Duration >> 8 : 0xff;
+	raw[8] = m.Gap;
+	raw[9] = m.Gap >> 8;
+	raw[10] = m.Gap >> 16;
+	raw[11] = m.Gap >> 24;
+	memcpy(&raw[FRAME_HEADER_SIZE], m.Data, m.Length);
+	off = FRAME_HEADER_SIZE + m.Length;
+
+	crc = CRC16(raw, off);
+	raw[off++] = crc;
+	raw[off++] = crc >> 8;
+
+	if (len < 1)
+		return 0;
+	ret = CobsEncode(raw, off, out, len - 1);
+	if (ret == 0)
+		return 0;
+	out[ret++] = 0;
+
+	return ret;
+}
+
+// Decode parses a COBS encoded frame without the 0x00 delimiter.
+// Returns false on invalid encoding or CRC mismatch.
+bool Frame::Decode(const uint8_t *in, size_t len, Message *m) {
+	uint8_t raw[FRAME_MAX_RAW_SIZE];
+	size_t raw_len;
+	uint8_t length;
+	uint16_t crc;
+
+	raw_len = CobsDecode(in, len, raw, sizeof(raw));
+	if (raw_len < FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+		return false;
+	length = raw[1] & ~FRAME_LENGTH_BUS;
+	if (length > MAX_PACKET_SIZE ||
+	    raw_len != (size_t)FRAME_HEADER_SIZE + length + FRAME_CRC_SIZE)
+		return false;
+
+	crc = raw[raw_len - 2] | (raw[raw_len - 1] << 8);
+	if (CRC16(raw, raw_len - FRAME_CRC_SIZE) != crc)
+		return false;
+
+	m->Status = raw[0];
+	m->Length = length;
+	m->Bus = raw[1] & FRAME_LENGTH_BUS ? 1 : 0;
+	m->Timestamp = raw[2] | (raw[3] << 8) | (raw[4] << 16) | ((uint32_t)raw[5] << 24);
+	m->Duration = raw[6] | (raw[7] << 8);
+	m->Gap = raw[8] | (raw[9] << 8) | (raw[10] << 16) | ((uint32_t)raw[11] << 24);
+	memcpy(m->Data, &raw[FRAME_HEADER_SIZE], m->Length);
+
+	return true;
+}
+
+// EncodeByte writes the COBS encoded byte frame including the 0x00
+// delimiter to out. status is the Message::STATUS of the byte, bus
+// the bus it was received on.
+// Returns the number of bytes written or 0 if out is too small.
+size_t Frame::EncodeByte(const uint8_t status, const uint8_t data,
+			 const uint32_t timestamp, const uint8_t bus,
+			 uint8_t *out, size_t len) {
+	uint8_t raw[FRAME_BYTE_RAW_SIZE];
+	size_t ret;
+	uint16_t crc;
+
+	raw[0] = FRAME_STREAM_BYTE | (status & FRAME_STREAM_STATUS_MASK) |
+		 (bus ? FRAME_STREAM_BUS : 0);
+	raw[1] = data;
+	raw[2] = timestamp;
+	raw[3] = timestamp >> 8;
+	raw[4] = timestamp >> 16;
+	raw[5] = timestamp >> 24;
+	crc = CRC16(raw, 6);
+	raw[6] = crc;
+	raw[7] = crc >> 8;
+
+	if (len < 1)
+		return 0;
+	ret = CobsEncode(raw, sizeof(raw), out, len - 1);
+	if (ret == 0)
+		return 0;
+	out[ret++] = 0;
+
+	return ret;
+}
+
+// DecodeByte parses a COBS encoded byte frame without the 0x00 delimiter.
+// Returns false on invalid encoding, CRC mismatch or other frame types.
+bool Frame::DecodeByte(const uint8_t *in, size_t len, uint8_t *status,
+		       uint8_t *data, uint32_t *timestamp, uint8_t *bus) {
+	uint8_t raw[FRAME_BYTE_RAW_SIZE];
+	uint16_t crc;
+
+	if (CobsDecode(in, len, raw, sizeof(raw)) != FRAME_BYTE_RAW_SIZE)
+		return false;
+	if (!(raw[0] & FRAME_STREAM_BYTE))
+		return false;
+
+	crc = raw[6] | (raw[7] << 8);
+	if (CRC16(raw, 6) != crc)
+		return false;
+
+	*status = raw[0] & FRAME_STREAM_STATUS_MASK;
+	*bus = raw[0] & FRAME_STREAM_BUS ? 1 : 0;
+	*data = raw[1];
+	*timestamp = raw[2] | (raw[3] << 8) | (raw[4] << 16) | ((uint32_t)raw[5] << 24);
+
+	return true;
+}
+
+// EncodeTxResult writes the COBS encoded result frame including the 0x00
+// delimiter to out. ok is false if the host messages are dropped.
+// Returns the number of bytes written or 0 if out is too small.
+size_t Frame::EncodeTxResult(const bool ok, const uint8_t type, const uint8_t writes,
+			     const uint8_t attempts, uint8_t *out, size_t len) {
+	uint8_t raw[FRAME_TX_RESULT_RAW_SIZE];
+	size_t ret;
+	uint16_t crc;
+
+	raw[0] = ok ? FRAME_TX_ACK : FRAME_TX_DROP;
+	raw[1] = type;
+	raw[2] = writes;
+	raw[3] = attempts;
+	crc = CRC16(raw, 4);
+	raw[4] = crc;
+	raw[5] = crc >> 8;
+
+	if (len < 1)
+		return 0;
+	ret = CobsEncode(raw, sizeof(raw), out, len - 1);
+	if (ret == 0)
+		return 0;
+	out[ret++] = 0;
+
+	return ret;
+}
+
+// DecodeTxResult parses a COBS encoded result frame without the 0x00
+// delimiter. Returns false on invalid encoding, CRC mismatch or other frame
+// types.
+bool Frame::DecodeTxResult(const uint8_t *in, size_t len, bool *ok, uint8_t *type,
+			   uint8_t *writes, uint8_t *attempts) {
+	uint8_t raw[FRAME_TX_RESULT_RAW_SIZE];
+	uint16_t crc;
+
+	if (CobsDecode(in, len, raw, sizeof(raw)) != FRAME_TX_RESULT_RAW_SIZE)
+		return false;
+	if (raw[0] != FRAME_TX_ACK && raw[0] != FRAME_TX_DROP)
+		return false;
+
+	crc = raw[4] | (raw[5] << 8);
+	if (CRC16(raw, 4) != crc)
+		return false;
+
+	*ok = raw[0] == FRAME_TX_ACK;
+	*type = raw[1];
+	*writes = raw[2];
+	*attempts = raw[3];
+
+	return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "message.hpp"
+
+// Binary frame layout before COBS encoding:
+//   Status (uint8) | Length (uint8) | Timestamp (uint32 LE) | Duration (uint16 LE) |
+//   Gap (uint32 LE) | Data[Length] | CRC16 (LE)
+// The MSB of Length is set for packets received on the second bus.
+#define FRAME_HEADER_SIZE 12
+#define FRAME_CRC_SIZE 2
+#define FRAME_MAX_RAW_SIZE (FRAME_HEADER_SIZE + MAX_PACKET_SIZE + FRAME_CRC_SIZE)
+// COBS adds one byte per 254 bytes plus the trailing 0x00 delimiter
+#define FRAME_MAX_ENCODED_SIZE (FRAME_MAX_RAW_SIZE + FRAME_MAX_RAW_SIZE / 254 + 2)
+
+// Byte frame layout of the streaming mode before COBS encoding:
+//   Status (uint8) | Data (uint8) | Timestamp (uint32 LE) | CRC16 (LE)
+// FRAME_STREAM_BUS is set in Status for bytes received on the second bus.
+#define FRAME_BYTE_RAW_SIZE 8
+#define FRAME_BYTE_ENCODED_SIZE (FRAME_BYTE_RAW_SIZE + 2)
+
+// Result frame of host messages sent with an answer before COBS encoding:
+//   Status (uint8) | Type (uint8) | Writes (uint8) | Attempts (uint8) | CRC16 (LE)
+// Status is FRAME_TX_ACK or FRAME_TX_DROP, Type the packet type of the answer.
+#define FRAME_TX_RESULT_RAW_SIZE 6
+#define FRAME_TX_RESULT_ENCODED_SIZE (FRAME_TX_RESULT_RAW_SIZE + 2)
+
+// Encodes and decodes messages in the compact binary host format.
+// Frames are COBS encoded and terminated by 0x00.
+// The code has no platform dependencies and serves as reference implementation
+// for host side tools.
+class Frame
+{
+	public:
+		enum FRAME_CMD {
+			// Host to modem: Transmit the payload on the bus
+			FRAME_CMD_TRANSMIT = 0x00,
+			// Host to modem: Switch back to the ASCII format
+			FRAME_CMD_MODE_ASCII = 0x80,
+		};
+
+		// Flags in the status field of frames sent in streaming mode.
+		// The lower bits hold the Message::STATUS.
+		enum FRAME_STREAM {
+			// Byte frame carrying a single received byte
+			FRAME_STREAM_BYTE = 0x40,
+			// Regular frame without data marking the end of a packet
+			FRAME_STREAM_END = 0x20,
+			FRAME_STREAM_STATUS_MASK = 0x1f,
+			// Byte frame received on the second bus
+			FRAME_STREAM_BUS = 0x80,
+		};
+
+		// Status of a result frame. Byte frames never set
+		// FRAME_STREAM_END.
+		enum FRAME_TX_RESULT {
+			// The host messages are on the bus
+			FRAME_TX_ACK = FRAME_STREAM_BYTE | FRAME_STREAM_END,
+			// The host messages are dropped after Attempts transmissions
+			FRAME_TX_DROP,
+		};
+
+		// Flag in the length field of a frame received on the second bus
+		static const uint8_t FRAME_LENGTH_BUS = 0x80;
+
+		// Encode writes the COBS encoded frame including the 0x00 delimiter to out.
+		// Returns the number of bytes written or 0 if out is too small.
+		static size_t Encode(const Message& m, uint8_t *out, size_t len);
+
+		// Decode parses a COBS encoded frame without the 0x00 delimiter.
+		// Returns false on invalid encoding or CRC mismatch.
+		static bool Decode(const uint8_t *in, size_t len, Message *m);
+
+		// EncodeByte writes the COBS encoded byte frame including the 0x00
+		// delimiter to out. status is the Message::STATUS of the byte, bus
+		// the bus it was received on.
+		// Returns the number of bytes written or 0 if out is too small.
+		static size_t EncodeByte(const uint8_t status, const uint8_t data,
+					 const uint32_t timestamp, const uint8_t bus,
+					 uint8_t *out, size_t len);
+
+		// DecodeByte parses a COBS encoded byte frame without the 0x00 delimiter.
+		// Returns false on invalid encoding, CRC mismatch or other frame types.
+		static bool DecodeByte(const uint8_t *in, size_t len, uint8_t *status,
+				       uint8_t *data, uint32_t *timestamp, uint8_t *bus);
+
+		// EncodeTxResult writes the COBS encoded result frame including the
+		// 0x00 delimiter to out. ok is false if the host messages are dropped.
+		// Returns the number of bytes written or 0 if out is too small.
+		static size_t EncodeTxResult(const bool ok, const uint8_t type, const uint8_t writes,
+					     const uint8_t attempts, uint8_t *out, size_t len);
+
+		// DecodeTxResult parses a COBS encoded result frame without the 0x00
+		// delimiter. Returns false on invalid encoding, CRC mismatch or other
+		// frame types.
+		static bool DecodeTxResult(const uint8_t *in, size_t len, bool *ok, uint8_t *type,
+					   uint8_t *writes, uint8_t *attempts);
+
+		// Calculates the CRC16-CCITT over data[0]..data[len - 1]
+		static uint16_t CRC16(const uint8_t *data, size_t len);
+
+	private:
+		static size_t CobsEncode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+		static size_t CobsDecode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+};
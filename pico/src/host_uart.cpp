@@ -1,76 +1,248 @@
 #include <inttypes.h>
+#include <string.h>
 #include "host_uart.hpp"
 #include "pico/stdlib.h"
 #include "hardware/uart.h"
 #include "hardware/irq.h"
+#include "hardware/dma.h"
 #include "pico/bootrom.h"
+#include "tusb.h"
+#include <cassert>
 #include <iostream>
 
+// Enables the RX interrupts of the hardware UART. The TX interrupt is
+// never enabled, the UART is fed by DMA and nothing clears it.
+static void uart_rx_irq_enable(const bool enabled) {
+	uart_set_irq_enables(uart0, enabled, false);
+}
+
 static void on_uart_irq() {
 	HostUART& u = HostUART::getInstance();
-	u.CheckTXFIFO();
-	u.CheckRXFIFO();
+	u.OnRxIrq();
+}
+
+static void on_dma_irq() {
+	HostUART& u = HostUART::getInstance();
+	u.OnTxDmaIrq();
 }
 
 HostUART::HostUART() :
-	error(false), tx_fifo(), rx_fifo(), rx_msgs_ext_ctrl(), rx_msgs_generic()
+	error(false), mode(MODE_ASCII), timestamps(false), streaming(false), stats_requested(false),
+	tx_uart(), tx_usb(),
+	tx_uart_dma_len(0), tx_uart_dma_channel(-1), rx_usb(), rx_uart(), rx_drops(0),
+	rx_msgs_ext_ctrl(), rx_msgs_generic()
 {
-	uart_set_baudrate(uart0, 115200);
+}
+
+// Init configures the hardware UART and the DMA.
+// Must be called after stdio_init_all().
+void HostUART::Init(void) {
+	uart_init(uart0, HOST_UART_BAUD_RATE);
+	gpio_set_function(HostUART::PIN_TX, GPIO_FUNC_UART);
+	gpio_set_function(HostUART::PIN_RX, GPIO_FUNC_UART);
 
 	// Set UART flow control CTS/RTS, we don't want these, so turn them off
 	uart_set_hw_flow(uart0, false, false);
 
+	// Get a free channel, panic() if there are none
+	this->tx_uart_dma_channel = dma_claim_unused_channel(true);
+
+	dma_channel_config c = dma_channel_get_default_config(this->tx_uart_dma_channel);
+	// 8 bit transfers
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	// increment the read adddress, don't increment write address
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	// wrap the read address at the end of the ring
+	channel_config_set_ring(&c, false, __builtin_ctz(HOST_TX_UART_LEN));
+
+	// Pace transfers based on availability of UART TX FIFO space
+	channel_config_set_dreq(&c, uart_get_dreq(uart0, true));
+
+	dma_channel_configure(this->tx_uart_dma_channel, &c,
+		&uart_get_hw(uart0)->dr,                   // dst
+		this->tx_uart.ReadPtr(),                   // src
+		0,                                         // transfer count
+		false                                      // start immediately
+	);
+
+	// DMA_IRQ_0 is used by the ADC on core1
+	irq_set_exclusive_handler(DMA_IRQ_1, on_dma_irq);
+	irq_set_enabled(DMA_IRQ_1, true);
+	dma_channel_set_irq1_enabled(this->tx_uart_dma_channel, true);
+
 	// And set up and enable the interrupt handlers
 	irq_set_exclusive_handler(UART0_IRQ, on_uart_irq);
 	irq_set_enabled(UART0_IRQ, true);
 
-	// Now enable the UART to send interrupts
-	uart_set_irq_enables(uart0, true, true);
+	// Now enable the UART to send RX interrupts
+	uart_rx_irq_enable(true);
 }
 
 HostUART::~HostUART() 
 {
-	uart_set_irq_enables(uart0, false, false);
+	uart_rx_irq_enable(false);
 
 	irq_set_enabled(UART0_IRQ, false);
 
 	irq_remove_handler(UART0_IRQ, on_uart_irq);
+
+	if (this->tx_uart_dma_channel >= 0) {
+		dma_channel_set_irq1_enabled(this->tx_uart_dma_channel, false);
+		dma_channel_abort(this->tx_uart_dma_channel);
+		dma_channel_unclaim(this->tx_uart_dma_channel);
+	}
 }
 
-// Receiving returns true as long as data is being received
+// The IRQ only wakes the CPU. Mask the RX interrupt until the main loop
+// has read the hardware FIFO.
+void HostUART::OnRxIrq(void) {
+	if (uart_is_readable(uart0))
+		uart_rx_irq_enable(false);
+	// An enabled TX interrupt would fire without end
+	assert(!(uart_get_hw(uart0)->imsc & UART_UARTIMSC_TXIM_BITS));
+}
+
+// CheckRXFIFO reads all pending data from USB CDC and UART in chunks
+// and handles complete lines.
 void HostUART::CheckRXFIFO(void) {
-	int c;
-	while ((c = getchar_timeout_us(0)) >= 0) {
-		if (this->rx_fifo.Full()) {
-			// Should never happen
-			this->rx_fifo.Clear();
-		}
-		if (c == '\r' || c == '\n') {
-			if (!this->rx_fifo.Empty()) {
-				this->rx_fifo.Push(0);
-				this->OnLineReceived(this->rx_fifo.Data());
-				this->rx_fifo.Clear();
-			}
-		} else {
-			this->rx_fifo.Push(c);
-		}
+	uint32_t save;
+	uint8_t *ptr;
+	size_t space, len;
+
+	// The USB stack runs in an IRQ on this core
+	save = save_and_disable_interrupts();
+	if (tud_cdc_available()) {
+		ptr = this->rx_usb.WritePtr(&space);
+		this->rx_usb.Commit(tud_cdc_read(ptr, space));
 	}
+	restore_interrupts(save);
+
+	ptr = this->rx_uart.WritePtr(&space);
+	for (len = 0; len < space && uart_is_readable(uart0); len++)
+		ptr[len] = uart_getc(uart0);
+	this->rx_uart.Commit(len);
+	uart_rx_irq_enable(true);
+
+	this->ProcessLines(this->rx_usb);
+	this->ProcessLines(this->rx_uart);
 }
 
-void HostUART::CheckTXFIFO(void) {
-	while (uart_is_writable(uart0) && !this->tx_fifo.Empty()) {
-		uint8_t c;
-		if (this->tx_fifo.Pop(&c))
-			putchar_raw(c);
+// ProcessLines handles all complete lines or frames in the buffer
+void HostUART::ProcessLines(LineBuffer<HOST_RX_BUFFER_LEN>& buf) {
+	size_t len;
+
+	for (;;) {
+		// The mode might change with every line
+		const bool binary = this->mode == MODE_BINARY;
+		char *line = buf.Pop(&len, binary);
+
+		if (line == nullptr)
+			break;
+		if (binary)
+			this->OnFrameReceived((uint8_t *)line, len);
+		else
+			this->OnLineReceived(line);
+	}
+
+	if (this->rx_usb.Drops() + this->rx_uart.Drops() != this->rx_drops) {
+		this->rx_drops = this->rx_usb.Drops() + this->rx_uart.Drops();
+		this->error = true;
+	}
+}
+
+// Returns the number of host lines dropped due to buffer overrun
+uint32_t HostUART::RxDrops(void) {
+	return this->rx_drops;
+}
+
+// Returns the number of messages dropped on the hardware UART
+uint32_t HostUART::TxDropsUart(void) {
+	return this->tx_uart.Dropped();
+}
+
+// Returns the number of messages dropped on USB CDC
+uint32_t HostUART::TxDropsUsb(void) {
+	return this->tx_usb.Dropped();
+}
+
+void HostUART::OnTxDmaIrq(void) {
+	dma_channel_acknowledge_irq1(this->tx_uart_dma_channel);
+	this->CheckTxUart();
+}
+
+// Start the DMA on the hardware UART if it's idle and data is queued.
+// Must be called with interrupts disabled.
+void HostUART::CheckTxUart(void) {
+	if (this->tx_uart_dma_channel < 0 || dma_channel_is_busy(this->tx_uart_dma_channel))
+		return;
+
+	// The previous transfer has finished
+	this->tx_uart.Consume(this->tx_uart_dma_len);
+
+	// The DMA wraps the read address at the end of the ring
+	this->tx_uart_dma_len = this->tx_uart.Length();
+	if (this->tx_uart_dma_len == 0)
+		return;
+
+	dma_channel_set_read_addr(this->tx_uart_dma_channel, this->tx_uart.ReadPtr(), false);
+	dma_channel_set_trans_count(this->tx_uart_dma_channel, this->tx_uart_dma_len, true);
+}
+
+// Write as much as possible to the USB CDC in bulk.
+// Discard the data when no host is connected.
+void HostUART::CheckTxUsb(void) {
+	uint32_t save;
+
+	// The USB stack runs in an IRQ on this core
+	save = save_and_disable_interrupts();
+	if (!tud_cdc_connected()) {
+		this->tx_usb.Discard();
+	} else if (this->tx_usb.Length()) {
+		size_t len;
+		while ((len = this->tx_usb.Contiguous()) > 0) {
+			len = tud_cdc_write(this->tx_usb.ReadPtr(), len);
+			if (len == 0)
+				break;
+			this->tx_usb.Consume(len);
+		}
+		tud_cdc_write_flush();
 	}
+	restore_interrupts(save);
 }
 
+void HostUART::CheckTXFIFO(void) {
+	uint32_t save;
+
+	save = save_and_disable_interrupts();
+	this->CheckTxUart();
+	restore_interrupts(save);
+
+	this->CheckTxUsb();
+}
 
 void HostUART::Check(void) {
 	this->CheckTXFIFO();
 	this->CheckRXFIFO();
 }
 
+// Returns true when data is waiting on one of the host interfaces
+bool HostUART::RxPending(void) {
+	return tud_cdc_available() > 0 || uart_is_readable(uart0);
+}
+
+// Returns true when data couldn't be passed to USB CDC yet
+bool HostUART::TxPending(void) {
+	return this->tx_usb.Length() > 0;
+}
+
+// Returns true once after the host requested the scheduler statistics
+bool HostUART::StatsRequested(void) {
+	bool requested = this->stats_requested;
+	this->stats_requested = false;
+	return requested;
+}
+
 bool HostUART::HasDataExtController(void) {
 	return !this->rx_msgs_ext_ctrl.Empty();
 }
@@ -97,19 +269,76 @@ Message HostUART::PopGeneric(void) {
 	return m;
 }
 
+// IsCommand returns true if line contains the command ;!cmd!;
+static bool IsCommand(const char *line, const char *cmd) {
+	size_t len = strlen(cmd);
+
+	return line[0] == ';' && line[1] == '!' &&
+		strncmp(&line[2], cmd, len) == 0 &&
+		line[len + 2] == '!' && line[len + 3] == ';';
+}
+
 void HostUART::OnLineReceived(char *line) {
-	if (line[0] == ';' && line[1] == '!' && line[2] == 'B' && line[3] == 'L' &&
-	    line[4] == 'D' && line[5] == '!' && line[6] == ';') {
+	if (IsCommand(line, "BLD")) {
 		reset_usb_boot(0,0);
 		return;
 	}
+	if (IsCommand(line, "BIN")) {
+		this->mode = MODE_BINARY;
+		return;
+	}
+	if (IsCommand(line, "TS1")) {
+		this->timestamps = true;
+		return;
+	}
+	if (IsCommand(line, "TS0")) {
+		this->timestamps = false;
+		return;
+	}
+	if (IsCommand(line, "STR1")) {
+		this->streaming = true;
+		return;
+	}
+	if (IsCommand(line, "STR0")) {
+		this->streaming = false;
+		return;
+	}
+	if (IsCommand(line, "SCH")) {
+		this->stats_requested = true;
+		return;
+	}
 	if (line[0] == 0 || line[0] == '#' || line[0] == ';') {
 		return;
 	}
 
 	Message m(line);
 
-	if (m.Length > 3 && m.Data[0] == 0x40 && m.Data[1] == 0xf0 && (m.Data[2] & 0xF0) == 0x30)
+	this->Dispatch(m);
+}
+
+void HostUART::OnFrameReceived(const uint8_t *data, size_t len) {
+	Message m;
+
+	if (!Frame::Decode(data, len, &m)) {
+		this->error = true;
+		return;
+	}
+
+	if (m.Status == Frame::FRAME_CMD_MODE_ASCII) {
+		this->mode = MODE_ASCII;
+		return;
+	} else if (m.Status != Frame::FRAME_CMD_TRANSMIT) {
+		return;
+	}
+	m.Status = 0;
+
+	this->Dispatch(m);
+}
+
+// Dispatch queues a message received from the host for transmission
+void HostUART::Dispatch(Message& m) {
+	// Answers of an external controller on 0xF0 - 0xF1
+	if (m.Length > 3 && m.Data[0] == 0x40 && (m.Data[1] & 0xfe) == 0xf0 && (m.Data[2] & 0xF0) == 0x30)
 		this->rx_msgs_ext_ctrl.Push(m);
 	else if (m.Length > 3)
 		this->rx_msgs_generic.Push(m);
@@ -124,30 +353,141 @@ void HostUART::UpdateAndSend(Message& m) {
 }
 
 void HostUART::Send(Message& m) {
+	if (this->mode == MODE_BINARY)
+		this->SendBinary(m);
+	else
+		this->SendAscii(m);
+}
+
+// Send a raw string to the host, i.e. comments
+// Dropped in binary mode as it would corrupt the framing.
+void HostUART::SendString(const char *str) {
+	if (this->mode == MODE_BINARY)
+		return;
+	this->Queue((const uint8_t *)str, strlen(str));
+}
+
+// Queue the data on all host interfaces and start the transmission.
+// Every interface applies its own drop policy:
+// - The hardware UART drops new messages when the queue is full.
+// - USB CDC drops new messages when the queue is full and discards everything
+//   when no host is connected.
+void HostUART::Queue(const uint8_t *data, size_t len) {
 	uint32_t save;
 
-	const char *line = m.c_str();
-	while (line[0]) {
-		if (!this->tx_fifo.Full()) {
-			this->tx_fifo.Push(line[0]);
-		} else {
-			this->error = true;
-			return;
-		}
-		line++;
+	save = save_and_disable_interrupts();
+	if (!this->tx_uart.Push(data, len))
+		this->error = true;
+	this->CheckTxUart();
+	restore_interrupts(save);
+
+	if (!this->tx_usb.Push(data, len) && tud_cdc_connected())
+		this->error = true;
+	this->CheckTxUsb();
+}
+
+// Streaming mode: received bytes are sent one by one followed by an
+// end of frame marker instead of whole packets.
+bool HostUART::Streaming(void) {
+	return this->streaming;
+}
+
+// Send a single byte received on the bus. timestamp is the start of
+// the byte in microseconds since boot.
+void HostUART::SendByte(const uint8_t data, const bool err, const uint32_t timestamp,
+			const uint8_t bus) {
+	if (this->mode == MODE_BINARY) {
+		uint8_t frame[FRAME_BYTE_ENCODED_SIZE];
+		size_t len;
+
+		len = Frame::EncodeByte(err ? Message::STATUS_ERR_PARITY : Message::STATUS_OK,
+					data, timestamp, bus, frame, sizeof(frame));
+		this->Queue(frame, len);
+	} else {
+		char line[32];
+		size_t len;
+
+		if (RX_BUSES > 1)
+			len = snprintf(line, sizeof(line), "~%02x%s t=%u b=%u\r\n", data,
+				       err ? " P" : "", timestamp, bus);
+		else
+			len = snprintf(line, sizeof(line), "~%02x%s t=%u\r\n", data,
+				       err ? " P" : "", timestamp);
+		this->Queue((const uint8_t *)line, len);
 	}
-	if (!this->tx_fifo.Full()) {
-		this->tx_fifo.Push('\r');
+}
+
+// Send the result of writes host messages sent with an answer of type.
+// ok is false if they are dropped after attempts transmissions.
+void HostUART::SendTxResult(const bool ok, const uint8_t type, const uint8_t writes,
+			    const uint8_t attempts) {
+	if (this->mode == MODE_BINARY) {
+		uint8_t frame[FRAME_TX_RESULT_ENCODED_SIZE];
+		size_t len;
+
+		len = Frame::EncodeTxResult(ok, type, writes, attempts, frame, sizeof(frame));
+		this->Queue(frame, len);
 	} else {
-		this->error = true;
+		char line[32];
+		size_t len;
+
+		len = snprintf(line, sizeof(line), "# %s %02x %u %u\r\n", ok ? "ack" : "drop",
+			       type, writes, attempts);
+		this->Queue((const uint8_t *)line, len);
 	}
-	if (!this->tx_fifo.Full()) {
-		this->tx_fifo.Push('\n');
+}
+
+// Send the end of frame marker with the status and timing of m.
+// The data of m has already been sent by SendByte.
+void HostUART::SendEndOfFrame(Message& m) {
+	if (this->error) {
+		m.Status |= Message::STATUS_ERR_OVERFLOW;
+		this->error = false;
+	}
+
+	if (this->mode == MODE_BINARY) {
+		Message end;
+
+		end.Status = Frame::FRAME_STREAM_END | (m.Status & Frame::FRAME_STREAM_STATUS_MASK);
+		end.Bus = m.Bus;
+		end.Timestamp = m.Timestamp;
+		end.Duration = m.Duration;
+		end.Gap = m.Gap;
+		this->SendBinary(end);
 	} else {
+		char line[64];
+		size_t len;
+
+		if (RX_BUSES > 1)
+			len = snprintf(line, sizeof(line), "~$ %02x t=%u d=%u g=%u b=%u\r\n",
+				       (unsigned)m.Status, m.Timestamp, m.Duration, m.Gap, m.Bus);
+		else
+			len = snprintf(line, sizeof(line), "~$ %02x t=%u d=%u g=%u\r\n",
+				       (unsigned)m.Status, m.Timestamp, m.Duration, m.Gap);
+		this->Queue((const uint8_t *)line, len);
+	}
+}
+
+void HostUART::SendBinary(Message& m) {
+	uint8_t frame[FRAME_MAX_ENCODED_SIZE];
+	size_t len;
+
+	len = Frame::Encode(m, frame, sizeof(frame));
+	if (len == 0) {
 		this->error = true;
+		return;
 	}
+	this->Queue(frame, len);
+}
 
-	save = save_and_disable_interrupts();
-	this->CheckTXFIFO();
-	restore_interrupts(save);
+void HostUART::SendAscii(Message& m) {
+	char line[160];
+	size_t len;
+
+	len = snprintf(line, sizeof(line), "%s\r\n", m.c_str(this->timestamps, RX_BUSES > 1));
+	if (len >= sizeof(line)) {
+		this->error = true;
+		return;
+	}
+	this->Queue((const uint8_t *)line, len);
 }
@@ -1,9 +1,15 @@
 #include "fifo_irqsafe.hpp"
-#include "line_receiver_irqsafe.hpp"
+#include "line_buffer.hpp"
+#include "tx_ring.hpp"
+#include "defines.hpp"
 
 #include "message.hpp"
+#include "frame.hpp"
 
 #define MAX_PACKET_SIZE 32
+#define HOST_TX_UART_LEN 1024
+#define HOST_TX_USB_LEN 1024
+#define HOST_RX_BUFFER_LEN 512
 
 // High level abstraction of UART
 class HostUART
@@ -12,12 +18,17 @@ class HostUART
 		HostUART(void);
 		~HostUART(void);
 
+		// The buffers don't fit into scratch memory
 		static HostUART& getInstance(void)
 		{
-			__scratch_y("host_uart_instance") static HostUART instance;
+			static HostUART instance;
 			return instance;
 		}
 
+		// Init configures the hardware UART and the DMA.
+		// Must be called after stdio_init_all().
+		void Init(void);
+
 		HostUART(HostUART const&) = delete;
 		void operator=(HostUART const&) = delete;
 
@@ -27,25 +38,93 @@ class HostUART
 			PARITY_ODD,
 		};
 
+		enum HOST_MODE {
+			// Hex encoded ASCII lines
+			MODE_ASCII = 0,
+			// COBS encoded binary frames
+			MODE_BINARY,
+		};
+
 		void OnLineReceived(char *line);
+		void OnFrameReceived(const uint8_t *data, size_t len);
 
 		void UpdateAndSend(Message& m);
 		void Send(Message& m);
+		// Send a raw string to the host, i.e. comments. Not sent in binary mode.
+		void SendString(const char *str);
+		// Streaming mode: received bytes are sent one by one followed by an
+		// end of frame marker instead of whole packets.
+		bool Streaming(void);
+		// Send a single byte received on the bus. timestamp is the start of
+		// the byte in microseconds since boot.
+		void SendByte(const uint8_t data, const bool err, const uint32_t timestamp,
+			      const uint8_t bus);
+		// Send the end of frame marker with the status and timing of m.
+		// The data of m has already been sent by SendByte.
+		void SendEndOfFrame(Message& m);
+		// Send the result of writes host messages sent with an answer of
+		// type. ok is false if they are dropped after attempts transmissions.
+		void SendTxResult(const bool ok, const uint8_t type, const uint8_t writes,
+				  const uint8_t attempts);
 		Message PopExtController(void);
 		Message PopGeneric(void);
 
 		void Check(void);
+		// Returns true when data is waiting on one of the host interfaces
+		bool RxPending(void);
+		// Returns true when data couldn't be passed to USB CDC yet
+		bool TxPending(void);
+		// Returns true once after the host requested the scheduler statistics
+		bool StatsRequested(void);
 		bool HasDataExtController(void);
 		bool HasDataGeneric(void);
 
 		void CheckRXFIFO(void);
 		void CheckTXFIFO(void);
+
+		// Called from the UART IRQ. Defers reading to CheckRXFIFO.
+		void OnRxIrq(void);
+		// Called from the DMA IRQ when the UART transfer has finished.
+		void OnTxDmaIrq(void);
+
+		// Returns the number of host lines dropped due to buffer overrun
+		uint32_t RxDrops(void);
+		// Returns the number of messages dropped on the hardware UART
+		uint32_t TxDropsUart(void);
+		// Returns the number of messages dropped on USB CDC
+		uint32_t TxDropsUsb(void);
 	private:
+		void Queue(const uint8_t *data, size_t len);
+		void CheckTxUart(void);
+		void CheckTxUsb(void);
+		void ProcessLines(LineBuffer<HOST_RX_BUFFER_LEN>& buf);
+		void Dispatch(Message& m);
+		void SendAscii(Message& m);
+		void SendBinary(Message& m);
 
 		// error is true on buffer overrun. Should never happen.
 		bool error;
-		FifoIrqSafe<uint8_t, 128> tx_fifo;
-		LineReceiverIrqSafe<char, 128> rx_fifo;
+		// The format used on the host interfaces
+		enum HOST_MODE mode;
+		// Append packet timing to ASCII lines
+		bool timestamps;
+		// Send received bytes one by one
+		bool streaming;
+		bool stats_requested;
+		// Separate transmit queues, a slow consumer must not throttle the other interface
+		TxRing<HOST_TX_UART_LEN> tx_uart;
+		TxRing<HOST_TX_USB_LEN> tx_usb;
+		// Bytes of tx_uart currently transferred by the DMA
+		size_t tx_uart_dma_len;
+		int tx_uart_dma_channel;
+		// Separate receive buffers as lines from both interfaces might interleave
+		LineBuffer<HOST_RX_BUFFER_LEN> rx_usb;
+		LineBuffer<HOST_RX_BUFFER_LEN> rx_uart;
+		uint32_t rx_drops;
 		FifoIrqSafe<Message, 8> rx_msgs_ext_ctrl;
 		FifoIrqSafe<Message, 8> rx_msgs_generic;
+
+		// Pin0 and Pin1 are connected to the RPi UART
+		static const uint PIN_TX = 0;
+		static const uint PIN_RX = 1;
 };
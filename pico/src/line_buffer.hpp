@@ -0,0 +1,117 @@
+#pragma once
+#include "inttypes.h"
+#include <string.h>
+#include <stddef.h>
+
+// Receive buffer for host commands.
+// The interface drivers read whole chunks directly into the buffer.
+// Complete lines are split in place and returned without further copies.
+// Not IRQ safe. The caller must serialize access.
+template <size_t N>
+class LineBuffer
+{
+  public:
+    LineBuffer() : data{}, head(0), scan(0), tail(0), drops(0), discard(false) {
+    }
+
+    // WritePtr returns a pointer to the free space at the end of the buffer.
+    // space is set to the number of bytes that can be written.
+    // Moves a partially received line to the start of the buffer to make room.
+    uint8_t *WritePtr(size_t *space) {
+        if (this->head > 0) {
+            memmove(this->data, &this->data[this->head], this->tail - this->head);
+            this->tail -= this->head;
+            this->scan -= this->head;
+            this->head = 0;
+        }
+        if (this->tail == N) {
+            // A single line doesn't fit into the buffer. Drop it
+            // including the remaining part not yet received.
+            this->tail = 0;
+            this->scan = 0;
+            this->drops++;
+            this->discard = true;
+        }
+        *space = N - this->tail;
+        return &this->data[this->tail];
+    }
+
+    // Commit marks len bytes written at WritePtr as valid.
+    void Commit(const size_t len) {
+        this->tail += len;
+    }
+
+    // Write copies the data into the buffer.
+    void Write(const uint8_t *in, size_t len) {
+        while (len > 0) {
+            size_t space;
+            uint8_t *ptr = this->WritePtr(&space);
+            size_t n = len < space ? len : space;
+
+            memcpy(ptr, in, n);
+            this->Commit(n);
+            in += n;
+            len -= n;
+        }
+    }
+
+    // Pop returns the next complete line and terminates it with 0 in place.
+    // In binary mode lines are terminated by 0x00, else by CR or LF.
+    // Empty lines are skipped. Returns nullptr if no complete line is available.
+    // The returned pointer is valid until WritePtr or Write is called.
+    char *Pop(size_t *len, const bool binary) {
+        while (this->scan < this->tail) {
+            const uint8_t c = this->data[this->scan++];
+
+            if (!IsDelimiter(c, binary))
+                continue;
+
+            char *line = (char *)&this->data[this->head];
+            *len = this->scan - 1 - this->head;
+            this->data[this->scan - 1] = 0;
+            this->head = this->scan;
+            if (this->discard) {
+                this->discard = false;
+                continue;
+            }
+            if (*len > 0)
+                return line;
+        }
+        return nullptr;
+    }
+
+    // Length returns the number of bytes not yet consumed
+    size_t Length(void) {
+        return this->tail - this->head;
+    }
+
+    // Drops returns the number of lines dropped as they didn't fit into the buffer
+    uint32_t Drops(void) {
+        return this->drops;
+    }
+
+    void Clear(void) {
+        this->head = 0;
+        this->scan = 0;
+        this->tail = 0;
+        this->discard = false;
+    }
+
+  private:
+    static inline bool IsDelimiter(const uint8_t c, const bool binary) {
+        if (binary)
+            return c == 0;
+        return c == '\r' || c == '\n';
+    }
+
+    uint8_t data[N];
+    // Start of the oldest not consumed line
+    size_t head;
+    // Position up to which the data was searched for delimiters
+    size_t scan;
+    // End of valid data
+    size_t tail;
+    uint32_t drops;
+    // Drop data till the next delimiter
+    bool discard;
+};
@@ -1,6 +1,9 @@
 #pragma once
 #include "shiftreg.hpp"
 
+// Carrier sense on the bus signal before the bit detector.
+// Counts the samples above level in a sliding window of N samples.
+// Update and Busy are O(1).
 template <size_t N>
 class LineBusy
 {
@@ -8,31 +11,31 @@ class LineBusy
 		LineBusy(const int32_t level) :
 		buffer{0},
 		reg(buffer),
-		level(level)
+		level(level),
+		count(0)
 		{
 		}
 
 		void Update(const int32_t in) {
+			const uint8_t active = in > this->level || in < -this->level;
+			uint8_t oldest;
+
 			// Shift in new value
-			this->reg.Update(in, NULL);
+			this->reg.Update(active, &oldest);
+			this->count += active;
+			this->count -= oldest;
 		}
 
 		// Busy returns true if a "0" symbol is likely being transmitted on the line
 		// This function is not as accurate as the uart_bit_detect
 		bool Busy(void) {
-			size_t cnt = 0;
-			for (size_t i = 0; i < N; i++)
-				if (this->reg.At(i) > level || this->reg.At(i) < -level)
-					cnt ++;
-			if (cnt > (N / 8) && cnt <= (N * 5 / 8))
-				return true;
-			return false;
+			return this->count > (N / 8) && this->count <= (N * 5 / 8);
 		}
 
 	private:
-		int32_t buffer[N * 2];
-		ShiftReg<int32_t, N> reg;
+		uint8_t buffer[N * 2];
+		ShiftReg<uint8_t, N> reg;
 		int32_t level;
+		// Number of samples above level in the window
+		size_t count;
 };
-
-
@@ -7,18 +7,19 @@
 
 #include "adc.hpp"
 #include "adc_sw.hpp"
-#include "uart.hpp"
-#include "fir_filter.hpp"
-#include "resample.hpp"
+#include "rx_pipeline.hpp"
+#include "spsc_ring.hpp"
 #include "uart_pio.hpp"
 #include "led_driver.hpp"
 #include "host_uart.hpp"
-#include "dcblock.hpp"
 #include "led_manager.hpp"
-#include "level_detect.hpp"
-#include "uart_bit_detect_fast.hpp"
 #include "standalone.hpp"
 #include "tx_statemachine.hpp"
+#include "scheduler.hpp"
+#include "collision_detect.hpp"
+#include "daikin_crc.hpp"
+#include "packet_repair.hpp"
+#include "bus_schedule.hpp"
 
 //
 // Global signal processing blocks
@@ -37,59 +38,36 @@ __scratch_x("ADCInstance") int16_t adc_data[0x100] __attribute__ ((aligned(0x200
 DifferentialADC& dadc = DifferentialADC::getInstance(adc_data);
 #endif
 
-// filter implements a FIR filter to reduce high frequency noise
-// captured by the ADC. As the FIR filter is processing intense,
-// the length was set to 7.
-// Introduces a delay of about 4 ADC samples.
-__scratch_x("FIRFilter1") int32_t fir_data1[7 * 2];
-__scratch_x("FIRFilter2") int32_t fir_data2[7 * 2];
-FIRFilter filter(fir_data1, fir_data2);
-
-#if (FIR_OVERSAMPLING_RATE / UART_OVERSAMPLING_RATE) == 4
-// resampler drops 3 samples out of 4 as it's not needed any more after
-// FIR filtering the signal.
-// Provides an 8x oversampled signal.
-Resample<int32_t> resampler(3);
+// rx decodes the P1P2 data signal of every bus to bytes and detects the
+// start and the end of packets:
+// - A band pass filter removes the high frequency noise captured by the ADC
+//   and the DC offset. It's only evaluated for the samples kept after
+//   decimation.
+// - Level applies the P1P2 bus hysteresis.
+// - UARTBit returns the probabilty for a high or low pulse.
+// - The UART detects parity errors, frame errors and DC errors ("0" not
+//   encoded as alternating up/down).
+// - A carrier sense and EndOfFrame detect the start and the end of packets.
+// Packets are transmitted on the first bus only.
+// With RX_SPLIT_CORES core1 runs the signal processing up to UARTBit, core0
+// runs the UART and EndOfFrame.
+typedef RxPipeline<FIR_OVERSAMPLING_RATE / UART_OVERSAMPLING_RATE> RxBus;
+__scratch_x("RxPipeline") RxBus rx0;
+#if RX_BUSES > 1
+RxBus rx1;
+RxBus *const rx[RX_BUSES] = {&rx0, &rx1};
 #else
-#if (FIR_OVERSAMPLING_RATE / UART_OVERSAMPLING_RATE) == 2
-// resampler drops 1 samples out of 2 as it's not needed any more after
-// FIR filtering the signal.
-// Provides an 8x oversampled signal.
-Resample<int32_t> resampler(1);
-#else
-#error Unsupported FIR_OVERSAMPLING_RATE to UART_OVERSAMPLING_RATE ratio!
-#endif
+RxBus *const rx[RX_BUSES] = {&rx0};
 #endif
 
-// dcblock removes the DC level by using about 200 samples. DC offsets can
-// appear when the used resistors have a high tolerance and don't properly
-// match each others value.
-DCblock dcblock;
-
-// p1p2uart decodes the P1P2 data signal to bytes. It can detect parity errors, frame
-// errors and DC errors ("0" not encoded as alternating up/down).
-__scratch_x("UART") int16_t uart_data[UART_BUFFER_LEN * 2];
-UART p1p2uart(uart_data, UART::PARITY_EVEN);
-
-// Level applies the P1P2 bus hysteresis.
-// The low level signal amplitude is reduced to 0.1.
-// The high level signal amplitude is unchanged.
-Level<int32_t> level;
-
-// bit returns the probabilty for a high or low pulse found in the signal.
-// Allow 0xE0/0x100 bit errors = 12,5%
-__scratch_x("UARTBit1") int32_t uart_bit_data[UART_OVERSAMPLING_RATE * 2];
-__scratch_x("UARTBit2") int32_t uart_bit_data2[UART_OVERSAMPLING_RATE * 2];
-UARTBit<int32_t, UART_OVERSAMPLING_RATE> bit(uart_bit_data, uart_bit_data2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
-
 // uart_tx implements the P1P2 transmitting part. The caller must avoid bus collisions on
-// the half duplex P1P2 bus. uart_tx has an internal 64 byte software fifo.
-__scratch_y("UART") UARTPio& uart_tx = UARTPio::getInstance();
+// the half duplex P1P2 bus. uart_tx queues up to UART_PIO_QUEUE_LEN packets.
+UARTPio& uart_tx = UARTPio::getInstance();
 
 // HostUART implement the logic to interface with the host
 // It generates and decodes the messages transceived on the host interfaces.
 // It updates the status bits on internal error.
-__scratch_y("host_uart") HostUART& hostUart = HostUART::getInstance();
+HostUART& hostUart = HostUART::getInstance();
 
 // LED drivers
 __scratch_y("pled") LEDdriver PowerLED = LEDdriver(21);
@@ -100,7 +78,13 @@ __scratch_y("rled") LEDdriver RxLED = LEDdriver(18);
 // system state.
 __scratch_y("ledmanager") LEDManager LedManager(RxLED, TxLED, PowerLED);
 
-__scratch_y("standalone") StandaloneController ctrl;
+// The queues and prepared answers of all slots don't fit into the 4 KB of
+// scratch Y next to the stack of core0
+StandaloneController ctrl;
+
+// collision compares the bits received while transmitting against the
+// transmitted packet and aborts the transmission on mismatch.
+__scratch_x("CollisionDetect") CollisionDetect collision;
 
 struct csv {
 	int16_t sample;
@@ -117,256 +101,663 @@ union CoreInterchangeData {
 		uint8_t LineBusy : 1;
 		uint8_t LineFree : 1;
 		uint8_t DADCError : 1;
+		// RxTiming[TimingIdx] holds the timing of the packet ended by LineFree
+		uint8_t TimingValid : 1;
+		uint8_t TimingIdx : 2;
+		// Transmission aborted. TxCollisionBit holds the position.
+		uint8_t TxCollision : 1;
+		// The stop bit of the last byte signaled by RxValid is invalid
+		uint8_t RxCorrection : 1;
+		// RxByteTime[RxByteIdx] holds the start of the byte in RxChar
+		uint8_t RxByteIdx : 2;
+		// The bus the event belongs to
+		uint8_t Bus : 1;
+		// The parity of RxChar is invalid. RxSuspect0 and RxSuspect1 are
+		// the bits with the lowest confidence.
+		uint8_t RxParity : 1;
+		uint8_t RxSuspect0 : 4;
+		uint8_t RxSuspect1 : 4;
 	};
 	uint32_t Raw;
 };
+static_assert(sizeof(CoreInterchangeData) == sizeof(uint32_t), "must fit into the SIO FIFO");
+
+// Start and end of a packet on the bus in microseconds since boot.
+struct FrameTiming {
+	uint32_t Start;
+	uint32_t End;
+};
 
 // Data exchange variables. Unidirectional only.
 volatile bool FifoErr;
+// Written by core1 before signaling LineFree. Core0 only reads the entry
+// passed in TimingIdx, thus up to 3 more packets might end before it's read.
+volatile FrameTiming RxTiming[RX_BUSES][4];
+// Start of every received byte in microseconds since boot. Written by core1
+// before signaling RxValid or RxError.
+volatile uint32_t RxByteTime[RX_BUSES][4];
+
+// The packet being transmitted. Written by core0 before setting Armed.
+struct TxEcho {
+	uint8_t Data[MAX_PACKET_SIZE];
+	uint8_t Length;
+	bool Armed;
+};
+volatile TxEcho TxEchoData;
+// Bit position of the last collision detected by core1
+volatile uint16_t TxCollisionBit;
+
+// Time of the first ADC sample in microseconds since boot.
+// Written by core1 before starting the ADC.
+volatile uint32_t SampleTimeBase;
+
+// SampleToUs converts the sample index into microseconds since boot
+static inline uint32_t SampleToUs(uint64_t sample) {
+	return SampleTimeBase + (uint32_t)(sample * 1000000 / (UART_BAUD_RATE * UART_OVERSAMPLING_RATE));
+}
+
+#ifdef RX_SPLIT_CORES
+// Output of the front end of every bus, decoded on core0
+SpscRing<RxSample, RX_SPLIT_RING_LEN> RxRing[RX_BUSES];
+#endif
+
+// Next free entry in RxTiming and RxByteTime of every bus. Only used by the
+// core running the back end of the receive pipeline.
+static uint8_t RxTimingIdx[RX_BUSES];
+static uint8_t RxByteIdx[RX_BUSES];
+
+// RxDecoded stores the result of the receive pipeline of bus in d
+static void RxDecoded(const uint8_t bus, const RxBus::Event& ev, CoreInterchangeData& d) {
+	switch (ev.Line) {
+	case EndOfFrame::EVENT_BUSY:
+		d.LineBusy = 1;
+		break;
+	case EndOfFrame::EVENT_FREE:
+		d.LineFree = 1;
+		if (ev.Frame) {
+			volatile FrameTiming& t = RxTiming[bus][RxTimingIdx[bus]];
+			t.Start = SampleToUs(ev.FrameStart);
+			t.End = SampleToUs(ev.FrameEnd);
+			__dmb();
+			d.TimingValid = 1;
+			d.TimingIdx = RxTimingIdx[bus];
+			RxTimingIdx[bus] = (RxTimingIdx[bus] + 1) & 3;
+		}
+		break;
+	case EndOfFrame::EVENT_NONE:
+		break;
+	}
+
+	if (!ev.Byte) {
+		if (ev.Correction)
+			d.RxCorrection = 1;
+		return;
+	}
+
+	RxByteTime[bus][RxByteIdx[bus]] = SampleToUs(ev.ByteStart);
+	__dmb();
+	d.RxByteIdx = RxByteIdx[bus];
+	RxByteIdx[bus] = (RxByteIdx[bus] + 1) & 3;
+	d.RxChar = ev.Data;
+	d.RxError = ev.Error;
+	d.RxValid = !ev.Error;
+	if (ev.ParityFailed) {
+		d.RxParity = 1;
+		d.RxSuspect0 = ev.Suspects[0];
+		d.RxSuspect1 = ev.Suspects[1];
+	}
+}
 
 static void core1_entry() {
-	uint8_t rx_data;
-	bool rx_error;
-	int32_t adc_data, fir_data, resamp_data, ac_data, hysteresis_data, bit_data;
-	int32_t LineIdleCounter;
-	bool LineIsBusy;
+	int32_t adc_data;
+	uint8_t bus;
+#ifdef RX_SPLIT_CORES
+	RxSample block[RX_BUSES][RX_SPLIT_BLOCK];
+	size_t BlockLen[RX_BUSES];
+#else
+	RxBus::Event ev;
+#endif
+	int32_t bit;
 
-	CoreInterchangeData Core1Data;
+	CoreInterchangeData Core1Data[RX_BUSES];
 
 	FifoErr = false;
-	LineIsBusy = true;
-	Core1Data.Raw = 0;
-	LineIdleCounter = 11 * UART_OVERSAMPLING_RATE;
+	for (size_t i = 0; i < RX_BUSES; i++) {
+		Core1Data[i].Raw = 0;
+#ifdef RX_SPLIT_CORES
+		BlockLen[i] = 0;
+#endif
+	}
 
 	dadc.SetGain((uint16_t)(ADC_EXTERNAL_GAIN * 0x100));
+	SampleTimeBase = time_us_32();
 	dadc.Start();
 	for (;;) {
-		if (Core1Data.Raw) {
+		for (size_t i = 0; i < RX_BUSES; i++) {
+			if (!Core1Data[i].Raw)
+				continue;
+			Core1Data[i].Bus = i;
 			if (!multicore_fifo_wready()) {
 				FifoErr = true;
 			} else {
-				multicore_fifo_push_timeout_us(Core1Data.Raw, 0);
+				multicore_fifo_push_timeout_us(Core1Data[i].Raw, 0);
 			}
-			Core1Data.Raw = 0;
+			Core1Data[i].Raw = 0;
 		}
-		if(!dadc.Update(&adc_data)) {
+		if(!dadc.Update(&adc_data, &bus)) {
 			__wfe();
 			continue;
 		}
+		CoreInterchangeData& d = Core1Data[bus];
 		if (dadc.Error ()) {
-			Core1Data.DADCError = true;
+			d.DADCError = true;
 			dadc.Reset();
 			continue;
 		}
-		if (!filter.Update(adc_data, &fir_data)) {
-			continue;
-		}
-		if (!resampler.Update(fir_data, &resamp_data)) {
+#ifdef RX_SPLIT_CORES
+		RxSample& sample = block[bus][BlockLen[bus]];
+		if (!rx[bus]->UpdateFront(adc_data, &sample)) {
 			continue;
 		}
-
-		if (!dcblock.Update(resamp_data, &ac_data)) {
-			continue;
+		bit = sample.Bit;
+		if (++BlockLen[bus] == RX_SPLIT_BLOCK) {
+			if (!RxRing[bus].Push(block[bus], RX_SPLIT_BLOCK))
+				FifoErr = true;
+			BlockLen[bus] = 0;
+			// Wake core0
+			__sev();
 		}
-		if (!level.Update(ac_data, &hysteresis_data)) {
+#else
+		if (!rx[bus]->Update(adc_data, &ev)) {
 			continue;
 		}
+		bit = ev.Bit;
+#endif
 
-		bit.Update(hysteresis_data, &bit_data);
-
-		// p1p2uart is busy as long as receiving a byte. It has an
-		// idle phase of UART_OVERSAMPLING_RATE/2 or less between two bytes.
-		// Thus the line is idle when p1p2uart haven't signaled busy for
-		// at least UART_OVERSAMPLING_RATE samples.
-		//
-		// The idle time between packets on the P1/P2 bus is unknown.
-		// Assume idle time of 1 byte == 9600Baud/11 bits == 1.15msec.
-
-		if (p1p2uart.Receiving()) {
-			if (!LineIsBusy) {
-				LineIsBusy = true;
-				LineIdleCounter = 11 * UART_OVERSAMPLING_RATE;
-				Core1Data.LineBusy = 1;
+		// Compare the echo of the packet being transmitted on bit level
+		if (bus == 0) {
+			if (TxEchoData.Armed) {
+				__dmb();
+				collision.Arm((const uint8_t *)TxEchoData.Data, TxEchoData.Length);
+				TxEchoData.Armed = false;
 			}
-		} else if (LineIsBusy) {
-			if (LineIdleCounter > 0) {
-				LineIdleCounter--;
-			} else {
-				LineIsBusy = false;
-				Core1Data.LineFree = 1;
+			if (collision.Armed() && collision.Update(bit)) {
+				uart_tx.Abort();
+				TxCollisionBit = collision.Bit();
+				d.TxCollision = 1;
 			}
 		}
 
-
-		rx_data = 0;
-		if (!p1p2uart.Update(bit_data, &rx_data, &rx_error)) {
-			continue;
-		}
-		Core1Data.RxChar = rx_data;
-		Core1Data.RxError = rx_error;
-		Core1Data.RxValid = !rx_error;
+#ifndef RX_SPLIT_CORES
+		RxDecoded(bus, ev, d);
+#endif
 	}
 }
 
-static void core0_entry() {
-	Message RxMsg;
+// Events handled by the core0 scheduler
+enum CORE0_EVENT {
+	// Core1 pushed data into the SIO FIFO
+	EVENT_CORE1 = 1 << 0,
+	// Data is waiting on a host interface
+	EVENT_HOST_RX = 1 << 1,
+};
+
+// Clock of the core0 scheduler
+struct Core0Clock {
+	static inline uint32_t Now(void) {
+		return time_us_32();
+	}
+
+	// Wakes up early on interrupts and on events sent by core1
+	static inline void Sleep(uint32_t deadline) {
+		int32_t us = deadline - time_us_32();
+		if (us > 0)
+			best_effort_wfe_or_timeout(make_timeout_time_us(us));
+	}
+};
+
+Scheduler<Core0Clock, 4> sched;
+
+// State shared by the core0 tasks
+struct Core0State {
+	// Packet being received on every bus
+	Message RxMsg[RX_BUSES];
+	// Repairs a single parity error of RxMsg
+	PacketRepair Repair[RX_BUSES];
 	bool LineIsBusy;
-	bool TxFailure;
 	uint32_t LineBusySinceMsec;
-	CoreInterchangeData Core1Data;
-	TxStateMachine SM(uart_tx);
+	// End of the last packet on every bus in microseconds since boot
+	uint32_t LastFrameEnd[RX_BUSES];
+	// Predicts the next packet of the main controller on bus 0
+	BusSchedule Schedule;
+	TxStateMachine *SM;
+	// The answer of ctrl is being transmitted
+	bool CtrlTxPending;
+	// Message from the host waiting for the message held for its queue
+	Message HostTxMsg;
+	bool HostTxHeld;
+	// Time from the start of a byte on the bus to queuing it for the host
+	// in streaming mode
+	uint32_t StreamBytes;
+	uint32_t StreamLatencySum;
+	uint32_t StreamLatencyMax;
+	int TaskCore1;
+	int TaskHost;
+	int TaskTimer;
+};
 
-	LineIsBusy = true;
-	LineBusySinceMsec = to_ms_since_boot(get_absolute_time());
+// Returns the earlier of both times
+static inline uint32_t Earlier(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) < 0 ? a : b;
+}
 
-	// discard old data
-	multicore_fifo_drain();
+// Sends a received packet to the host. In streaming mode the data has already
+// been sent byte by byte, only the end of frame marker is missing.
+static void Core0SendRx(Message& m) {
+	if (hostUart.Streaming()) {
+		// The bytes have been sent before the packet was repaired
+		if (m.Status == Message::STATUS_REPAIRED)
+			m.Status = Message::STATUS_ERR_PARITY;
+		hostUart.SendEndOfFrame(m);
+	} else
+		hostUart.UpdateAndSend(m);
+}
 
-	while(1) {
-		// USB CDC has no interrupts.
-		// Poll for changes...
-		hostUart.Check();
+// Core0Stream forwards a received byte to the host in streaming mode
+static void Core0Stream(Core0State& s, CoreInterchangeData Core1Data) {
+	const uint32_t t = RxByteTime[Core1Data.Bus][Core1Data.RxByteIdx];
+	const uint32_t latency = time_us_32() - t;
 
-		ctrl.Check();
+	hostUart.SendByte(Core1Data.RxChar, Core1Data.RxError, t, Core1Data.Bus);
 
-		TxFailure = SM.Error();
+	s.StreamBytes++;
+	s.StreamLatencySum += latency;
+	if (latency > s.StreamLatencyMax)
+		s.StreamLatencyMax = latency;
+}
 
-		// Update LEDs
-		if (SM.IsTransmitting())
-			LedManager.ActivityTx();
-		else if (FifoErr || uart_tx.Error())
-			LedManager.InternalError();
-		else if (TxFailure)
-			LedManager.TransmissionErrorTx();
-
-		// Check if line is busy for too long.
-		if (LineIsBusy) {
-			if (LineBusySinceMsec + LINE_BUSY_TIMEOUT_MS < to_ms_since_boot(get_absolute_time())) {
-				LedManager.InternalError();
-				LineBusySinceMsec = to_ms_since_boot(get_absolute_time());
-				RxMsg.Status = Message::STATUS_ERR_NO_FRAMING;
-				hostUart.UpdateAndSend(RxMsg);
-				RxMsg.Clear();
-			}
-		}
+// Core0Receive processes one event sent by core1. The controller and the
+// transmitter only use bus 0, the packets of the other bus are forwarded to
+// the host.
+static void Core0Receive(Core0State& s, CoreInterchangeData Core1Data) {
+	Message& RxMsg = s.RxMsg[Core1Data.Bus];
+	PacketRepair& Repair = s.Repair[Core1Data.Bus];
 
-		// FIFO errors should never happen
-		if (FifoErr) {
-			RxMsg.Status = Message::STATUS_ERR_OVERFLOW;
-			hostUart.UpdateAndSend(RxMsg);
-			RxMsg.Clear();
+	if (Core1Data.TxCollision) {
+		char line[48];
 
-			FifoErr = false;
-		}
+		s.SM->Collision();
+		snprintf(line, sizeof(line), "# collision at bit %u\r\n", TxCollisionBit);
+		hostUart.SendString(line);
+	}
 
-		// Failed to TX a packet. Notify HOST and CTRL.
-		if (TxFailure) {
-			if (SM.RxMsg.Status != Message::STATUS_ERR_PARITY) {
-				// STATUS_ERR_PARITY is already send by RX code
-				hostUart.UpdateAndSend(SM.RxMsg);
-				SM.RxMsg.Clear();
+	// Update RxMsg
+	if (Core1Data.RxCorrection) {
+		if (RxMsg.Status == 0)
+			// The last byte has already been appended
+			RxMsg.Status = Message::STATUS_ERR_PARITY;
+		Repair.Invalidate();
+	}
+	if (Core1Data.DADCError)
+		RxMsg.Status = Message::STATUS_ERR_OVERFLOW;
+	else if (Core1Data.RxError) {
+		RxMsg.Status = Message::STATUS_ERR_PARITY;
+		RxMsg.Append(Core1Data.RxChar);
+	} else if (Core1Data.RxValid)
+		RxMsg.Append(Core1Data.RxChar);
+	if (Core1Data.RxError || Core1Data.RxValid)
+		Repair.Byte(Core1Data.RxError, Core1Data.RxParity,
+			    Core1Data.RxSuspect0, Core1Data.RxSuspect1);
+
+	if ((Core1Data.RxValid || Core1Data.RxError) && hostUart.Streaming())
+		Core0Stream(s, Core1Data);
+
+	if (Core1Data.TimingValid) {
+		const volatile FrameTiming& t = RxTiming[Core1Data.Bus][Core1Data.TimingIdx];
+		uint32_t& LastFrameEnd = s.LastFrameEnd[Core1Data.Bus];
+
+		RxMsg.Timestamp = t.Start;
+		RxMsg.Duration = t.End - t.Start;
+		if (LastFrameEnd)
+			RxMsg.Gap = t.Start - LastFrameEnd;
+		LastFrameEnd = t.End;
+		if (Core1Data.Bus == 0)
+			s.SM->FrameEnd(time_us_32() - t.End);
+	}
+
+	// Packet end reached, transmit now...
+	if (Core1Data.LineFree) {
+		// Validate the CRC of every packet received without error
+		if (RxMsg.Status == Message::STATUS_OK && RxMsg.Length > 0 &&
+		    !DaikinCRC::Valid(RxMsg.Data, RxMsg.Length))
+			RxMsg.Status = Message::STATUS_ERR_CRC;
+		// Try to fix a single parity error by the CRC
+		Repair.Repair(&RxMsg);
+		if (RxMsg.Length > 0 || RxMsg.Status != 0) {
+			// Update the schedule and the external controller
+			if (Core1Data.Bus == 0) {
+				s.Schedule.Frame(RxMsg);
+				ctrl.Receive(&RxMsg);
 			}
-			if (ctrl.IsTxAnswer(&SM.TxMsg))
-				ctrl.BusCollision();
+
+			// Send to host
+			Core0SendRx(RxMsg);
+			RxMsg.Clear();
 		}
+	}
+	// Received more data than would fit into message...
+	if (RxMsg.Overflow()) {
+		RxMsg.Status = Message::STATUS_ERR_OVERFLOW;
+		Core0SendRx(RxMsg);
+		RxMsg.Clear();
+		Repair.Clear();
+	}
 
-		// Handle CORE0 events
-		if (multicore_fifo_rvalid()) {
-			Core1Data.Raw = multicore_fifo_pop_blocking();
-
-			// Update RxMsg
-			if (Core1Data.DADCError)
-				RxMsg.Status = Message::STATUS_ERR_OVERFLOW;
-			else if (Core1Data.RxError) {
-				RxMsg.Status = Message::STATUS_ERR_PARITY;
-				RxMsg.Append(Core1Data.RxChar);
-			} else if (Core1Data.RxValid)
-				RxMsg.Append(Core1Data.RxChar);
-
-			// Packet end reached, transmit now...
-			if (Core1Data.LineFree) {
-				if (RxMsg.Length > 0 || RxMsg.Status != 0) {
-					// Update external controller
-					ctrl.Receive(&RxMsg);
-
-					// Send to host
-					hostUart.UpdateAndSend(RxMsg);
-					RxMsg.Clear();
-				}
-			}
-			// Received more data than would fit into message...
-			if (RxMsg.Overflow()) {
-				RxMsg.Status = Message::STATUS_ERR_OVERFLOW;
-				hostUart.UpdateAndSend(RxMsg);
-				RxMsg.Clear();
-			}
+	// Update LEDs
+	if (Core1Data.RxError || Core1Data.RxCorrection) {
+		LedManager.TransmissionErrorRx();
+	} else if (Core1Data.RxValid) {
+		LedManager.ActivityRx();
+	}
+	if (Core1Data.DADCError) {
+		LedManager.InternalError();
+	}
 
-			// Update half duplex state machine
-			if (Core1Data.LineFree && LineIsBusy) {
-				LineIsBusy = false;
-			} else if (Core1Data.LineBusy && !LineIsBusy) {
-				LineIsBusy = true;
-				LineBusySinceMsec = to_ms_since_boot(get_absolute_time());
-			}
+	if (Core1Data.Bus != 0)
+		return;
 
-			// Update LEDs
-			if (Core1Data.RxError) {
-				LedManager.TransmissionErrorRx();
-			} else if (Core1Data.RxValid) {
-				LedManager.ActivityRx();
-			}
-			if (Core1Data.DADCError) {
-				LedManager.InternalError();
-			}
+	// Update half duplex state machine
+	if (Core1Data.LineFree && s.LineIsBusy) {
+		s.LineIsBusy = false;
+	} else if (Core1Data.LineBusy && !s.LineIsBusy) {
+		s.LineIsBusy = true;
+		s.LineBusySinceMsec = to_ms_since_boot(get_absolute_time());
+	}
 
-		} else if (LineIsBusy) {
-			// Break every msec to check LineBusySinceMsec counter and statemachine
-			best_effort_wfe_or_timeout(make_timeout_time_ms(1));
-		} else if (!ctrl.HasTxData() && !hostUart.HasDataExtController() && !hostUart.HasDataGeneric() && SM.IsIdle()) {
-			// Nothing to TX and statemachine is idle
-			// Need to break every few msec to poll the USB CDC
-			best_effort_wfe_or_timeout(make_timeout_time_ms(1));
-			continue;
+	// Update half duplex statemachine
+	s.SM->Update(s.LineIsBusy, Core1Data.RxError || Core1Data.RxCorrection,
+		     Core1Data.RxValid, Core1Data.RxChar);
+}
+
+// Core0SendTxResult tells the host the outcome of the host messages sent
+// with an answer of ctrl
+static void Core0SendTxResult(const bool ok, const uint8_t type,
+			      const StandaloneController::TxResult& r) {
+	if (!r.Writes || r.Retry)
+		return;
+	hostUart.SendTxResult(ok, type, r.Writes, r.Attempts);
+}
+
+// Core0Process runs after every task. Reports errors, starts
+// transmissions and arms the timer task.
+static void Core0Process(Core0State& s) {
+	TxStateMachine& SM = *s.SM;
+	bool TxFailure = SM.Error();
+
+	// Update LEDs
+	if (SM.IsTransmitting())
+		LedManager.ActivityTx();
+	else if (FifoErr || uart_tx.Error())
+		LedManager.InternalError();
+	else if (TxFailure)
+		LedManager.TransmissionErrorTx();
+
+	// Check if line is busy for too long.
+	if (s.LineIsBusy) {
+		if (s.LineBusySinceMsec + LINE_BUSY_TIMEOUT_MS < to_ms_since_boot(get_absolute_time())) {
+			LedManager.InternalError();
+			s.LineBusySinceMsec = to_ms_since_boot(get_absolute_time());
+			s.RxMsg[0].Status = Message::STATUS_ERR_NO_FRAMING;
+			hostUart.UpdateAndSend(s.RxMsg[0]);
+			s.RxMsg[0].Clear();
+			s.Repair[0].Clear();
 		}
+	}
+
+	// FIFO errors should never happen
+	if (FifoErr) {
+		s.RxMsg[0].Status = Message::STATUS_ERR_OVERFLOW;
+		hostUart.UpdateAndSend(s.RxMsg[0]);
+		s.RxMsg[0].Clear();
+		s.Repair[0].Clear();
 
-		// Update half duplex statemachine
-		SM.Update(LineIsBusy, Core1Data.RxError, Core1Data.RxValid, Core1Data.RxChar);
+		FifoErr = false;
+	}
 
-		Message TxMsg;
-		// Relay messages for standalone controller
-		// It will be transmitted when requested by the control unit
-		if (hostUart.HasDataExtController()) {
-			TxMsg = hostUart.PopExtController();
-			ctrl.CacheTxMessage(TxMsg);
+	// Failed to TX a packet. Notify HOST and CTRL.
+	if (TxFailure) {
+		StandaloneController::TxResult r = {0, 0, false};
+
+		// The packets of the host stay queued and are sent again after
+		// a random backoff
+		if (s.CtrlTxPending) {
+			s.CtrlTxPending = false;
+			ctrl.AddEntropy(time_us_32());
+			r = ctrl.TxDone(false);
 		}
-		// Let standalone controller also handle non standalone packets!
-		// It will send those packets instead of the "correct" answer packet
-		// to avoid bus collissions.
-		if (hostUart.HasDataGeneric() && !ctrl.Non3xhPacketWaitForTransmission()) {
-			TxMsg = hostUart.PopGeneric();
-			ctrl.CacheTxMessage(TxMsg);
+		// Only the final outcome of a host packet is reported, by a
+		// single drop result with the attempts
+		if (!r.Retry && !r.Writes && SM.RxMsg.Status != Message::STATUS_ERR_PARITY) {
+			// STATUS_ERR_PARITY is already send by RX code
+			hostUart.UpdateAndSend(SM.RxMsg);
 		}
-		// Transmit packet if any. Start transmission in the moment the lines becomes idle.
-		if (SM.IsIdle() && ctrl.HasTxData()) {
-			ctrl.TxAnswer(&TxMsg);
+		SM.RxMsg.Clear();
+		if (ctrl.IsTxAnswer(&SM.TxMsg))
+			ctrl.BusCollision();
+		Core0SendTxResult(false, SM.TxMsg.Data[2], r);
+	}
+
+	// The answer of ctrl is on the bus. Acknowledge the host messages sent
+	// with it.
+	if (s.CtrlTxPending && SM.IsIdle()) {
+		s.CtrlTxPending = false;
+		Core0SendTxResult(true, SM.TxMsg.Data[2], ctrl.TxDone(true));
+	}
+
+	Message TxMsg;
+	// Relay messages for standalone controller
+	// It will be transmitted when requested by the control unit.
+	// Let standalone controller also handle non standalone packets!
+	// It will send those packets instead of the "correct" answer packet
+	// to avoid bus collissions.
+	// A message for a full queue is held by ctrl until the queue has room,
+	// the messages for the other queues are cached in the meantime. Only a
+	// second message for the same queue waits in HostTxMsg.
+	for (;;) {
+		if (!s.HostTxHeld) {
+			if (hostUart.HasDataExtController())
+				s.HostTxMsg = hostUart.PopExtController();
+			else if (hostUart.HasDataGeneric())
+				s.HostTxMsg = hostUart.PopGeneric();
+			else
+				break;
+			s.HostTxHeld = true;
+		}
+		if (!ctrl.TxQueueFull(s.HostTxMsg))
+			ctrl.CacheTxMessage(s.HostTxMsg);
+		else if (!ctrl.HoldTxMessage(s.HostTxMsg))
+			break;
+		s.HostTxHeld = false;
+	}
+	// Keep the line driver powered while the 3xh packets are exchanged
+	SM.KeepWarm(ctrl.ExtCtrlPhase());
+
+	// Transmit packet if any. Start transmission in the moment the lines becomes idle.
+	// Skip the answer if the main controller is expected to start its next
+	// packet before it ends.
+	if (SM.IsIdle() && ctrl.HasTxData()) {
+		ctrl.TxAnswer(&TxMsg);
+		// A warm start waits for the turnaround time at most
+		const uint32_t start = time_us_32() + (SM.IsWarm() ? TX_TURNAROUND_US : TX_POWERON_TIMEOUT_US);
+		if (s.Schedule.Fits(start, TxMsg.Length)) {
 			SM.WakeAndTransmit(TxMsg);
+			s.CtrlTxPending = true;
+			SM.Update(s.LineIsBusy, false, false, 0);
+		} else {
+			ctrl.TxCancel();
 		}
+	}
 
-		Core1Data.Raw = 0;
-	};
+	// Wake the timer task on the next timeout
+	uint32_t next = (uint32_t)to_us_since_boot(ctrl.Deadline());
+	if (SM.HasDeadline())
+		next = Earlier(next, (uint32_t)to_us_since_boot(SM.Deadline()));
+	if (SM.GetState() == TxState::IDLE_WAIT_LINEFREE && !s.LineIsBusy)
+		// Wait for the PIO to finish the previous packet
+		next = Earlier(next, time_us_32() + TX_IDLE_POLL_US);
+	if (s.LineIsBusy)
+		next = Earlier(next, (s.LineBusySinceMsec + LINE_BUSY_TIMEOUT_MS + 1) * 1000);
+	sched.SetDeadline(s.TaskTimer, next);
+}
+
+#ifdef RX_SPLIT_CORES
+// Core0Decode runs the back end of the receive pipeline on the samples
+// handed over by core1
+static void Core0Decode(Core0State& s, const uint8_t bus) {
+	RxSample block[RX_SPLIT_BLOCK];
+	size_t len;
+
+	while ((len = RxRing[bus].Pop(block, RX_SPLIT_BLOCK)) > 0) {
+		for (size_t i = 0; i < len; i++) {
+			CoreInterchangeData d;
+			RxBus::Event ev;
+
+			rx[bus]->UpdateBack(block[i], &ev);
+			d.Raw = 0;
+			RxDecoded(bus, ev, d);
+			if (!d.Raw)
+				continue;
+			d.Bus = bus;
+			Core0Receive(s, d);
+		}
+	}
+}
+#endif
+
+// Handles data sent by core1
+static void TaskCore1(void *ctx) {
+	Core0State& s = *(Core0State *)ctx;
+	CoreInterchangeData Core1Data;
+
+	while (multicore_fifo_rvalid()) {
+		Core1Data.Raw = multicore_fifo_pop_blocking();
+		Core0Receive(s, Core1Data);
+	}
+#ifdef RX_SPLIT_CORES
+	for (size_t i = 0; i < RX_BUSES; i++)
+		Core0Decode(s, i);
+#endif
+	Core0Process(s);
+}
+
+// Handles host commands and output
+static void TaskHost(void *ctx) {
+	Core0State& s = *(Core0State *)ctx;
+
+	hostUart.Check();
+	if (hostUart.StatsRequested()) {
+		char line[80];
+		snprintf(line, sizeof(line), "# sched: runs=%u latency avg=%uus max=%uus\r\n",
+			sched.Runs(), sched.LatencyAvg(), sched.LatencyMax());
+		hostUart.SendString(line);
+		sched.ResetStats();
+		if (s.StreamBytes) {
+			snprintf(line, sizeof(line), "# stream: bytes=%u latency avg=%uus max=%uus\r\n",
+				s.StreamBytes, s.StreamLatencySum / s.StreamBytes, s.StreamLatencyMax);
+			hostUart.SendString(line);
+			s.StreamBytes = 0;
+			s.StreamLatencySum = 0;
+			s.StreamLatencyMax = 0;
+		}
+	}
+	// USB CDC has no TX interrupt. Retry when the host was too slow.
+	if (hostUart.TxPending())
+		sched.SetDeadline(s.TaskHost, time_us_32() + HOST_TX_RETRY_US);
+	Core0Process(s);
+}
+
+// Handles timeouts of the state machines
+static void TaskTimer(void *ctx) {
+	Core0State& s = *(Core0State *)ctx;
+
+	ctrl.Check();
+	s.SM->Update(s.LineIsBusy, false, false, 0);
+	Core0Process(s);
+}
+
+// Called by the UART when a packet is about to be transmitted
+static void OnTxEvent(const Message& m, const enum UARTPio::Queue::EVENT ev, void *ctx) {
+	if (ev != UARTPio::Queue::EVENT_STARTED)
+		return;
+	for (size_t i = 0; i < m.Length; i++)
+		TxEchoData.Data[i] = m.Data[i];
+	TxEchoData.Length = m.Length;
+	__dmb();
+	TxEchoData.Armed = true;
+}
+
+static bool Core1Ready(void *ctx) {
+#ifdef RX_SPLIT_CORES
+	for (size_t i = 0; i < RX_BUSES; i++) {
+		if (RxRing[i].Length())
+			return true;
+	}
+#endif
+	return multicore_fifo_rvalid();
+}
+
+static bool HostRxReady(void *ctx) {
+	return hostUart.RxPending();
+}
+
+static void core0_entry() {
+	static Core0State s;
+
+	s.SM = &TxStateMachine::getInstance(uart_tx);
+	s.SM->SetTxCallback(OnTxEvent, nullptr);
+	s.LineIsBusy = true;
+	s.LineBusySinceMsec = to_ms_since_boot(get_absolute_time());
+	for (size_t i = 0; i < RX_BUSES; i++) {
+		s.RxMsg[i].Bus = i;
+		s.LastFrameEnd[i] = 0;
+	}
+	s.CtrlTxPending = false;
+	s.HostTxHeld = false;
+	s.StreamBytes = 0;
+	s.StreamLatencySum = 0;
+	s.StreamLatencyMax = 0;
+
+	// discard old data
+	multicore_fifo_drain();
+
+	// The SIO FIFO, the RxRing and the host interfaces are checked every
+	// time the core wakes up. Core1 sends an event when pushing into the
+	// FIFO or the RxRing, the host interfaces wake the core by interrupt.
+	s.TaskCore1 = sched.Add(TaskCore1, &s, EVENT_CORE1);
+	s.TaskHost = sched.Add(TaskHost, &s, EVENT_HOST_RX);
+	s.TaskTimer = sched.Add(TaskTimer, &s, 0);
+	sched.AddSource(Core1Ready, nullptr, EVENT_CORE1);
+	sched.AddSource(HostRxReady, nullptr, EVENT_HOST_RX);
+
+	sched.SetDeadline(s.TaskTimer, time_us_32());
+
+	sched.Run();
 }
 
 int main(void) {
 	stdio_init_all();	// Must be called on core0!
+	hostUart.Init();
 	sleep_ms(3000);
 
-	printf("\n#==================\n");
-	printf("#RP2040 P1/P2 modem\n");
-	printf("#==================\n");
-	printf("# Send ;!BLD!; to enter USB bootloader\n");
-
-	uart_default_tx_wait_blocking();
+	hostUart.SendString("\r\n#==================\r\n");
+	hostUart.SendString("#RP2040 P1/P2 modem\r\n");
+	hostUart.SendString("#==================\r\n");
+	hostUart.SendString("# Send ;!BLD!; to enter USB bootloader\r\n");
 
+	// Deliver bytes right after the parity bit. Shortens the TX echo check
+	// and the reply path by a bit time per byte.
+	for (size_t i = 0; i < RX_BUSES; i++)
+		rx[i]->SetEarly(true);
 	multicore_launch_core1(core1_entry);
 
 	core0_entry();
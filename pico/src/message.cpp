@@ -6,24 +6,27 @@
 #include <iostream>
 
 Message::Message() :
-	Status(0), Length(0)
+	Status(0), Timestamp(0), Duration(0), Gap(0), Bus(0), Length(0)
 {
 }
 
 Message::Message(uint32_t status, uint8_t *data, uint8_t length) :
-	Status(status), Length(length < sizeof(this->Data) ? length : sizeof(this->Data))
+	Status(status), Timestamp(0), Duration(0), Gap(0), Bus(0), Length(length < sizeof(this->Data) ? length : sizeof(this->Data))
 {
 	memcpy(this->Data, data, this->Length);
 }
 
 // c_str returns the Message as c string representation
+// When timestamp is set the packet timing is appended as comment.
+// When bus is set the bus number is appended as comment.
 // The returned data is valid until c_str is called again.
-const char *Message::c_str(void)
+const char *Message::c_str(bool timestamp, bool bus)
 {
 	static char line[128];
 	char c;
 	size_t off;
 
+	line[0] = 0;
 	for (size_t i = 0; i < this->Length; i++)
 		snprintf(&line[i*2], sizeof(line) - (i*2), "%02x", this->Data[i]);
 
@@ -38,12 +41,30 @@ const char *Message::c_str(void)
 			c = 'P';
 		else if (this->Status == STATUS_ERR_NO_FRAMING)
 			c = 'F';
+		else if (this->Status == STATUS_ERR_CRC)
+			c = 'K';
+		else if (this->Status == STATUS_REPAIRED)
+			c = 'R';
 		else
 			c = ' ';
 
 		snprintf(&line[off], sizeof(line) - off, " # %02x %c", this->Status, c);
 	}
 
+	if (timestamp || bus) {
+		off = strlen(line);
+		snprintf(&line[off], sizeof(line) - off, " ;");
+	}
+	if (timestamp) {
+		off = strlen(line);
+		snprintf(&line[off], sizeof(line) - off, " t=%u d=%u g=%u",
+			 this->Timestamp, this->Duration, this->Gap);
+	}
+	if (bus) {
+		off = strlen(line);
+		snprintf(&line[off], sizeof(line) - off, " b=%u", this->Bus);
+	}
+
 	return line;
 }
 
@@ -57,6 +78,10 @@ Message::Message(char *line)
 	char decoded;
 
 	this->Status = 0;
+	this->Timestamp = 0;
+	this->Duration = 0;
+	this->Gap = 0;
+	this->Bus = 0;
 	this->Length = 0;
 
 	data_ptr = line;
@@ -104,6 +129,9 @@ void Message::Clear(void)
 {
 	this->Length = 0;
 	this->Status = 0;
+	this->Timestamp = 0;
+	this->Duration = 0;
+	this->Gap = 0;
 }
 
 bool Message::Overflow(void)
@@ -19,6 +19,12 @@ class Message
 			STATUS_ERR_NO_FRAMING = 4,
 			// Internal error
 			STATUS_INTERNAL_ERROR = 5,
+			// Received a packet without parity or framing error, but the
+			// last byte isn't the Daikin CRC of the bytes before.
+			STATUS_ERR_CRC = 6,
+			// Received a packet with a parity error in one byte. A single
+			// bit of the byte has been corrected, the CRC is valid.
+			STATUS_REPAIRED = 7,
 		};
 	
 		Message();
@@ -29,9 +35,17 @@ class Message
 		void Clear(void);
 		bool Overflow(void);
 
-		const char* c_str();
+		const char* c_str(bool timestamp = false, bool bus = false);
 
 		uint32_t Status;
+		// Start of the packet on the bus in microseconds since boot
+		uint32_t Timestamp;
+		// Length of the packet on the bus in microseconds
+		uint32_t Duration;
+		// Idle time since the end of the previous packet in microseconds
+		uint32_t Gap;
+		// Bus the packet was received on. Not changed by Clear().
+		uint8_t Bus;
 
 		uint8_t Data[MAX_PACKET_SIZE];
 		uint8_t Length;
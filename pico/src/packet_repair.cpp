@@ -0,0 +1,81 @@
+#include "daikin_crc.hpp"
+#include "packet_repair.hpp"
+
+PacketRepair::PacketRepair(void) :
+	length(0), pos(0), suspects{}, found(false), invalid(false),
+	repaired(0), failed(0)
+{
+}
+
+// Byte is called for every byte appended to the packet. parity is
+// true if the parity of the byte is invalid, first and second are
+// the bits with the lowest confidence as returned by UART::Suspects.
+void PacketRepair::Byte(const bool err, const bool parity, const uint8_t first, const uint8_t second) {
+	if (err) {
+		// Only a single byte with a parity error can be repaired
+		if (!parity || this->found)
+			this->invalid = true;
+		this->found = true;
+		this->pos = this->length;
+		this->suspects[0] = first;
+		this->suspects[1] = second;
+	}
+	if (this->length < MAX_PACKET_SIZE)
+		this->length++;
+}
+
+void PacketRepair::Invalidate(void) {
+	this->invalid = true;
+}
+
+// Repair tries to fix the packet m. Returns true if m has been
+// repaired, its status is then STATUS_REPAIRED.
+// Clears the state for the next packet.
+bool PacketRepair::Repair(Message *m) {
+	bool ok = false;
+
+	if (m->Status != Message::STATUS_ERR_PARITY || !this->found || this->invalid ||
+	    this->length != m->Length || m->Length < 2) {
+		this->Clear();
+		return false;
+	}
+
+	// The CRC of the bytes before the broken one doesn't change
+	const uint8_t pos = this->pos;
+	const uint8_t crc = DaikinCRC::Calc(m->Data, pos);
+
+	for (size_t i = 0; i < REPAIR_CANDIDATES && !ok; i++) {
+		// Bit 8 is the parity bit, the data is valid then
+		const uint8_t flip = this->suspects[i] < 8 ? 1 << this->suspects[i] : 0;
+
+		m->Data[pos] ^= flip;
+		if (pos == m->Length - 1)
+			ok = crc == m->Data[pos];
+		else
+			ok = DaikinCRC::Calc(&m->Data[pos], m->Length - 1 - pos, crc) == m->Data[m->Length - 1];
+		if (!ok)
+			m->Data[pos] ^= flip;
+	}
+	if (ok) {
+		m->Status = Message::STATUS_REPAIRED;
+		this->repaired++;
+	} else {
+		this->failed++;
+	}
+	this->Clear();
+	return ok;
+}
+
+void PacketRepair::Clear(void) {
+	this->length = 0;
+	this->found = false;
+	this->invalid = false;
+}
+
+uint32_t PacketRepair::Repaired(void) {
+	return this->repaired;
+}
+
+uint32_t PacketRepair::Failed(void) {
+	return this->failed;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "message.hpp"
+
+// Number of suspect bits tried per packet. Every candidate has a chance of
+// 1/256 to match the CRC by accident.
+#define REPAIR_CANDIDATES 2
+
+// Repairs packets with a single parity error by the Daikin CRC.
+// A parity error means an odd number of bit errors in the byte, most likely
+// one. The bits of the byte with the lowest confidence are flipped one after
+// another and the first candidate with a valid CRC is accepted.
+class PacketRepair
+{
+	public:
+		PacketRepair(void);
+
+		// Byte is called for every byte appended to the packet. parity is
+		// true if the parity of the byte is invalid, first and second are
+		// the bits with the lowest confidence as returned by UART::Suspects.
+		void Byte(const bool err, const bool parity, const uint8_t first, const uint8_t second);
+
+		// Invalidate marks the packet as not repairable, i.e. on a stop
+		// bit error or an overflow.
+		void Invalidate(void);
+
+		// Repair tries to fix the packet m. Returns true if m has been
+		// repaired, its status is then STATUS_REPAIRED.
+		// Clears the state for the next packet.
+		bool Repair(Message *m);
+
+		// Clear starts a new packet
+		void Clear(void);
+
+		// Returns the number of repaired packets
+		uint32_t Repaired(void);
+
+		// Returns the number of packets that couldn't be repaired
+		uint32_t Failed(void);
+
+	private:
+		// Number of bytes seen in the packet
+		uint8_t length;
+		// Position of the byte with the parity error
+		uint8_t pos;
+		uint8_t suspects[REPAIR_CANDIDATES];
+		bool found;
+		bool invalid;
+		uint32_t repaired;
+		uint32_t failed;
+};
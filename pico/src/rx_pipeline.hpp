@@ -0,0 +1,194 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "defines.hpp"
+#include "bandpass.hpp"
+#include "end_of_frame.hpp"
+#include "level_detect.hpp"
+#include "line_busy.hpp"
+#include "uart.hpp"
+#include "uart_bit_detect_fast.hpp"
+
+// Output of the front end of the receive pipeline for one sample at
+// UART_OVERSAMPLING_RATE
+struct RxSample {
+	// Output of the bit detector
+	int32_t Bit;
+	// The carrier sense found a pulse
+	bool Busy;
+};
+
+// Receive pipeline of one P1P2 bus. Decodes the ADC samples to bytes and
+// detects the start and the end of packets.
+// M is the decimation of the band pass filter. The ADC samples arrive at
+// M * UART_OVERSAMPLING_RATE.
+//
+// The pipeline consists of two halves which can run on different cores:
+// - UpdateFront: band pass filter, carrier sense, level and bit detector
+// - UpdateBack: UART and end of frame detection
+// Update runs both.
+template <size_t M>
+class RxPipeline
+{
+	public:
+		typedef BandPassDecimator<RX_FILTER_TAPS, M, RX_FILTER_LOW_HZ, RX_FILTER_HIGH_HZ,
+			M * UART_OVERSAMPLING_RATE * UART_BAUD_RATE, RX_FILTER_WINDOW> Filter;
+
+		// Group delay of the pipeline in samples at UART_OVERSAMPLING_RATE.
+		// Used to correct the packet timestamps.
+		// The ADC phase compensation (1 sample) and the band pass filter run
+		// at the ADC sample rate. The bit detector finds a pulse
+		// UART_OVERSAMPLING_RATE - 2 samples after its start.
+		static constexpr uint32_t GROUP_DELAY = (1 + Filter::DELAY) / M + UART_OVERSAMPLING_RATE - 2;
+
+		// Result of one sample at UART_OVERSAMPLING_RATE
+		struct Event {
+			// Output of the bit detector
+			int32_t Bit;
+			// Change of the line state
+			enum EndOfFrame::EVENT Line;
+			// A packet ended, FrameStart and FrameEnd are valid
+			bool Frame;
+			// Start of the first byte and end of the last byte in samples
+			uint64_t FrameStart;
+			uint64_t FrameEnd;
+			// A byte has been received
+			bool Byte;
+			uint8_t Data;
+			bool Error;
+			// Start of the byte in samples
+			uint64_t ByteStart;
+			// The stop bit of the last byte is invalid
+			bool Correction;
+			// The parity of the byte is invalid. Suspects holds the bits
+			// with the lowest confidence, see UART::Suspects.
+			bool ParityFailed;
+			uint8_t Suspects[2];
+		};
+
+		RxPipeline(void) :
+		fir_data{},
+		bit_data{},
+		bit_data_abs{},
+		uart_data{},
+		filter(fir_data),
+		carrier(BUS_HIGH_MV),
+		bit(bit_data, bit_data_abs, BUS_HIGH_MV, BUS_LOW_MV, 0xE0),
+		uart(uart_data, UART::PARITY_EVEN),
+		samples(0),
+		frame_start(0),
+		frame_end(0),
+		frame_started(false)
+		{
+		}
+
+		// Deliver bytes right after the parity bit
+		void SetEarly(const bool early) {
+			this->uart.SetEarly(early);
+		}
+
+		// Returns the number of samples at UART_OVERSAMPLING_RATE since start
+		uint64_t Samples(void) {
+			return this->samples;
+		}
+
+		// Update processes one ADC sample. Returns false if the filter dropped
+		// the sample, otherwise the result has been placed in ev.
+		bool Update(const int32_t in, struct Event *ev) {
+			struct RxSample s;
+
+			if (!this->UpdateFront(in, &s))
+				return false;
+			this->UpdateBack(s, ev);
+			return true;
+		}
+
+		// UpdateFront runs the signal processing on one ADC sample. Returns
+		// false if the filter dropped the sample, otherwise the input of
+		// UpdateBack has been placed in out.
+		bool UpdateFront(const int32_t in, struct RxSample *out) {
+			int32_t ac, hysteresis;
+
+			if (!this->filter.Update(in, &ac))
+				return false;
+			this->carrier.Update(ac);
+			this->level.Update(ac, &hysteresis);
+			this->bit.Update(hysteresis, &out->Bit);
+			out->Busy = this->carrier.Busy();
+			return true;
+		}
+
+		// UpdateBack decodes the bytes and the packets of one sample
+		// returned by UpdateFront.
+		void UpdateBack(const struct RxSample& in, struct Event *ev) {
+			this->samples++;
+			ev->Bit = in.Bit;
+
+			// uart is busy as long as receiving a byte. It has an idle
+			// phase of UART_OVERSAMPLING_RATE/2 or less between two bytes.
+			// carrier detects the start bit before uart does.
+			// eof closes the packet right after the stop bit of its last
+			// byte if the length is known and the CRC is valid, otherwise
+			// after a learned idle time.
+			ev->Line = this->eof.Update(this->uart.Receiving() || in.Busy,
+						    this->uart.StopPending());
+			ev->Frame = false;
+			if (ev->Line == EndOfFrame::EVENT_FREE && this->frame_started) {
+				ev->Frame = true;
+				ev->FrameStart = this->frame_start;
+				ev->FrameEnd = this->frame_end;
+				this->frame_started = false;
+			}
+
+			ev->Data = 0;
+			ev->Byte = this->uart.Update(ev->Bit, &ev->Data, &ev->Error);
+			if (!ev->Byte) {
+				ev->Correction = this->uart.Correction();
+				if (ev->Correction)
+					this->eof.Correction();
+				return;
+			}
+			ev->Correction = false;
+			ev->ParityFailed = this->uart.Suspects(&ev->Suspects[0], &ev->Suspects[1]);
+
+			// The start bit was detected uart.Delay() samples ago.
+			// Correct by the phase of the start bit and the pipeline delay.
+			ev->ByteStart = this->samples - this->uart.Delay() + this->uart.Phase() - GROUP_DELAY;
+			if (!this->frame_started) {
+				this->frame_start = ev->ByteStart;
+				this->frame_started = true;
+			}
+			this->frame_end = ev->ByteStart + UART_BITS_PARITY * UART_OVERSAMPLING_RATE;
+			this->eof.Byte(ev->Data, ev->Error);
+		}
+
+	private:
+		int32_t fir_data[RX_FILTER_TAPS * 2];
+		int32_t bit_data[UART_OVERSAMPLING_RATE * 2];
+		int32_t bit_data_abs[UART_OVERSAMPLING_RATE * 2];
+		int16_t uart_data[UART_BUFFER_LEN * 2];
+
+		// Front end
+
+		// Removes the high frequency noise and the DC offset
+		Filter filter;
+		// Senses pulses on the bus before the bit detector
+		LineBusy<UART_OVERSAMPLING_RATE> carrier;
+		// Applies the P1P2 bus hysteresis
+		Level<int32_t> level;
+		// Returns the probabilty for a high or low pulse found in the signal.
+		// Allow 0xE0/0x100 bit errors = 12,5%
+		UARTBit<int32_t, UART_OVERSAMPLING_RATE> bit;
+
+		// Back end
+
+		UART uart;
+		// Detects the end of a packet by its length and CRC
+		EndOfFrame eof;
+
+		uint64_t samples;
+		uint64_t frame_start;
+		uint64_t frame_end;
+		bool frame_started;
+};
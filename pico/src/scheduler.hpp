@@ -0,0 +1,202 @@
+#pragma once
+#include "hardware/sync.h"
+#include "inttypes.h"
+#include <stddef.h>
+
+// Upper limit for sleeping when no task has a deadline
+#define SCHEDULER_MAX_SLEEP_US 100000
+
+// Run-to-completion event scheduler.
+// A task runs when one of its events has been signaled, one of its polled
+// sources is ready or its deadline has been reached. When no task is ready
+// the core sleeps until the next deadline or an interrupt wakes it.
+//
+// Clock must provide:
+//   static uint32_t Now(void)             - Current time in microseconds
+//   static void Sleep(uint32_t deadline)  - Sleep until deadline or any event
+//
+// The time is allowed to wrap around.
+// Signal() is IRQ safe, all other methods must be called from the thread
+// running the scheduler.
+template <class Clock, size_t N>
+class Scheduler
+{
+  public:
+    typedef void (*TaskFn)(void *ctx);
+    typedef bool (*SourceFn)(void *ctx);
+
+    Scheduler() : tasks{}, sources{}, num_tasks(0), num_sources(0),
+        runs(0), latency_max(0), latency_sum(0) {
+    }
+
+    // Add registers a task woken by the events in the events mask.
+    // Returns the task id or -1 if there's no space left.
+    int Add(TaskFn fn, void *ctx, const uint32_t events) {
+        if (this->num_tasks == N)
+            return -1;
+        Task& t = this->tasks[this->num_tasks];
+        t.fn = fn;
+        t.ctx = ctx;
+        t.events = events;
+        t.pending = false;
+        t.has_deadline = false;
+        return this->num_tasks++;
+    }
+
+    // AddSource registers a function that is polled every time the core
+    // wakes up. Signals the events when it returns true.
+    // Must be cheap, i.e. reading a status register.
+    bool AddSource(SourceFn fn, void *ctx, const uint32_t events) {
+        if (this->num_sources == N)
+            return false;
+        Source& s = this->sources[this->num_sources++];
+        s.fn = fn;
+        s.ctx = ctx;
+        s.events = events;
+        return true;
+    }
+
+    // Signal wakes all tasks waiting for one of the events.
+    void Signal(const uint32_t events) {
+        const uint32_t now = Clock::Now();
+        uint32_t save = save_and_disable_interrupts();
+
+        for (size_t i = 0; i < this->num_tasks; i++) {
+            Task& t = this->tasks[i];
+            if (!(t.events & events) || t.pending)
+                continue;
+            t.wake = now;
+            t.pending = true;
+        }
+        restore_interrupts(save);
+    }
+
+    // SetDeadline runs the task at time us. Replaces the previous deadline.
+    void SetDeadline(const int id, const uint32_t us) {
+        this->tasks[id].deadline = us;
+        this->tasks[id].has_deadline = true;
+    }
+
+    void ClearDeadline(const int id) {
+        this->tasks[id].has_deadline = false;
+    }
+
+    // RunOnce runs every task that is ready. Sleeps until the next
+    // deadline if no task was ready.
+    // Returns the number of tasks run.
+    size_t RunOnce(void) {
+        size_t ran = 0;
+
+        for (size_t i = 0; i < this->num_sources; i++) {
+            if (this->sources[i].fn(this->sources[i].ctx))
+                this->Signal(this->sources[i].events);
+        }
+
+        for (size_t i = 0; i < this->num_tasks; i++) {
+            Task& t = this->tasks[i];
+            uint32_t wake;
+
+            if (!this->Ready(t, &wake))
+                continue;
+
+            const uint32_t latency = Clock::Now() - wake;
+            if (latency > this->latency_max)
+                this->latency_max = latency;
+            this->latency_sum += latency;
+            this->runs++;
+
+            t.fn(t.ctx);
+            ran++;
+        }
+
+        if (ran == 0)
+            Clock::Sleep(this->NextDeadline());
+
+        return ran;
+    }
+
+    // Run never returns
+    void Run(void) {
+        for (;;)
+            this->RunOnce();
+    }
+
+    // Runs returns the number of times a task has been run
+    uint32_t Runs(void) {
+        return this->runs;
+    }
+
+    // LatencyMax returns the maximum time in microseconds between a task
+    // becoming ready and the task being run
+    uint32_t LatencyMax(void) {
+        return this->latency_max;
+    }
+
+    // LatencyAvg returns the average time in microseconds between a task
+    // becoming ready and the task being run
+    uint32_t LatencyAvg(void) {
+        return this->runs ? this->latency_sum / this->runs : 0;
+    }
+
+    void ResetStats(void) {
+        this->runs = 0;
+        this->latency_max = 0;
+        this->latency_sum = 0;
+    }
+
+  private:
+    struct Task {
+        TaskFn fn;
+        void *ctx;
+        uint32_t events;
+        // Time when the task became ready
+        uint32_t wake;
+        uint32_t deadline;
+        volatile bool pending;
+        bool has_deadline;
+    };
+
+    struct Source {
+        SourceFn fn;
+        void *ctx;
+        uint32_t events;
+    };
+
+    // Returns true if the task is ready and clears the ready state.
+    // wake is set to the time the task became ready.
+    bool Ready(Task& t, uint32_t *wake) {
+        uint32_t save = save_and_disable_interrupts();
+        const bool pending = t.pending;
+        *wake = t.wake;
+        t.pending = false;
+        restore_interrupts(save);
+
+        if (t.has_deadline && (int32_t)(Clock::Now() - t.deadline) >= 0) {
+            if (!pending || (int32_t)(t.deadline - *wake) < 0)
+                *wake = t.deadline;
+            t.has_deadline = false;
+            return true;
+        }
+        return pending;
+    }
+
+    uint32_t NextDeadline(void) {
+        const uint32_t now = Clock::Now();
+        uint32_t next = now + SCHEDULER_MAX_SLEEP_US;
+
+        for (size_t i = 0; i < this->num_tasks; i++) {
+            const Task& t = this->tasks[i];
+            if (t.has_deadline && (int32_t)(t.deadline - next) < 0)
+                next = t.deadline;
+        }
+        return next;
+    }
+
+    Task tasks[N];
+    Source sources[N];
+    size_t num_tasks;
+    size_t num_sources;
+    uint32_t runs;
+    uint32_t latency_max;
+    uint64_t latency_sum;
+};
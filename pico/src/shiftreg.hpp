@@ -114,6 +114,31 @@ class ShiftReg
         return result;
     }
 
+    // Folds the shift register with symmetric coefficients. Only the first
+    // (N + 1) / 2 coefficients are read, the others are the mirror image.
+    // Adding the two samples sharing a coefficient first halves the number
+    // of multiplications.
+    //
+    // The caller must make sure that the result doesn't overflow.
+    template<typename B>
+    int32_t ConvoluteSymmetric(const B *coeff)
+    {
+        const T *lo = this->Data();
+        const T *hi = lo + N - 1;
+        int32_t result = 0;
+
+        for (size_t i = 0; i < N / 2; i++) {
+            // Pointer magic generates smaller code
+            result += (lo[0] + hi[0]) * coeff[0];
+            lo++;
+            hi--;
+            coeff++;
+        }
+        if (N % 2)
+            result += lo[0] * coeff[0];
+        return result;
+    }
+
   private:
     T *data;
     uint32_t off;
@@ -0,0 +1,67 @@
+#pragma once
+#include "inttypes.h"
+#include <stddef.h>
+#include <atomic>
+
+// Lock-free ring buffer between exactly one producer and one consumer,
+// i.e. both cores. Elements are pushed and popped in blocks.
+// N must be a power of two.
+// Only the producer writes head and only the consumer writes tail. The
+// release store of one offset publishes the elements written before, the
+// acquire load on the other side makes them visible.
+template <class T, size_t N>
+class SpscRing
+{
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+  public:
+    SpscRing() : data{}, head(0), tail(0), dropped(0) {
+    }
+
+    // Push queues the whole block or nothing. Producer only.
+    // Returns false if the block has been dropped.
+    bool Push(const T *in, const size_t len) {
+        const uint32_t h = this->head.load(std::memory_order_relaxed);
+        const uint32_t t = this->tail.load(std::memory_order_acquire);
+
+        if (len > N - (h - t)) {
+            this->dropped++;
+            return false;
+        }
+        for (size_t i = 0; i < len; i++)
+            this->data[(h + i) & (N - 1)] = in[i];
+        this->head.store(h + len, std::memory_order_release);
+        return true;
+    }
+
+    // Pop removes up to len elements and places them in out. Consumer only.
+    // Returns the number of elements popped.
+    size_t Pop(T *out, const size_t len) {
+        const uint32_t t = this->tail.load(std::memory_order_relaxed);
+        const uint32_t h = this->head.load(std::memory_order_acquire);
+        const size_t n = (h - t) < len ? (h - t) : len;
+
+        for (size_t i = 0; i < n; i++)
+            out[i] = this->data[(t + i) & (N - 1)];
+        this->tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Length returns the number of queued elements. Safe on both sides.
+    size_t Length(void) {
+        return this->head.load(std::memory_order_acquire) -
+               this->tail.load(std::memory_order_acquire);
+    }
+
+    // Dropped returns the number of dropped blocks. Producer only.
+    uint32_t Dropped(void) {
+        return this->dropped;
+    }
+
+  private:
+    T data[N];
+    // Free running write and read offsets
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    uint32_t dropped;
+};
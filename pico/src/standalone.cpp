@@ -1,7 +1,11 @@
 #include <stdio.h>
+#include <string.h>
+#ifndef WITH_GOOGLE_TEST
 #include <pico.h>
 #include <pico/stdlib.h>
+#endif
 
+#include "daikin_crc.hpp"
 #include "standalone.hpp"
 
 #define TIMEOUT_IDLE_MS 100
@@ -11,11 +15,24 @@
 // Response to specific packets on the bus to
 // emulate an 'external controller'.
 
-StandaloneController::StandaloneController() :
-	Answer{}, Non3xhPacket{}, Address(P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR),
-	Ready(false), State(IDLE),
-	IdleCounterMs(make_timeout_time_ms(TIMEOUT_IDLE_MS)),
-	ExtCtrlPacketsTodo(0) {
+// Size of the parameter values in packet 32h - 3fh, 0 if the layout is
+// unknown. The payload is a list of entries holding the parameter number
+// (u16 LE) followed by the value. Unused entries are filled with 0xff.
+static const uint8_t param_size[14] = {
+	0, 0, 0, 1, 2, 3, 4, 4, 1, 2, 3, 1, 0, 0,
+};
+
+StandaloneController::StandaloneController(const uint8_t addresses) :
+	Answer{}, Source(nullptr), InFlight(nullptr), Slots{},
+	SlotCount(addresses < 1 ? 1 : addresses > CTRL_MAX_ADDRESSES ? CTRL_MAX_ADDRESSES : addresses),
+	Non3xhPacket{}, Taken(0), Seed(2463534242u),
+	Ready(false), EchoPending(false), State(IDLE),
+	IdleCounterMs(make_timeout_time_ms(TIMEOUT_IDLE_MS)) {
+	for (int n = 0; n < this->SlotCount; n++) {
+		this->Slots[n].Address = P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR + n;
+		this->Slots[n].Active = true;
+		this->PrepareAnswers(&this->Slots[n]);
+	}
 }
 
 // Periodic state machine function
@@ -32,29 +49,46 @@ void StandaloneController::Check(void) {
 	case BUS_SCAN:
 		// Scan the bus for external controller activity
 		if (time_reached(this->IdleCounterMs)) {
+			// Resting slots take the addresses that are still free
+			for (int n = 0; n < this->SlotCount; n++) {
+				Slot *s = &this->Slots[n];
+
+				if (!s->Active && this->FindAddress(s, P1P2_DAIKIN_LAST_EXT_CTRL_ADDR))
+					this->PrepareAnswers(s);
+			}
 			this->State = OPERATING;
 			this->IdleCounterMs = make_timeout_time_ms(TIMEOUT_OPERATION);
 		}
 	break;
 	case OPERATING:
-		// Every 10 minutes stop normal operation for scanning external controller
-		if (time_reached(this->IdleCounterMs)) {
-			this->State = IDLE;
-			this->Ready = false;
-			this->IdleCounterMs = make_timeout_time_ms(TIMEOUT_IDLE_MS);
-		}
+		// Conflicting external controllers are detected by Receive().
+		// Nothing to do here.
+		if (time_reached(this->IdleCounterMs))
+			this->IdleCounterMs = make_timeout_time_ms(TIMEOUT_OPERATION);
 	break;
 	}
 }
 
+// Returns the time Check() needs to be called next
+absolute_time_t StandaloneController::Deadline(void) {
+	return this->IdleCounterMs;
+}
+
 // Returns true when 3xh packets needs to be exchanged (bus is busy)
 bool StandaloneController::ExtCtrlPhase(void) {
-	return this->ExtCtrlPacketsTodo > 0;
+	for (int n = 0; n < this->SlotCount; n++)
+		if (this->Slots[n].ExtCtrlPacketsTodo > 0)
+			return true;
+	return false;
 }
 
 // Returns true when the last 3xh packets is exchanged (bus is busy)
 bool StandaloneController::ExtCtrlPhaseEndsNow(void) {
-	return this->ExtCtrlPacketsTodo == 1;
+	size_t todo = 0;
+
+	for (int n = 0; n < this->SlotCount; n++)
+		todo += this->Slots[n].ExtCtrlPacketsTodo;
+	return todo == 1;
 }
 
 // Update bus busy status
@@ -63,10 +97,10 @@ void __attribute__((optimize("no-unroll-loops"))) StandaloneController::UpdateEx
 	if (in->Length <= 3)
 		return;
 
-	if (in->Data[1] != this->Address) {
-		// Only accept packets for the external controller address.
+	// Only accept packets for the external controller addresses.
+	Slot *s = this->SlotOf(in->Data[1]);
+	if (!s)
 		return;
-	}
 
 	switch (in->Data[2]) {
 		case P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL:
@@ -79,11 +113,11 @@ void __attribute__((optimize("no-unroll-loops"))) StandaloneController::UpdateEx
 			if (in->Data[0] == P1P2_DAIKIN_CMD_REQUEST) {
 				packets_todo++;
 			}
-			this->ExtCtrlPacketsTodo = packets_todo;
+			s->ExtCtrlPacketsTodo = packets_todo;
 			break;
 		case P1P2_DAIKIN_TYPE_STATUS_EXT_CTRL...P1P2_DAIKIN_TYPE_EXT_LAST:
-			if (this->ExtCtrlPacketsTodo > 0)
-				this->ExtCtrlPacketsTodo --;
+			if (s->ExtCtrlPacketsTodo > 0)
+				s->ExtCtrlPacketsTodo --;
 			break;
 		default:
 			return;
@@ -100,21 +134,18 @@ void StandaloneController::Receive(const Message *in) {
 	case IDLE:
 		return;
 	case BUS_SCAN:
-		if ((in->Data[0] == P1P2_DAIKIN_CMD_ANSWER) &&
-		    (in->Data[1] == this->Address) &&
-		    (in->Data[2] == P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL) &&
-		    (this->GenCRC(in, in->Length - 1) == in->Data[in->Length - 1])) {
+		if (this->IsConflict(in))
 			// Found a conflicting external controller!
-			// Switch to next address.
-			this->Address++;
-			if (this->Address > 0xF1)
-				this->Address = P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR;
-		}
+			this->Conflict(in->Data[1]);
 		break;
 	case OPERATING:
+		// The answer of another external controller. Switch immediately
+		// if it's on our address, it answers the requests from now on.
+		if (this->IsConflict(in) && !this->IsEcho(in))
+			this->Conflict(in->Data[1]);
 		this->UpdateExtCtrlPhase(in);
 		if (this->NeedToHandlePacket(in) &&
-		    this->GenCRC(in, in->Length - 1) == in->Data[in->Length - 1]) {
+		    DaikinCRC::Valid(in->Data, in->Length)) {
 			this->GenerateAnswer(in);
 		} else {
 			this->Ready = false;
@@ -123,14 +154,88 @@ void StandaloneController::Receive(const Message *in) {
 	}
 }
 
+// Returns true if in is the answer of an external controller
+bool StandaloneController::IsConflict(const Message *in) {
+	return (in->Data[0] == P1P2_DAIKIN_CMD_ANSWER) &&
+	       (in->Data[1] >= P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR) &&
+	       (in->Data[1] <= P1P2_DAIKIN_LAST_EXT_CTRL_ADDR) &&
+	       (in->Data[2] == P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL) &&
+	       DaikinCRC::Valid(in->Data, in->Length);
+}
+
+// Returns true if in is the answer to 30h transmitted last by this instance.
+// Only the first answer of an external controller after the transmission can
+// be the echo.
+bool StandaloneController::IsEcho(const Message *in) {
+	if (!this->EchoPending)
+		return false;
+	this->EchoPending = false;
+	return in->Length == this->Answer.Length &&
+	       memcmp(in->Data, this->Answer.Data, in->Length) == 0;
+}
+
+// Marks address as taken by another external controller. The slot on
+// address switches to the next free address or rests if there's none.
+void StandaloneController::Conflict(const uint8_t address) {
+	const uint8_t bit = 1 << (address - P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR);
+	Slot *s = this->SlotOf(address);
+
+	this->Taken |= bit;
+	if (!s)
+		return;
+
+	if (!this->FindAddress(s, address)) {
+		// All others are taken. Those conflicts are older than this one,
+		// their controllers might be gone.
+		this->Taken = bit;
+		this->FindAddress(s, address);
+	}
+	this->PrepareAnswers(s);
+	// The answer to the last request has the old address
+	this->Ready = false;
+}
+
+// Moves s to the first address after from that is neither taken nor served
+// by another slot. s rests if there's none. Returns true if s is active.
+bool StandaloneController::FindAddress(Slot *s, const uint8_t from) {
+	s->Active = false;
+	for (int i = 1; i <= CTRL_MAX_ADDRESSES; i++) {
+		const uint8_t n = (from - P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR + i) % CTRL_MAX_ADDRESSES;
+		const uint8_t address = P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR + n;
+
+		if ((this->Taken & (1 << n)) || this->SlotOf(address))
+			continue;
+		s->Address = address;
+		s->Active = true;
+		break;
+	}
+	s->ExtCtrlPacketsTodo = 0;
+	return s->Active;
+}
+
+// Returns the active slot serving address or nullptr
+StandaloneController::Slot *StandaloneController::SlotOf(const uint8_t address) {
+	for (int n = 0; n < this->SlotCount; n++)
+		if (this->Slots[n].Active && this->Slots[n].Address == address)
+			return &this->Slots[n];
+	return nullptr;
+}
+
+// Returns the address served by slot n, 0 if the slot rests
+uint8_t StandaloneController::Address(const uint8_t n) {
+	if (n >= this->SlotCount || !this->Slots[n].Active)
+		return 0;
+	return this->Slots[n].Address;
+}
+
 bool StandaloneController::NeedToHandlePacket(const Message *in) {
 	if (in->Data[0] != P1P2_DAIKIN_CMD_REQUEST) {
 		// External controller only answers requests.
 		// Ignore answers.
 		return false;
 	}
-	if (in->Data[1] != this->Address) {
-		// Only accept packets for the external controller address.
+	if (!this->SlotOf(in->Data[1])) {
+		// Only accept packets for the external controller addresses.
 		return false;
 	}
 
@@ -158,39 +263,54 @@ bool StandaloneController::NeedToHandlePacket(const Message *in) {
 // Generates a response message.
 void StandaloneController::GenerateAnswer(const Message *in) {
 	uint8_t type = in->Data[2];
+	uint8_t crc;
+	Slot *s = this->SlotOf(in->Data[1]);
 
 	this->Ready = false;
+	this->Source = nullptr;
+	if (!s)
+		return;
 
 	switch (type) {
 	case P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL:
 		this->Answer.Data[0] = P1P2_DAIKIN_CMD_ANSWER;
-		this->Answer.Data[1] = this->Address;
+		this->Answer.Data[1] = s->Address;
 		this->Answer.Data[2] = P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL;
+		crc = s->SenseCRC;
 		for (int i = 3; i < 17; i++) {
-			this->Answer.Data[i] = in->Data[i];
+			uint8_t d = in->Data[i];
 
 			// Request packet 3xh to be handled in the current cycle
 			if (i >= 4) {
 				// Returning 0 here doesn't prevent the other side from sending the packet.
 				// Thus only request to handle the packet when the remote doesn't want
 				// to send a packet yet.
-				if ((this->Packet3xh[i - 4].Length > 3) && this->Answer.Data[i] == 0)
-					this->Answer.Data[i] = 1;
+				if ((s->Packet3xh[i - 4].Length > 0) && d == 0)
+					d = 1;
 			}
+			this->Answer.Data[i] = d;
+			crc = DaikinCRC::Update(crc, d);
 		}
-
+		this->Answer.Data[17] = crc;
 		this->Answer.Length = 18;
 	break;
 
 	case P1P2_DAIKIN_TYPE_STATUS_EXT_CTRL:
 		this->Answer.Data[0] = P1P2_DAIKIN_CMD_ANSWER;
-		this->Answer.Data[1] = this->Address;
+		this->Answer.Data[1] = s->Address;
 		this->Answer.Data[2] = P1P2_DAIKIN_TYPE_STATUS_EXT_CTRL;
+		crc = s->StatusCRC;
 		for (int i = 3; i < 15; i++) {
-			this->Answer.Data[i] = in->Data[i];
+			uint8_t d = in->Data[i];
+
+			if (i == 7)
+				d = 0xB4; // LAN adapter ID in 0x31 payload byte 7
+			else if (i == 8)
+				d = 0x10; // LAN adapter ID in 0x31 payload byte 8
+			this->Answer.Data[i] = d;
+			crc = DaikinCRC::Update(crc, d);
 		}
-		this->Answer.Data[7] = 0xB4; // LAN adapter ID in 0x31 payload byte 7
-		this->Answer.Data[8] = 0x10; // LAN adapter ID in 0x31 payload byte 8
+		this->Answer.Data[15] = crc;
 		this->Answer.Length = 16;
 	break;
 
@@ -198,20 +318,11 @@ void StandaloneController::GenerateAnswer(const Message *in) {
 	case P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL...P1P2_DAIKIN_TYPE_EXT_LAST:
 		{
 			uint8_t idx = type - P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL;
-			this->Answer.Data[0] = P1P2_DAIKIN_CMD_ANSWER;
-			this->Answer.Data[1] = this->Address;
-			this->Answer.Data[2] = type;
-
-			if (this->Packet3xh[idx].Length) {
-				// Copy cached payload
-				for (int i = 3; i < this->Packet3xh[idx].Length - 1; i++) {
-					this->Answer.Data[i] = this->Packet3xh[idx].Data[i];
-				}
-				this->Answer.Length = this->Packet3xh[idx].Length;
-
-				// Mark cached packet as transmitted
-				this->Packet3xh[idx].Length = 0;
-			} else if (this->Non3xhPacket.Length) {
+
+			if (s->Packet3xh[idx].Length && !this->Defer(&s->Packet3xh[idx])) {
+				// Send the oldest cached packet
+				this->Source = &s->Packet3xh[idx];
+			} else if (this->Non3xhPacket.Length && !this->Defer(&this->Non3xhPacket)) {
 				// Protocol violation! Send a 'wrong' packet here!
 				// The remote waits about 180 msec for a correct response.
 				//
@@ -221,33 +332,17 @@ void StandaloneController::GenerateAnswer(const Message *in) {
 				// packet. As it waits here 180msec, this gives the oppertunity to transmit and
 				// receive custom packets here.
 				//
-
-				// Copy cached payload
-				for (int i = 0; i < this->Non3xhPacket.Length - 1; i++) {
-					this->Answer.Data[i] = this->Non3xhPacket.Data[i];
-				}
-				this->Answer.Length = this->Non3xhPacket.Length;
-	
-				this->Non3xhPacket.Length = 0;
-			} else {
+				this->Source = &this->Non3xhPacket;
+			} else if (s->Null3xh[idx].Length) {
 				// No cached packet, respond with NULL data packet (all bytes 0xff).
 				// This prevents a timeout on the remote waiting for an answer:
 				//   The remote waits about 150msec, thus there's a 180msec gap between two
 				//   packets when no answer is being transmitted.
 				//
 				// With this code the gap between 3xh packets is 120msec.
-				int len;
-				if (type == 0x35 || type == 0x3a || type == 0x38 || type == 0x39 || type == 0x3d)
-					len = 22;
-				else if (type == 0x36 || type == 0x3b || type == 0x37 || type == 0x3c)
-					len = 24;
-				else {
-					return;
-				}
-				// Generate NULL answer
-				for (int i = 3; i < len - 1; i++)
-					this->Answer.Data[i] = 0xff;
-				this->Answer.Length = len;
+				this->Answer = s->Null3xh[idx];
+			} else {
+				return;
 			}
 
 			break;
@@ -257,12 +352,47 @@ void StandaloneController::GenerateAnswer(const Message *in) {
 		return;
 	}
 
-	// Fix CRC
-	this->Answer.Data[this->Answer.Length - 1] =
-			this->GenCRC(&this->Answer, this->Answer.Length - 1);
 	this->Ready = true;
 }
 
+// Sets the header and the CRC of the answer to packet type
+void StandaloneController::PrepareAnswer(Message *m, uint8_t address, uint8_t type) {
+	m->Data[0] = P1P2_DAIKIN_CMD_ANSWER;
+	m->Data[1] = address;
+	m->Data[2] = type;
+	m->Data[m->Length - 1] = DaikinCRC::Calc(m->Data, m->Length - 1);
+}
+
+// Builds all answers of s that don't depend on the request.
+// Must be called when the address changes.
+void StandaloneController::PrepareAnswers(Slot *s) {
+	// Length of the NULL answer to packet 32h - 3fh, 0 if there's none
+	static const uint8_t null_length[14] = {
+		0, 0, 0, 22, 24, 24, 22, 22, 22, 24, 24, 22, 0, 0,
+	};
+	const uint8_t sense[3] = {P1P2_DAIKIN_CMD_ANSWER, s->Address,
+				  P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL};
+	const uint8_t status[3] = {P1P2_DAIKIN_CMD_ANSWER, s->Address,
+				   P1P2_DAIKIN_TYPE_STATUS_EXT_CTRL};
+
+	s->SenseCRC = DaikinCRC::Calc(sense, sizeof(sense));
+	s->StatusCRC = DaikinCRC::Calc(status, sizeof(status));
+
+	for (int idx = 0; idx < 14; idx++) {
+		const uint8_t type = P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL + idx;
+
+		for (int i = 0; i < s->Packet3xh[idx].Length; i++)
+			this->PrepareAnswer(&s->Packet3xh[idx].Packet[i], s->Address, type);
+
+		s->Null3xh[idx].Length = null_length[idx];
+		if (!s->Null3xh[idx].Length)
+			continue;
+		for (int i = 3; i < s->Null3xh[idx].Length - 1; i++)
+			s->Null3xh[idx].Data[i] = 0xff;
+		this->PrepareAnswer(&s->Null3xh[idx], s->Address, type);
+	}
+}
+
 // Returns true when TxAnswer should be transmitted.
 // Only true as long as TxAnswer() has not been called.
 // Only true till another packet is received, aka. Receive() is called
@@ -275,42 +405,210 @@ bool StandaloneController::Non3xhPacketWaitForTransmission(void) {
 	return this->Non3xhPacket.Length > 0;
 }
 
-// Cache a message and transmit it on the next free slot
-bool StandaloneController::CacheTxMessage(Message& in) {
+// Returns the queue in is cached in or nullptr if in is invalid
+StandaloneController::TxPackets *StandaloneController::QueueOf(const Message& in) {
 	if (in.Length <= 3)
-		return false;
+		return nullptr;
 
 	if (in.Data[2] < P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL ||
-		in.Data[2] > P1P2_DAIKIN_TYPE_EXT_LAST) {
-		this->Non3xhPacket = in;
-		return true;
-	}
+		in.Data[2] > P1P2_DAIKIN_TYPE_EXT_LAST)
+		return &this->Non3xhPacket;
 
 	if (in.Data[0] != P1P2_DAIKIN_CMD_ANSWER ||
-		in.Data[2] < P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL ||
-		in.Data[2] > P1P2_DAIKIN_TYPE_EXT_LAST)
+		in.Data[2] < P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL)
+		return nullptr;
+
+	return &this->SlotFor(in)->Packet3xh[in.Data[2] - P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL];
+}
+
+// Returns the slot sending the host message in. Host messages to 0xF0 + n
+// are sent by slot n, by slot 0 if slot n doesn't exist or rests.
+StandaloneController::Slot *StandaloneController::SlotFor(const Message& in) {
+	uint8_t n = in.Data[1] - P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR;
+
+	if (n >= this->SlotCount || !this->Slots[n].Active)
+		n = 0;
+	return &this->Slots[n];
+}
+
+// Merges the parameters written by in into the last packet of q. A pending
+// value of the same parameter is replaced. Returns false if in can't be
+// merged, q is unchanged then. dry only checks if in can be merged.
+bool StandaloneController::Merge(TxPackets *q, const Message& in, const bool dry) {
+	if (q == &this->Non3xhPacket || q->Length == 0)
+		return false;
+
+	const uint8_t idx = in.Data[2] - P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL;
+	const uint8_t last = q->Length - 1;
+	const int entry = 2 + param_size[idx];
+
+	// The packet being transmitted can't be changed anymore
+	if (last == 0 && this->InFlight == q)
+		return false;
+
+	Message m = q->Packet[last];
+	if (entry == 2 || m.Length != in.Length || (in.Length - 4) % entry)
+		return false;
+
+	for (int i = 3; i + entry < in.Length; i += entry) {
+		int slot = -1;
+
+		if (in.Data[i] == 0xff && in.Data[i + 1] == 0xff)
+			continue;
+		// Same parameter or the first unused entry
+		for (int j = 3; j + entry < m.Length; j += entry) {
+			if (m.Data[j] == in.Data[i] && m.Data[j + 1] == in.Data[i + 1]) {
+				slot = j;
+				break;
+			}
+			if (slot < 0 && m.Data[j] == 0xff && m.Data[j + 1] == 0xff)
+				slot = j;
+		}
+		if (slot < 0)
+			return false;
+		memcpy(&m.Data[slot], &in.Data[i], entry);
+	}
+
+	if (!dry) {
+		q->Packet[last] = m;
+		q->Writes[last]++;
+		this->PrepareAnswer(&q->Packet[last], q->Packet[last].Data[1], in.Data[2]);
+	}
+	return true;
+}
+
+// Cache a message and transmit it on the next free slot
+bool StandaloneController::CacheTxMessage(Message& in) {
+	TxPackets *q = this->QueueOf(in);
+
+	// A held message goes first
+	if (!q || q->HasHeld)
 		return false;
+	return this->Append(q, in);
+}
+
+// Caches in in q, returns false if q is full
+bool StandaloneController::Append(TxPackets *q, const Message& in) {
+	if (this->Merge(q, in, false))
+		return true;
+	if (q->Length == CTRL_TX_QUEUE_LEN)
+		return false;
+
+	Message& m = q->Packet[q->Length];
+	m = in;
+	if (q == &this->Non3xhPacket)
+		// Transmitted as is with a valid CRC
+		m.Data[m.Length - 1] = DaikinCRC::Calc(m.Data, m.Length - 1);
+	else
+		this->PrepareAnswer(&m, this->SlotFor(in)->Address, in.Data[2]);
+	q->Writes[q->Length] = 1;
+	q->Length++;
+	return true;
+}
 
-	uint8_t idx = in.Data[2] - P1P2_DAIKIN_TYPE_PARAM_EXT_CTRL;
+// Returns true if in can't be cached as its queue is full or a message is
+// held for it
+bool StandaloneController::TxQueueFull(const Message& in) {
+	TxPackets *q = this->QueueOf(in);
 
-	// Still have old packet in cache, abort...
-	if (this->Packet3xh[idx].Length > 3)
+	return q && (q->HasHeld || (q->Length == CTRL_TX_QUEUE_LEN && !this->Merge(q, in, true)));
+}
+
+// Holds in until its full queue has room. The host messages for the other
+// queues are cached in the meantime.
+bool StandaloneController::HoldTxMessage(const Message& in) {
+	TxPackets *q = this->QueueOf(in);
+
+	if (!q || q->HasHeld)
 		return false;
-	
-	this->Packet3xh[idx] = in;
+	q->Held = in;
+	q->HasHeld = true;
 	return true;
 }
 
 // The Msg to be transmitted.
 // Calling this functions resets HasTxData()
 void StandaloneController::TxAnswer(Message *out) {
-	out->Length = this->Answer.Length;
+	const TxPackets *q = this->Source;
+	const Message& m = q ? q->Packet[0] : this->Answer;
+
+	out->Length = m.Length;
 	for (int i = 0; i < out->Length; i++) {
-		out->Data[i] = this->Answer.Data[i];
+		out->Data[i] = m.Data[i];
 	}
+	this->InFlight = this->Source;
+	this->EchoPending = !this->Source &&
+			    m.Data[2] == P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL;
 	this->Ready = false;
 }
 
+// The last TxAnswer isn't transmitted. A queued packet is sent on a later
+// request without counting an attempt.
+void StandaloneController::TxCancel(void) {
+	this->InFlight = nullptr;
+	this->EchoPending = false;
+}
+
+// Returns true if q skips this request. Counts down the backoff.
+bool StandaloneController::Defer(TxPackets *q) {
+	if (!q->Backoff)
+		return false;
+	q->Backoff--;
+	return true;
+}
+
+// Removes Packet[0] of q
+void StandaloneController::Pop(TxPackets *q) {
+	for (int i = 1; i < q->Length; i++) {
+		q->Packet[i - 1] = q->Packet[i];
+		q->Writes[i - 1] = q->Writes[i];
+	}
+	q->Length--;
+	q->Attempts = 0;
+	q->Backoff = 0;
+
+	if (q->HasHeld) {
+		q->HasHeld = false;
+		this->Append(q, q->Held);
+	}
+}
+
+// Mixes e into the random backoff
+void StandaloneController::AddEntropy(const uint32_t e) {
+	this->Seed ^= e;
+	if (!this->Seed)
+		this->Seed = 2463534242u;
+}
+
+// The transmission of the last TxAnswer has finished. ok is false on
+// errors, a queued packet is sent again then.
+StandaloneController::TxResult StandaloneController::TxDone(const bool ok) {
+	TxPackets *q = this->InFlight;
+	TxResult r = {0, 0, false};
+
+	this->InFlight = nullptr;
+	if (!ok)
+		this->EchoPending = false;
+	if (!q)
+		return r;
+
+	r.Writes = q->Writes[0];
+	r.Attempts = ++q->Attempts;
+	if (ok || q->Attempts >= CTRL_TX_ATTEMPTS) {
+		// Transmitted or given up
+		this->Pop(q);
+		return r;
+	}
+
+	// Binary exponential backoff, xorshift32
+	this->Seed ^= this->Seed << 13;
+	this->Seed ^= this->Seed >> 17;
+	this->Seed ^= this->Seed << 5;
+	q->Backoff = this->Seed & ((1 << q->Attempts) - 1);
+	r.Retry = true;
+	return r;
+}
+
 void StandaloneController::BusCollision(void) {
 	// On bus collision scan bus for conflicting external controllers
 	this->State = IDLE;
@@ -323,28 +621,9 @@ bool StandaloneController::IsTxAnswer(const Message *in) {
 	if (in->Data[0] != P1P2_DAIKIN_CMD_ANSWER)
 		return false;
 
-	if (in->Data[1] == this->Address)
+	if (this->SlotOf(in->Data[1]))
 		return false;
 
 	return (in->Data[2] >= P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL) &&
 	       (in->Data[2] <= P1P2_DAIKIN_TYPE_EXT_LAST);
 }
-
-// Calculates the CRC over Data[0]..Data[len - 1]
-// Using uint32_t/size_t for faster assembly code.
-uint8_t StandaloneController::GenCRC(const Message *in, size_t len) {
-	uint32_t crc = 0;
-	for (size_t j = 0; j < len; j++) {
-		uint32_t c = in->Data[j];
-		for (size_t i = 0; i < 8; i++) {
-			if ((crc ^ c) & 0x01) {
-				crc = (crc >> 1) ^ 0xd9;
-			} else {
-				crc = (crc >> 1);
-			}
-			c >>= 1;
-		}
-	}
-	return crc & 0xff;
-}
-
@@ -1,5 +1,8 @@
 #pragma once
+#include <stddef.h>
+
 #include "message.hpp"
+#include "pico/types.h"
 
 #define P1P2_DAIKIN_CMD_REQUEST 0x00
 #define P1P2_DAIKIN_CMD_ANSWER  0x40
@@ -12,15 +15,55 @@
 #define  P1P2_DAIKIN_STATUS_USER_ACT 0x80
 
 #define P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR 0xF0
+#define P1P2_DAIKIN_LAST_EXT_CTRL_ADDR    0xF1
+
+// Number of external controller addresses served at once by default. Every
+// address gets its own 3xh cycle from the main controller.
+#ifndef CTRL_ADDRESSES
+#define CTRL_ADDRESSES 1
+#endif
+#define CTRL_MAX_ADDRESSES (P1P2_DAIKIN_LAST_EXT_CTRL_ADDR - P1P2_DAIKIN_DEFAULT_EXT_CTRL_ADDR + 1)
+
+// Number of packets waiting for transmission per 3xh packet type and for
+// non 3xh packets
+#define CTRL_TX_QUEUE_LEN 4
+
+// Transmissions of a host packet before it's dropped
+#ifndef CTRL_TX_ATTEMPTS
+#define CTRL_TX_ATTEMPTS 4
+#endif
 
 //
 // Act as Daiking external controller
 // Response to address 0xF0,0xF1,... on the P1P2 bus.
 //
+// Up to CTRL_MAX_ADDRESSES addresses are served at once, each by a slot with
+// its own 3xh cache and phase tracking. Every slot answers on a different
+// address.
+//
+// The bus is scanned for other external controllers for 2 seconds on start
+// and after a bus collision. Every answer to 30h of another device marks its
+// address as taken. A slot on that address switches to the next address
+// neither taken nor served by another slot immediately. If there's none the
+// slot rests until the end of the next bus scan.
+//
+// The answers are assembled and CRC'd ahead of time when the address or the
+// cached packets change. Answering a request only copies the request
+// dependent bytes of 30h and 31h packets while updating the CRC.
+//
+// Packets written by the host are queued per type. Parameters written to a
+// 3xh packet that is still waiting are merged into it, a later write of the
+// same parameter replaces the pending value. A packet leaves the queue once
+// it has been transmitted without error or after CTRL_TX_ATTEMPTS failed
+// transmissions, see TxDone(). After the n-th failure the packet skips a
+// random number of 0 to 2^n - 1 requests it could answer. Host messages to
+// 0xF0 + n are queued in slot n, to slot 0 if there's no such slot.
+//
 class StandaloneController
 {
   public:
-    StandaloneController();
+    // addresses is the number of slots
+    StandaloneController(const uint8_t addresses = CTRL_ADDRESSES);
 
     // Process received message.
     void Receive(const Message *in);
@@ -29,6 +72,9 @@ class StandaloneController
     // Must be regulary called.
     void Check(void);
 
+    // Returns the time Check() needs to be called next
+    absolute_time_t Deadline(void);
+
     // Returns true when TxAnswer should be transmitted.
     // Only true as long as TxAnswer() has not been called.
     // Only true till another packet is received, aka. Receive() is called.
@@ -38,15 +84,45 @@ class StandaloneController
     // Calling this functions resets HasTxData()
     void TxAnswer(Message *out);
 
+    // Outcome of the transmission of an answer
+    struct TxResult {
+      // Number of host messages transmitted with the answer
+      uint8_t Writes;
+      // Transmissions of the answer so far
+      uint8_t Attempts;
+      // The transmission failed, the answer stays queued for another attempt
+      bool Retry;
+    };
+
+    // The transmission of the last TxAnswer has finished. ok is false on
+    // errors, a queued packet is sent again then.
+    TxResult TxDone(const bool ok);
+
+    // The last TxAnswer isn't transmitted. A queued packet is sent on
+    // a later request without counting an attempt.
+    void TxCancel(void);
+
+    // Mixes e into the random backoff, i.e. the time of a collision
+    void AddEntropy(const uint32_t e);
+
     // A bus collision on Tx Msg happened.
     void BusCollision(void);
 
     // Returns true if packet is generated by this instance.
     bool IsTxAnswer(const Message *in);
 
-    // Caches a message and transmits it on the next available slot
+    // Caches a message and transmits it on the next available slot.
+    // Returns false if the message is invalid or its queue is full.
     bool CacheTxMessage(Message& in);
 
+    // Returns true if in can't be cached as its queue is full or a
+    // message is held for it
+    bool TxQueueFull(const Message& in);
+
+    // Holds in until its full queue has room, it's cached then. Returns
+    // false if a message is held for the queue of in already.
+    bool HoldTxMessage(const Message& in);
+
     // Check if received packet needs to be handled
     bool NeedToHandlePacket(const Message *in);
 
@@ -63,6 +139,9 @@ class StandaloneController
     // Returns true when a non 3xh packet is waiting for transmission
     bool Non3xhPacketWaitForTransmission(void);
 
+    // Returns the address served by slot n, 0 if the slot rests
+    uint8_t Address(const uint8_t n);
+
 
   private:
     enum CTRL_STATE {
@@ -71,23 +150,88 @@ class StandaloneController
       OPERATING,
     };
 
+    // Packets written by the host waiting for transmission, ready to
+    // transmit. Packet[0] is sent next.
+    struct TxPackets {
+      Message Packet[CTRL_TX_QUEUE_LEN];
+      // Number of host messages merged into each packet
+      uint8_t Writes[CTRL_TX_QUEUE_LEN];
+      uint8_t Length;
+      // Transmissions of Packet[0] so far
+      uint8_t Attempts;
+      // Requests Packet[0] skips before its next attempt
+      uint8_t Backoff;
+      // Host message waiting for room in Packet
+      Message Held;
+      bool HasHeld;
+    };
+
+    // State of one emulated external controller
+    struct Slot {
+      // The address to listen on
+      uint8_t Address;
+      // Answers requests on Address
+      bool Active;
+      // Cached responses for Packet 32h - 3fh
+      TxPackets Packet3xh[14];
+      // NULL responses for Packet 32h - 3fh, ready to transmit
+      Message Null3xh[14];
+      // CRC of the header of the answer to packet 30h and 31h
+      uint8_t SenseCRC;
+      uint8_t StatusCRC;
+      // Counter of remaining 3xh packets
+      size_t ExtCtrlPacketsTodo;
+    };
+
     // Returns true when 3xh packets needs to be exchanged (bus is busy)
     void UpdateExtCtrlPhase(const Message *in);
-    uint8_t GenCRC(const Message *in, size_t len);
+    // Returns the active slot serving address or nullptr
+    Slot *SlotOf(const uint8_t address);
+    // Builds all answers of s that don't depend on the request
+    void PrepareAnswers(Slot *s);
+    // Returns the queue in is cached in or nullptr if in is invalid
+    TxPackets *QueueOf(const Message& in);
+    // Returns the slot sending the host message in
+    Slot *SlotFor(const Message& in);
+    // Caches in in q, returns false if q is full
+    bool Append(TxPackets *q, const Message& in);
+    // Merges the parameters of in into the last packet of q
+    bool Merge(TxPackets *q, const Message& in, const bool dry);
+    // Returns true if q skips this request. Counts down the backoff.
+    bool Defer(TxPackets *q);
+    // Removes Packet[0] of q
+    void Pop(TxPackets *q);
+    // Returns true if in is the answer of an external controller
+    bool IsConflict(const Message *in);
+    // Returns true if in is the echo of the last 30h answer
+    bool IsEcho(const Message *in);
+    // Marks address as taken, moves its slot away
+    void Conflict(const uint8_t address);
+    // Moves s to the next free address, returns false if there's none
+    bool FindAddress(Slot *s, const uint8_t from);
+    // Sets the header and the CRC of the answer to packet type
+    void PrepareAnswer(Message *m, uint8_t address, uint8_t type);
     // Message to answer latest request
     Message Answer;
-    // Cached responses for Packet 32h - 3fh
-    Message Packet3xh[14];
-    // Cached response for Packet != 3xh
-    Message Non3xhPacket;
-    // The address to listen on
-    size_t Address;
+    // Queue holding the answer to the latest request, nullptr for Answer
+    TxPackets *Source;
+    // Queue holding the answer being transmitted or nullptr
+    TxPackets *InFlight;
+    // Emulated external controllers
+    Slot Slots[CTRL_MAX_ADDRESSES];
+    uint8_t SlotCount;
+    // Cached responses for Packet != 3xh, sent in the cycle of any slot
+    TxPackets Non3xhPacket;
+    // Addresses of other external controllers, bit n is 0xF0 + n
+    uint8_t Taken;
+    // State of the random number generator for the backoff
+    uint32_t Seed;
     // Has message to transmit
     bool Ready;
+    // The echo of the last 30h answer hasn't been received yet
+    bool EchoPending;
     // Statemachine
     enum CTRL_STATE State;
     // Counter used in the state machine
     absolute_time_t IdleCounterMs;
-    // Counter of remaining 3xh packets
-    size_t ExtCtrlPacketsTodo;
 };
@@ -0,0 +1,144 @@
+#pragma once
+#include "inttypes.h"
+#include <stddef.h>
+
+#include "message.hpp"
+
+// Interval to check if the hardware has finished the current packet
+#define TX_QUEUE_POLL_US 100
+
+// Transmit queue of whole packets for the P1P2 UART.
+// Packets are started one after another with a minimum gap measured from
+// the end of the previous packet on the bus.
+// The queue has no hardware dependencies. The driver calls Update() on a
+// timer and starts the transmission of the returned packet.
+// Not IRQ safe. The caller must serialize access.
+template <size_t N>
+class TxQueue
+{
+  public:
+    enum EVENT {
+        // The packet is about to be transmitted. Allows to arm echo checks.
+        EVENT_STARTED,
+        // The last stop bit of the packet has been transmitted
+        EVENT_DONE,
+        // The packet has been removed by Abort()
+        EVENT_ABORTED,
+    };
+
+    // Called on every state change of a packet.
+    typedef void (*Callback)(const Message& m, const enum EVENT ev, void *ctx);
+
+    TxQueue(const uint32_t gap_us) : entries{}, head(0), length(0),
+        state(IDLE), gap(gap_us), gap_end(0) {
+    }
+
+    // Push queues the packet. Returns false if the queue is full.
+    bool Push(const Message& m, Callback cb, void *ctx) {
+        if (this->length == N)
+            return false;
+        Entry& e = this->entries[(this->head + this->length) % N];
+        e.msg = m;
+        e.cb = cb;
+        e.ctx = ctx;
+        this->length++;
+        return true;
+    }
+
+    // SetGap sets the minimum idle time between two queued packets
+    void SetGap(const uint32_t us) {
+        this->gap = us;
+    }
+
+    // Update advances the queue.
+    // busy must be true as long as the hardware is transmitting.
+    // Returns the packet to transmit now or nullptr.
+    // next is set to the time Update must be called again or 0 if the
+    // queue is idle.
+    const Message *Update(const uint32_t now, const bool busy, uint32_t *next) {
+        *next = 0;
+
+        if (this->state == SENDING) {
+            if (busy) {
+                *next = Later(now + TX_QUEUE_POLL_US);
+                return nullptr;
+            }
+            this->Pop(EVENT_DONE);
+            this->gap_end = now + this->gap;
+            this->state = GAP;
+        }
+        if (this->state == GAP) {
+            if (this->length == 0) {
+                // Keep the gap for packets pushed later
+                *next = (int32_t)(now - this->gap_end) < 0 ? Later(this->gap_end) : 0;
+                if (*next == 0)
+                    this->state = IDLE;
+                return nullptr;
+            }
+            if ((int32_t)(now - this->gap_end) < 0) {
+                *next = Later(this->gap_end);
+                return nullptr;
+            }
+            this->state = IDLE;
+        }
+        if (this->length == 0)
+            return nullptr;
+
+        Entry& e = this->entries[this->head];
+        if (e.cb)
+            e.cb(e.msg, EVENT_STARTED, e.ctx);
+        this->state = SENDING;
+        *next = Later(now + TX_QUEUE_POLL_US);
+        return &e.msg;
+    }
+
+    // Abort removes all packets including the one being transmitted
+    void Abort(void) {
+        while (this->length > 0)
+            this->Pop(EVENT_ABORTED);
+        this->state = IDLE;
+    }
+
+    size_t Length(void) {
+        return this->length;
+    }
+
+    // Returns true if no packet is queued or being transmitted
+    bool Empty(void) {
+        return this->length == 0;
+    }
+
+  private:
+    enum STATE {
+        IDLE,
+        SENDING,
+        // Waiting for the gap after a packet
+        GAP,
+    };
+
+    struct Entry {
+        Message msg;
+        Callback cb;
+        void *ctx;
+    };
+
+    void Pop(const enum EVENT ev) {
+        Entry& e = this->entries[this->head];
+        this->head = (this->head + 1) % N;
+        this->length--;
+        if (e.cb)
+            e.cb(e.msg, ev, e.ctx);
+    }
+
+    // 0 is used as 'no time', move it by 1 usec
+    static inline uint32_t Later(const uint32_t t) {
+        return t ? t : 1;
+    }
+
+    Entry entries[N];
+    size_t head;
+    size_t length;
+    enum STATE state;
+    uint32_t gap;
+    uint32_t gap_end;
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include "inttypes.h"
+#include <string.h>
+#include <stddef.h>
+
+// Transmit queue for one host interface.
+// N must be a power of two. The buffer is aligned to N to allow the DMA
+// to wrap the read address in hardware.
+// Messages are only queued as a whole. If a message doesn't fit the message
+// is dropped, so a slow consumer never corrupts lines.
+// Not IRQ safe. The caller must serialize access.
+template <size_t N>
+class TxRing
+{
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+  public:
+    TxRing() : data{}, head(0), tail(0), dropped(0), sent(0) {
+    }
+
+    // Push queues the whole message or nothing.
+    // Returns false if the message has been dropped.
+    bool Push(const uint8_t *in, const size_t len) {
+        if (len > this->Free()) {
+            this->dropped++;
+            return false;
+        }
+        for (size_t i = 0; i < len; i++)
+            this->data[(this->head + i) & (N - 1)] = in[i];
+        this->head += len;
+        return true;
+    }
+
+    // ReadPtr returns a pointer to the oldest byte
+    const uint8_t *ReadPtr(void) {
+        return &this->data[this->tail & (N - 1)];
+    }
+
+    // Contiguous returns the number of bytes that can be read at ReadPtr
+    // without wrapping around.
+    size_t Contiguous(void) {
+        const size_t off = this->tail & (N - 1);
+        const size_t len = this->Length();
+        return len < N - off ? len : N - off;
+    }
+
+    // Consume removes len bytes from the queue
+    void Consume(const size_t len) {
+        this->tail += len;
+        this->sent += len;
+    }
+
+    // Discard removes all queued bytes. They are counted as dropped.
+    void Discard(void) {
+        if (this->Length())
+            this->dropped++;
+        this->tail = this->head;
+    }
+
+    size_t Length(void) {
+        return this->head - this->tail;
+    }
+
+    size_t Free(void) {
+        return N - this->Length();
+    }
+
+    // Dropped returns the number of dropped messages
+    uint32_t Dropped(void) {
+        return this->dropped;
+    }
+
+    // Sent returns the number of bytes passed to the interface
+    uint32_t Sent(void) {
+        return this->sent;
+    }
+
+  private:
+    uint8_t data[N] __attribute__ ((aligned(N)));
+    // Free running write and read offsets
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    uint32_t sent;
+};
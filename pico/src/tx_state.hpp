@@ -45,6 +45,16 @@ class TxState
 			return State;
 		}
 
+		// Returns true if the state has a timeout
+		bool HasTimeout(void) {
+			return TimeoutForState(State) != 0;
+		}
+
+		// Returns the time the state times out. Only valid if HasTimeout().
+		absolute_time_t Deadline(void) {
+			return WaitCounter;
+		}
+
 		static unsigned long TimeoutForState(const enum STATE s) {
 			switch (s) {
 			case IDLE:
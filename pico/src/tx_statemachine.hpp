@@ -15,7 +15,9 @@ class TxStateMachine
 {
 	public:
 		TxStateMachine(UARTPio& Pio) :
-		TxMsg{}, RxMsg{}, State(TxState::IDLE), TxOffset(~0), UART(&Pio), Err (false)
+		TxMsg{}, RxMsg{}, State(TxState::IDLE), TxOffset(~0), UART(&Pio), Err (false),
+		PoweredOn(false), PowerReadyAt{0}, HoldUntil{0}, TurnaroundAt{0}, HoldTimeUs(TX_WARM_HOLD_US),
+		Burst(false), TxCb(nullptr), TxCtx(nullptr)
 		{
 			UART->ClearFifo();
 			UART->EnableShutdown(true);
@@ -59,6 +61,60 @@ class TxStateMachine
 			return TxOffset == TxMsg.Length;
 		}
 
+		// KeepWarm tells the state machine that more transmissions are
+		// expected shortly, i.e. during the 3xh packet exchange.
+		// The line driver then stays powered for the hold time after a
+		// transmission and the next one starts without power on delay.
+		void KeepWarm(const bool burst) {
+			Burst = burst;
+			if (!Burst && IsIdle() && PoweredOn)
+				PowerOff();
+		}
+
+		// Sets the time in micro seconds the line driver stays powered
+		// after a transmission in burst mode. 0 disables burst mode.
+		void SetHoldTime(const unsigned long us) {
+			HoldTimeUs = us;
+		}
+
+		// FrameEnd passes the end of the last packet received on the bus,
+		// ago_us micro seconds before now. A transmission with the line
+		// driver already powered starts TX_TURNAROUND_US after it at the
+		// earliest.
+		void FrameEnd(const unsigned long ago_us) {
+			TurnaroundAt = make_timeout_time_us(ago_us < TX_TURNAROUND_US ?
+							    TX_TURNAROUND_US - ago_us : 0);
+		}
+
+		// SetTxCallback sets the callback passed to the UART for every
+		// packet, i.e. to arm the bit level collision detection.
+		void SetTxCallback(UARTPio::Queue::Callback cb, void *ctx) {
+			TxCb = cb;
+			TxCtx = ctx;
+		}
+
+		// Collision aborts the transmission on a bus collision detected
+		// while the packet is on the bus.
+		void Collision(void) {
+			if (State.Value() != TxState::STARTED_WAIT_FOR_BUSY &&
+			    State.Value() != TxState::RUNNING_CHECK_DATA)
+				return;
+			RxMsg.Status = Message::STATUS_ERR_BUS_COLLISION;
+			ChangeState(TxState::RUNNING_WAIT_FOR_IDLE);
+			Err = true;
+		}
+
+		// Returns true if the line driver is powered
+		bool IsPoweredOn(void) {
+			return PoweredOn;
+		}
+
+		// Returns true if the line driver is powered and has finished
+		// its startup
+		bool IsWarm(void) {
+			return PoweredOn && time_reached(PowerReadyAt);
+		}
+
 		// Returns true if the TX state machine has encountered an error
 		// transmitting the packet
 		bool Error(void) {
@@ -71,10 +127,27 @@ class TxStateMachine
 			return State.Value();
 		}
 
+		// Returns true if Update must be called at Deadline() even
+		// without line state changes
+		bool HasDeadline(void) {
+			if (IsIdle())
+				return PoweredOn;
+			return State.HasTimeout();
+		}
+
+		// Returns the time the current state times out
+		absolute_time_t Deadline(void) {
+			if (IsIdle())
+				return HoldUntil;
+			if (State.Value() == TxState::WAIT_POWERON)
+				return PowerReadyAt;
+			return State.Deadline();
+		}
+
 		// Update performs periodic checks on the TX state machine.
 		// This method will change the state by calling ChangeState.
 		void Update(const bool LineIsBusy, const bool RxError,
-			    const bool RxValid, const char RxChar) {
+			    const bool RxValid, const uint8_t RxChar) {
 			bool BusCollision = false;
 			if (State.IsError() || State.LineStateIsError(LineIsBusy)) {
 				if (LineIsBusy)
@@ -89,21 +162,32 @@ class TxStateMachine
 			if (!IsIdle() && UART->Error()) {
 				RxMsg.Status = Message::STATUS_INTERNAL_ERROR;
 				ChangeState(TxState::IDLE);
+				PowerOff();
 				Err = true;
 				return;
 			}
 
 			switch (State.Value()) {
 			case TxState::IDLE:
-				// Nothing to do here
+				// Burst is over, power off the line driver
+				if (PoweredOn && time_reached(HoldUntil))
+					PowerOff();
 				break;
 			case TxState::IDLE_WAIT_LINEFREE:
-				if (!LineIsBusy && !UART->Transmitting() && TxOffset == 0)
-					// Need to wait for the IC to power on...
-					ChangeState(TxState::WAIT_POWERON);
+				if (!LineIsBusy && !UART->Transmitting() && TxOffset == 0) {
+					if (IsWarm()) {
+						// Line driver is still powered from the previous
+						// transmission. Keep the turnaround time.
+						if (time_reached(TurnaroundAt))
+							ChangeState(TxState::STARTED_WAIT_FOR_BUSY);
+					} else {
+						// Need to wait for the IC to power on...
+						ChangeState(TxState::WAIT_POWERON);
+					}
+				}
 				break;
 			case TxState::WAIT_POWERON:
-				if (State.TimedOut())
+				if (time_reached(PowerReadyAt))
 					ChangeState(TxState::STARTED_WAIT_FOR_BUSY);
 				break;
 			case TxState::STARTED_WAIT_FOR_BUSY:
@@ -155,15 +239,19 @@ class TxStateMachine
 			switch (NewState) {
 			case TxState::IDLE:
 				// FIFO should be empty.
-				UART->EnableShutdown(true);
+				// Keep the line driver powered if more packets are expected.
+				if (Burst && HoldTimeUs > 0 && PoweredOn)
+					HoldUntil = make_timeout_time_us(HoldTimeUs);
+				else
+					PowerOff();
 				break;
 			case TxState::IDLE_WAIT_LINEFREE:
 				break;
 			case TxState::WAIT_POWERON:
-				UART->EnableShutdown(false);
+				PowerOn();
 				break;
 			case TxState::STARTED_WAIT_FOR_BUSY:
-				UART->Send(TxMsg);
+				UART->Send(TxMsg, TxCb, TxCtx);
 				break;
 			case TxState::RUNNING_CHECK_DATA:
 				break;
@@ -177,8 +265,35 @@ class TxStateMachine
 			State = TxState(NewState);
 		}
 
+		// Enables the line driver. Keeps the startup time if it's already
+		// powered.
+		void PowerOn(void) {
+			if (PoweredOn)
+				return;
+			UART->EnableShutdown(false);
+			PoweredOn = true;
+			PowerReadyAt = make_timeout_time_us(TX_POWERON_TIMEOUT_US);
+		}
+
+		void PowerOff(void) {
+			UART->EnableShutdown(true);
+			PoweredOn = false;
+		}
+
 		TxState State;
 		size_t TxOffset;
 		UARTPio* UART;
 		bool Err;
+		// Line driver power state
+		bool PoweredOn;
+		// Time the line driver has finished its startup
+		absolute_time_t PowerReadyAt;
+		// Time the line driver is powered off in burst mode
+		absolute_time_t HoldUntil;
+		// Earliest start of a transmission after the last packet received
+		absolute_time_t TurnaroundAt;
+		unsigned long HoldTimeUs;
+		bool Burst;
+		UARTPio::Queue::Callback TxCb;
+		void *TxCtx;
 };
@@ -1,6 +1,7 @@
 #include <inttypes.h>
 #include "uart.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 // Level sets the line level for a "high" or "low" symbol
@@ -9,7 +10,12 @@
 UART::UART(int16_t buffer[UART_BUFFER_LEN * 2], enum UART_PARITY p) :
 	parity(p),
 	counter(0),
+	phase(0),
 	state(WAIT_FOR_IDLE),
+	early(false),
+	correction(false),
+	parity_failed(false),
+	suspects{},
 	reg(buffer)
 {
 }
@@ -23,40 +29,47 @@ inline bool UART::ZeroLevelDetect(const int16_t prob) {
 	return prob != 0;
 }
 
-bool UART::FindBestPhase(uint8_t *out, bool *err) {
+// FindBestPhase decodes the first bits of the byte. The start bit is at
+// reg.At(base).
+bool UART::FindBestPhase(const uint8_t base, const uint8_t bits, uint8_t *out, bool *err) {
 	uint32_t bestprob = 0;
 	//std::cout << "FindBestPhase " << std::endl;
 
 	// The START bit detected a zero condition, so the phase must be close to the
 	// beginning. It's safe to ignore the 1/2 last part of the symbol.
+	this->parity_failed = false;
 	for (uint8_t phase = 0; phase < UART_OVERSAMPLING_RATE / 2; phase++) {
 		uint8_t tmp_data, tmp_parity;
-		bool rx_error;
+		bool rx_error, parity_error;
 		uint32_t prob;
 		//std::cout << "phase: " << (int)phase << std::endl;
 		tmp_data = 0;
 		tmp_parity = 0;
 		rx_error = false;
+		parity_error = false;
 
 		if (this->parity == PARITY_NONE)
-			prob = this->ExtractData(phase, &tmp_data, &rx_error);
+			prob = this->ExtractData(base, phase, bits, &tmp_data, &rx_error);
 		else {
-			prob = this->ExtractDataAndParity(phase, &tmp_parity, &tmp_data, &rx_error);
+			prob = this->ExtractDataAndParity(base, phase, bits, &tmp_parity, &tmp_data, &rx_error);
 
 			if ((tmp_parity & 1) && this->parity == PARITY_EVEN) {
 				//std::cout << "parity error " << std::endl;
-				rx_error = true;
+				parity_error = true;
 			}
 			else if (!(tmp_parity & 1) && this->parity == PARITY_ODD) {
 				//std::cout << "parity error " << std::endl;
-				rx_error = true;
+				parity_error = true;
 			}
+			rx_error |= parity_error;
 		}
 
 		if (prob > bestprob) {
 			bestprob = prob;
 			*out = tmp_data;
 			*err = rx_error;
+			this->parity_failed = parity_error;
+			this->phase = phase;
 		}
 		//std::cout << "prob " << (int) prob << std::endl;
 		//std::cout << "rx_error " << (int) rx_error << std::endl;
@@ -66,13 +79,93 @@ bool UART::FindBestPhase(uint8_t *out, bool *err) {
 	}
 	if (bestprob == 0) {
 		*err = true;
+		this->parity_failed = false;
 	}
+	if (this->parity_failed)
+		this->RankBits(base);
 	return false;
 }
 
-uint32_t UART::ExtractData(const uint8_t phase, uint8_t *out, bool *err) {
+// RankBits finds the two data or parity bits of the last byte with the
+// lowest confidence. The start bit is at reg.At(base + phase).
+// A pulse is as confident as its probability. A bit without pulse is less
+// confident the stronger a pulse detected close to its center is. Two pulses
+// of the same polarity in a row mean that one of them is spurious or that a
+// pulse in between has been lost. The latter is more likely, a weak pulse is
+// cancelled easier than a pulse is created.
+void UART::RankBits(const uint8_t base) {
+	const uint32_t start = base + this->phase;
+	int32_t conf[9];
+	int32_t ref = 0;
+	uint8_t last = 0;
+
+	for (uint8_t b = 0; b <= 9; b++)
+		ref = std::max(ref, (int32_t)abs(this->reg.At(start + b * UART_OVERSAMPLING_RATE)));
+
+	for (uint8_t b = 1; b <= 9; b++) {
+		const uint32_t center = start + b * UART_OVERSAMPLING_RATE;
+		const int16_t prob = this->reg.At(center);
+		int32_t near = 0;
+
+		if (prob != 0) {
+			conf[b - 1] = abs(prob);
+			continue;
+		}
+		for (uint32_t i = center - UART_OVERSAMPLING_RATE / 4;
+		     i <= center + UART_OVERSAMPLING_RATE / 4 && i < UART_BUFFER_LEN; i++)
+			near = std::max(near, (int32_t)abs(this->reg.At(i)));
+		conf[b - 1] = std::max(ref - near, (int32_t)0);
+	}
+
+	for (uint8_t b = 1; b <= 9; b++) {
+		const int16_t prob = this->reg.At(start + b * UART_OVERSAMPLING_RATE);
+		const int16_t prev = this->reg.At(start + last * UART_OVERSAMPLING_RATE);
+
+		if (prob == 0)
+			continue;
+		if ((prob > 0) == (prev > 0)) {
+			// Either a pulse in between has been lost or one of both
+			// pulses is spurious
+			for (uint8_t i = last + 1; i < b; i++)
+				conf[i - 1] /= 4;
+			if (last)
+				conf[last - 1] /= 2;
+			conf[b - 1] /= 2;
+		}
+		last = b;
+	}
+
+	this->suspects[0] = 0;
+	this->suspects[1] = 1;
+	if (conf[1] < conf[0]) {
+		this->suspects[0] = 1;
+		this->suspects[1] = 0;
+	}
+	for (uint8_t i = 2; i < 9; i++) {
+		if (conf[i] < conf[this->suspects[0]]) {
+			this->suspects[1] = this->suspects[0];
+			this->suspects[0] = i;
+		} else if (conf[i] < conf[this->suspects[1]]) {
+			this->suspects[1] = i;
+		}
+	}
+}
+
+// Suspects returns the two bits of the last byte with the lowest
+// confidence, weakest first. 0-7 are the data bits, 8 is the parity bit.
+// Returns false if the parity of the last byte is valid.
+bool UART::Suspects(uint8_t *first, uint8_t *second) {
+	if (!this->parity_failed)
+		return false;
+	*first = this->suspects[0];
+	*second = this->suspects[1];
+	return true;
+}
+
+uint32_t UART::ExtractData(const uint8_t base, const uint8_t phase, const uint8_t bits,
+			   uint8_t *out, bool *err) {
 	uint32_t prob;
-	int16_t last_prob = this->reg.At(phase + 1 * UART_OVERSAMPLING_RATE);
+	int16_t last_prob = this->reg.At(base + phase + 1 * UART_OVERSAMPLING_RATE);
 
 	if (last_prob == 0) {
 		// Framing error
@@ -81,8 +174,8 @@ uint32_t UART::ExtractData(const uint8_t phase, uint8_t *out, bool *err) {
 	}
 	prob = abs(last_prob);
 
-	for (uint8_t b = 1; b < UART_BITS_NO_PARITY; b++) {
-		int16_t tmp_prob = this->reg.At(phase + (b + 1) * UART_OVERSAMPLING_RATE);
+	for (uint8_t b = 1; b < bits; b++) {
+		int16_t tmp_prob = this->reg.At(base + phase + (b + 1) * UART_OVERSAMPLING_RATE);
 		// Decode data
 		if (b >= 1 && b <= 8) {
 			if (tmp_prob == 0) {
@@ -110,13 +203,14 @@ uint32_t UART::ExtractData(const uint8_t phase, uint8_t *out, bool *err) {
 	return prob;
 }
 
-uint32_t UART::ExtractDataAndParity(const uint8_t phase, uint8_t *parity, uint8_t *out, bool *err) {
+uint32_t UART::ExtractDataAndParity(const uint8_t base, const uint8_t phase, const uint8_t bits,
+				   uint8_t *parity, uint8_t *out, bool *err) {
 	uint32_t prob;
 	int16_t last_prob;
 	
 	*parity = 0;
 
-	last_prob = this->reg.At(phase + 0 * UART_OVERSAMPLING_RATE);
+	last_prob = this->reg.At(base + phase + 0 * UART_OVERSAMPLING_RATE);
 	if (last_prob == 0) {
 		// Framing error
 		*err = true;
@@ -124,8 +218,8 @@ uint32_t UART::ExtractDataAndParity(const uint8_t phase, uint8_t *parity, uint8_
 	}
 	prob = abs(last_prob);
 
-	for (size_t b = 1; b < UART_BITS_PARITY; b++) {
-		int16_t tmp_prob = this->reg.At(phase + b * UART_OVERSAMPLING_RATE);
+	for (size_t b = 1; b < bits; b++) {
+		int16_t tmp_prob = this->reg.At(base + phase + b * UART_OVERSAMPLING_RATE);
 		// Decode data
 		if (b >= 1 && b <= 8) {
 			if (tmp_prob == 0) {
@@ -157,6 +251,50 @@ uint32_t UART::ExtractDataAndParity(const uint8_t phase, uint8_t *parity, uint8_
 	return prob;
 }
 
+// Phase returns the offset in samples of the start bit found in the last
+// received byte, relative to the sample the start bit was detected.
+uint8_t UART::Phase(void) {
+	return this->phase;
+}
+
+// SetEarly enables the low latency mode. The byte is returned as soon
+// as the last data or parity bit has been received. The stop bit is
+// checked later, a framing error is then signaled by Correction().
+void UART::SetEarly(bool early) {
+	this->early = early;
+}
+
+// Correction returns true once if the stop bit of the byte returned
+// last in low latency mode is invalid.
+bool UART::Correction(void) {
+	bool ret = this->correction;
+
+	this->correction = false;
+	return ret;
+}
+
+// StopPending returns true from returning a byte in low latency mode until
+// its stop bit has been checked.
+bool UART::StopPending(void) {
+	return this->early && (this->state == STOP ||
+		(this->state == DATA && this->counter <= UART_OVERSAMPLING_RATE));
+}
+
+// Delay returns the number of samples between the start bit being
+// detected and Update returning the byte.
+uint32_t UART::Delay(void) {
+	// The early decision is taken on the last sample before the stop bit.
+	// Without it the byte is decoded on the sample after the stop bit.
+	if (this->early)
+		return UART_BUFFER_LEN - UART_OVERSAMPLING_RATE - 1;
+	return UART_BUFFER_LEN;
+}
+
+// Bits returns the number of bits in a frame, including start and stop bit.
+inline uint8_t UART::Bits(void) {
+	return this->parity == PARITY_NONE ? UART_BITS_NO_PARITY : UART_BITS_PARITY;
+}
+
 void UART::PrintShiftreg(void) {
 	size_t len = UART_OVERSAMPLING_RATE * UART_BITS_NO_PARITY;
 
@@ -181,16 +319,15 @@ bool UART::Update(const int32_t symbol_prob, uint8_t *out, bool *err) {
 		}
 		break;
 	case WAIT_FOR_START:
+		// The shift register is filled completely after the start bit,
+		// no need to shift in samples of the idle line.
+		if (!this->ZeroLevelDetect(symbol_prob))
+			break;
 		// As ZeroLevelDetect returns true the phase must be close to beginning
 		// so it's safe to drop 1/2 Symbol (STOP symbol) here.
-		if (this->ZeroLevelDetect(symbol_prob)) {
-			this->state = DATA;
-			if (this->parity == PARITY_NONE)
-				this->counter = UART_OVERSAMPLING_RATE * UART_BITS_NO_PARITY;
-			else
-				this->counter = UART_OVERSAMPLING_RATE * UART_BITS_PARITY;
-			this->counter -= UART_OVERSAMPLING_RATE/2;
-		}
+		this->state = DATA;
+		this->counter = UART_OVERSAMPLING_RATE * this->Bits();
+		this->counter -= UART_OVERSAMPLING_RATE/2;
 		// fallthrough
 	case DATA:
 		this->reg.Update(symbol_prob, nullptr);
@@ -198,12 +335,26 @@ bool UART::Update(const int32_t symbol_prob, uint8_t *out, bool *err) {
 		this->counter--;
 		if (this->counter == 0) {
 			this->state = STOP;
+		} else if (this->early && this->counter == UART_OVERSAMPLING_RATE) {
+			// All samples of the last bit before the stop bit are in the
+			// shift register. The start bit is one symbol less shifted.
+			this->FindBestPhase(UART_OVERSAMPLING_RATE, this->Bits() - 1, out, err);
+			this->correction = false;
+			ret = true;
 		}
 
 		break;
 	case STOP:
-		this->FindBestPhase(out, err);
-		ret = true;
+		if (this->early) {
+			// Verify the stop bit of the byte already returned. Without
+			// parity the start bit is one bit time later in the register.
+			const uint32_t start = (UART_BITS_PARITY - this->Bits()) * UART_OVERSAMPLING_RATE;
+			if (this->reg.At(start + this->phase + (this->Bits() - 1) * UART_OVERSAMPLING_RATE) != 0)
+				this->correction = true;
+		} else {
+			this->FindBestPhase(0, this->Bits(), out, err);
+			ret = true;
+		}
 		this->state = WAIT_FOR_IDLE;
 	
 	break;
@@ -29,14 +29,44 @@ class UART
 	// Update returns true if new data has been placed in out.
 	bool Update(const int32_t symbol_prob, uint8_t *out, bool *err);
 
+	// Phase returns the offset in samples of the start bit found in the last
+	// received byte, relative to the sample the start bit was detected.
+	uint8_t Phase(void);
+
+	// SetEarly enables the low latency mode. The byte is returned as soon
+	// as the last data or parity bit has been received. The stop bit is
+	// checked later, a framing error is then signaled by Correction().
+	void SetEarly(bool early);
+
+	// Correction returns true once if the stop bit of the byte returned
+	// last in low latency mode is invalid.
+	bool Correction(void);
+
+	// StopPending returns true from returning a byte in low latency mode
+	// until its stop bit has been checked.
+	bool StopPending(void);
+
+	// Delay returns the number of samples between the start bit being
+	// detected and Update returning the byte.
+	uint32_t Delay(void);
+
+	// Suspects returns the two bits of the last byte with the lowest
+	// confidence, weakest first. 0-7 are the data bits, 8 is the parity bit.
+	// Returns false if the parity of the last byte is valid.
+	bool Suspects(uint8_t *first, uint8_t *second);
+
 	// Print contents of internal shiftreg
 	void PrintShiftreg(void);
 
 	private:
 		bool ZeroLevelDetect(const int16_t prob);
-		uint32_t ExtractDataAndParity(const uint8_t phase, uint8_t *parity, uint8_t *out, bool *err);
-		uint32_t ExtractData(const uint8_t phase, uint8_t *out, bool *err);
-		bool FindBestPhase(uint8_t *out, bool *err);
+		uint32_t ExtractDataAndParity(const uint8_t base, const uint8_t phase, const uint8_t bits,
+					      uint8_t *parity, uint8_t *out, bool *err);
+		uint32_t ExtractData(const uint8_t base, const uint8_t phase, const uint8_t bits,
+				     uint8_t *out, bool *err);
+		bool FindBestPhase(const uint8_t base, const uint8_t bits, uint8_t *out, bool *err);
+		void RankBits(const uint8_t base);
+		uint8_t Bits(void);
 
 		enum UART_STATE {
 			// Wait for the line to be idle
@@ -54,8 +84,18 @@ class UART
 		// Parity
 		enum UART_PARITY parity;
 		size_t counter;
+		// The phase of the last received byte
+		uint8_t phase;
 		// The internal state used to decode uart data
 		enum UART_STATE state;
+		// Low latency mode
+		bool early;
+		// Stop bit of the last byte returned in low latency mode is invalid
+		bool correction;
+		// The parity of the last byte is invalid
+		bool parity_failed;
+		// Bits of the last byte with the lowest confidence
+		uint8_t suspects[2];
 
 		// Data storage for propability
 		ShiftReg<int16_t, UART_BUFFER_LEN> reg;
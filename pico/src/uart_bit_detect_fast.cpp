@@ -10,7 +10,7 @@ UARTBit<T, N>::UARTBit(T buffer[N * 2],
 		       const uint32_t high_level,
 		       const uint32_t low_level,
 		       const uint8_t error_rate) :
-	data(buffer), data_abs(buffer_abs), receiver_level(0), off(0) {
+	data(buffer), data_abs(buffer_abs), sum_abs(0), receiver_level(0), off(0) {
 	memset(data, 0, sizeof(T) * N * 2);
 	memset(data_abs, 0, sizeof(T) * N * 2);
 
@@ -35,6 +35,13 @@ void UARTBit<T, N>::Update(const T in, T *probability) {
 
 	this->ShiftIn(in);
 
+	// The pulse energy can't exceed the window energy. Most of the time
+	// the line is idle, skip the detection.
+	if (this->Idle()) {
+		*probability = 0;
+		return;
+	}
+
 	// Get pointers to memory with length N
 	// The first element is the oldest and the last is the newest
 	const T *const ptr = &this->data[this->off];
@@ -66,6 +73,12 @@ uint32_t UARTBit<T, N>::Length(void) {
 	return N;
 }
 
+// Idle returns true if the energy in the window is too low for a pulse.
+template <class T, size_t N>
+bool UARTBit<T, N>::Idle(void) {
+	return this->sum_abs < this->receiver_level;
+}
+
 template <class T, size_t N>
 inline void UARTBit<T, N>::ShiftIn(const T in) {
 	const T in_abs = abs(in);
@@ -81,6 +94,8 @@ inline void UARTBit<T, N>::ShiftIn(const T in) {
 
 	// Place two times in buffer to make sure reading never wraps
 	ptr = &this->data_abs[this->off];
+	// Replace the oldest value in the running sum
+	this->sum_abs += in_abs - *ptr;
 	// Pointer magic generates smaller program size
 	*ptr = in_abs;
 	ptr += N;
@@ -19,12 +19,18 @@ class UARTBit
     // Returns the length of the shift register used.
     uint32_t Length(void);
 
+    // Idle returns true if the energy in the window is too low for a pulse.
+    // Update skips the detection and returns 0 then.
+    bool Idle(void);
+
   private:
     // Shifts in new data.
     inline void ShiftIn(const T in);
 
     T *data;
     T *data_abs;
+    // Sum of data_abs over the window
+    int32_t sum_abs;
     int32_t receiver_level;
     uint32_t off;
 };
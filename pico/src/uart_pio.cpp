@@ -2,15 +2,17 @@
 #include "uart_pio.hpp"
 #include "p1p2_uart_tx.pio.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
 
 #include <iostream>
 
 // Initialize PIO0 SM0 to generate the P1P2 bus encoded serial UART.
 // The serial runs at 9600 baud, parity even, 1 stop bit.
-UARTPio::UARTPio() : pio(pio0), sm(0), channel(0), Data{}
+UARTPio::UARTPio() : error(false), pio(pio0), sm(0), offset(0), channel(0),
+	queue(TX_PACKET_GAP_US), alarm(0)
 {
-	uint offset = pio_add_program(this->pio, &p1p2_uart_tx_program);
-	p1p2_uart_tx_program_init(this->pio, this->sm, offset, UARTPio::PIN_UP, 9600);
+	this->offset = pio_add_program(this->pio, &p1p2_uart_tx_program);
+	p1p2_uart_tx_program_init(this->pio, this->sm, this->offset, UARTPio::PIN_UP, 9600);
 
 	// Get a free channel, panic() if there are none
 	this->channel = dma_claim_unused_channel(true);
@@ -29,7 +31,7 @@ UARTPio::UARTPio() : pio(pio0), sm(0), channel(0), Data{}
 
 	dma_channel_configure(this->channel, &c,
 		p1p2_uart_tx_reg(this->pio, this->sm) ,    // dst
-		this->Data,                                // src
+		nullptr,                                   // src
 		0,                                         // transfer count
 		false                                      // start immediately
 	);
@@ -45,43 +47,117 @@ void UARTPio::EnableShutdown(bool state) {
 	gpio_put(UARTPio::PIN_SHUTDOWN, state);
 }
 
-// Transmitting returns true as long as data is being transmitted or the TX FIFO is not empty
-bool UARTPio::Transmitting(void) {
+static int64_t on_alarm(alarm_id_t id, void *user_data) {
+	UARTPio *u = (UARTPio *)user_data;
+	u->Schedule();
+	return 0;
+}
+
+// Returns true while the PIO or DMA is transmitting
+bool UARTPio::Busy(void) {
 	return pio_interrupt_get(pio, sm) ||
 		!pio_sm_is_tx_fifo_empty(this->pio, this->sm) ||
-		this->DataWaiting();
+		dma_channel_is_busy(this->channel);
+}
+
+// Transmitting returns true as long as data is being transmitted or packets are queued
+bool UARTPio::Transmitting(void) {
+	return this->Busy() || this->DataWaiting();
 }
 
-// ClearFifo discards all data stored in the TX FIFO
+// ClearFifo discards all data stored in the TX FIFO and the queue
 void UARTPio::ClearFifo(void) {
+	uint32_t save = save_and_disable_interrupts();
+
+	if (this->alarm > 0) {
+		cancel_alarm(this->alarm);
+		this->alarm = 0;
+	}
 	dma_channel_abort(this->channel);
 	pio_sm_clear_fifos(this->pio, this->sm);
+	this->queue.Abort();
+	restore_interrupts(save);
+}
+
+// Abort stops the transmission in the middle of a byte.
+// Only touches the hardware, the queue notices the end of the packet
+// on the next alarm. Can be called from core1.
+void UARTPio::Abort(void) {
+	dma_channel_abort(this->channel);
+	pio_sm_clear_fifos(this->pio, this->sm);
+	// Jump to the start of the program and drive the idle level
+	pio_sm_exec(this->pio, this->sm,
+		pio_encode_jmp(this->offset + p1p2_uart_tx_offset_start) |
+		pio_encode_sideset(2, UARTPio::LEVEL_IDLE));
+}
+
+// Schedule starts the next packet when the previous one and the gap have
+// passed. Rearms the alarm to check again.
+// Must be called with interrupts disabled or from the alarm IRQ.
+void UARTPio::Schedule(void) {
+	const Message *m;
+	uint32_t next;
+
+	if (this->alarm > 0) {
+		cancel_alarm(this->alarm);
+		this->alarm = 0;
+	}
+
+	m = this->queue.Update(time_us_32(), this->Busy(), &next);
+	if (m) {
+		// The queue entry stays valid until the packet is done
+		dma_channel_set_read_addr(this->channel, m->Data, false);
+		dma_channel_set_trans_count(this->channel, m->Length, true);
+	}
+	if (next) {
+		int32_t us = next - time_us_32();
+		// Returns 0 if the callback already ran
+		alarm_id_t id = add_alarm_in_us(us > 0 ? us : 1, on_alarm, this, true);
+		if (id > 0)
+			this->alarm = id;
+	}
 }
 
 // Transmit the message on the bus.
 // Does not check for bus being idle or bus collisions!
 void UARTPio::Send(const Message& m) {
-	if (dma_channel_is_busy(this->channel)) {
-		this->error = true;
-		return;
-	}
-	if (m.Length > sizeof(this->Data)) {
+	this->Send(m, nullptr, nullptr);
+}
+
+// Queue the message for transmission. The packets are transmitted with
+// a gap of at least TX_PACKET_GAP_US between them.
+// cb is called from IRQ context when the packet starts and ends.
+// Does not check for bus being idle or bus collisions!
+bool UARTPio::Send(const Message& m, UARTPio::Queue::Callback cb, void *ctx) {
+	uint32_t save;
+	bool ok;
+
+	if (m.Length > MAX_PACKET_SIZE) {
 		this->error = true;
-		return;
-	}
-	for (int i = 0; i < m.Length; i++) {
-		this->Data[i] = m.Data[i];
+		return false;
 	}
 
-	dma_channel_set_read_addr(this->channel, this->Data, false);
-	dma_channel_set_trans_count(this->channel, m.Length, false);
+	save = save_and_disable_interrupts();
+	ok = this->queue.Push(m, cb, ctx);
+	if (ok)
+		this->Schedule();
+	restore_interrupts(save);
 
-	dma_start_channel_mask(1 << this->channel);
+	if (!ok)
+		this->error = true;
+	return ok;
 }
 
-// Returns true if the FIFO has data
+// SetGap sets the minimum idle time between queued packets
+void UARTPio::SetGap(uint32_t us) {
+	uint32_t save = save_and_disable_interrupts();
+	this->queue.SetGap(us);
+	restore_interrupts(save);
+}
+
+// Returns true if packets are queued or being transmitted
 bool UARTPio::DataWaiting(void) {
-	return dma_channel_is_busy(this->channel);
+	return !this->queue.Empty() || dma_channel_is_busy(this->channel);
 }
 
 // Returns true if a buffer overrun was detected
@@ -89,4 +165,4 @@ bool UARTPio::Error(void) {
 	bool tmp = this->error;
 	this->error = false;
 	return tmp;
-}
\ No newline at end of file
+}
@@ -1,17 +1,22 @@
 #pragma once
 #include "fifo_irqsafe.hpp"
 #include "message.hpp"
+#include "tx_queue.hpp"
+#include "defines.hpp"
 
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 
+#define UART_PIO_QUEUE_LEN 4
+
 // High level abstraction of P1P2 UART transmit functions
 class UARTPio
 {
 	public:
+	// The packet queue doesn't fit into scratch memory
 	static UARTPio& getInstance(void)
 	{
-		__scratch_y("UARTPioInstance") static UARTPio instance;
+		static UARTPio instance;
 		return instance;
 	}
 
@@ -20,24 +25,40 @@ class UARTPio
 
 	UARTPio(void);
 
+	typedef TxQueue<UART_PIO_QUEUE_LEN> Queue;
+
 	bool Transmitting(void);
 	void Send(const Message& m);
+	bool Send(const Message& m, Queue::Callback cb, void *ctx);
+	void SetGap(uint32_t us);
 	bool DataWaiting(void);
 	void EnableShutdown(bool state);
 	void ClearFifo(void);
 	bool Error(void);
+	// Stops the transmission immediately. Can be called from core1.
+	void Abort(void);
+
+	// Called from the alarm IRQ
+	void Schedule(void);
 
 	private:
+	bool Busy(void);
+
 	bool error;
 	PIO pio;
 	uint sm;
+	// Offset of the PIO program
+	uint offset;
 	// DMA channels
 	int channel;
+	Queue queue;
+	alarm_id_t alarm;
 
 	// Pin2 and Pin3 are used for P1P2 transmission
 	// Pin20 sets the transmitting into shutdown mode
 	static const uint PIN_UP = 2;
 	static const uint PIN_DOWN = 3;
 	static const uint PIN_SHUTDOWN = 20;
-	uint8_t Data[32];
+	// Side set value of LEVEL_IDLE in p1p2_uart_tx.pio
+	static const uint LEVEL_IDLE = 1;
 };
@@ -1,5 +1,8 @@
 #pragma once
 #include "message.hpp"
+#include "tx_queue.hpp"
+
+#define UART_PIO_QUEUE_LEN 4
 
 // High level abstraction of P1P2 UART transmit functions
 class UARTPio
@@ -8,17 +11,26 @@ class UARTPio
 	UARTPio(UARTPio const&) = delete;
 	void operator=(UARTPio const&) = delete;
 
-	UARTPio(void) : error(false) {}
+	UARTPio(void) : error(false), shutdown(true), sent(0) {}
+
+	typedef TxQueue<UART_PIO_QUEUE_LEN> Queue;
 
 	bool Transmitting(void) {return false;}
-	void Send(const Message& m) {}
+	void Send(const Message& m) {this->sent++;}
+	bool Send(const Message& m, Queue::Callback cb, void *ctx) {this->sent++; return true;}
+	void SetGap(uint32_t us) {}
 	bool DataWaiting(void) {return false;}
-	void EnableShutdown(bool state) {}
+	void EnableShutdown(bool state) {this->shutdown = state;}
 	void ClearFifo(void) {}
+	void Abort(void) {}
 	bool Error(void) {return this->error;}
 
 	void MokSetError(bool err) {this->error = err;}
+	bool MokShutdown(void) {return this->shutdown;}
+	size_t MokSent(void) {return this->sent;}
 
 	private:
 		bool error;
+		bool shutdown;
+		size_t sent;
 };
@@ -0,0 +1,266 @@
+#include <gtest/gtest.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "bandpass.hpp"
+#include "dcblock.hpp"
+#include "fir_filter.hpp"
+#include "level_detect.hpp"
+#include "resample.hpp"
+#include "uart.hpp"
+#include "uart_bit_detect_fast.hpp"
+#include "waveform.hpp"
+
+#define DECIMATION (FIR_OVERSAMPLING_RATE / UART_OVERSAMPLING_RATE)
+// Idle samples at FIR_OVERSAMPLING_RATE before the first byte
+#define LEAD (40 * FIR_OVERSAMPLING_RATE)
+
+typedef BandPassDecimator<RX_FILTER_TAPS, DECIMATION, RX_FILTER_LOW_HZ, RX_FILTER_HIGH_HZ,
+	FIR_OVERSAMPLING_RATE * UART_BAUD_RATE, RX_FILTER_WINDOW> RxFilter;
+
+// The receive chain before the band pass filter. The 7 tap sinc filter
+// is close to the hand written coefficients it used.
+struct Legacy {
+	int32_t buf[7 * 2];
+	FIRFilter<7, 66000, FIR_OVERSAMPLING_RATE * UART_BAUD_RATE, FIRDesign::RECTANGULAR> filter;
+	Resample<int32_t> resampler;
+	DCblock dcblock;
+
+	Legacy() : buf{}, filter(buf), resampler(DECIMATION - 1) {}
+
+	bool Update(const int32_t in, int32_t *out) {
+		int32_t fir, resamp;
+
+		this->filter.Update(in, &fir);
+		if (!this->resampler.Update(fir, &resamp))
+			return false;
+		return this->dcblock.Update(resamp, out);
+	}
+};
+
+struct BandPass {
+	int32_t buf[RX_FILTER_TAPS * 2];
+	RxFilter filter;
+
+	BandPass() : buf{}, filter(buf) {}
+
+	bool Update(const int32_t in, int32_t *out) {
+		return this->filter.Update(in, out);
+	}
+};
+
+// Returns the P1P2 waveform of the bytes at FIR_OVERSAMPLING_RATE
+static std::vector<int32_t> genSignal(const std::vector<uint8_t>& data, int32_t offset)
+{
+	std::vector<int32_t> p(LEAD, offset);
+
+	genBytes(p, data.data(), data.size(), FIR_OVERSAMPLING_RATE, 3000, offset);
+	p.insert(p.end(), LEAD, offset);
+	return p;
+}
+
+// Runs the signal through the filter, Level, UARTBit and UART.
+// Returns true if exactly the byte data has been decoded.
+template <class F>
+static bool decode(const std::vector<int32_t>& p, const uint8_t data)
+{
+	int32_t buf1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf2[UART_OVERSAMPLING_RATE * 2];
+	int16_t buf[UART_BUFFER_LEN * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> bit(buf1, buf2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+	UART uart(buf, UART::PARITY_EVEN);
+	Level<int32_t> level;
+	F f;
+	size_t n = 0;
+	bool ok = false;
+
+	for (int32_t in : p) {
+		int32_t ac, hysteresis, prob;
+		uint8_t out;
+		bool err;
+
+		if (!f.Update(in, &ac))
+			continue;
+		level.Update(ac, &hysteresis);
+		bit.Update(hysteresis, &prob);
+		if (!uart.Update(prob, &out, &err))
+			continue;
+		ok = !err && out == data;
+		n++;
+	}
+	return n == 1 && ok;
+}
+
+// Returns the filter delay in input samples of a single P1P2 pulse
+template <class F>
+static double groupDelay(void)
+{
+	const size_t start = 64, width = FIR_OVERSAMPLING_RATE / 2;
+	double sum = 0, weighted = 0;
+	F f;
+
+	for (size_t i = 0; i < 256; i++) {
+		int32_t out;
+
+		if (!f.Update(i >= start && i < start + width ? 3000 : 0, &out))
+			continue;
+		// Centroid of the positive pulse
+		if (out > 0) {
+			sum += out;
+			weighted += (double)out * i;
+		}
+	}
+	return weighted / sum - (start + (width - 1) / 2.0);
+}
+
+// Returns the time per input sample in ns
+template <class F>
+static double cpuTime(const std::vector<int32_t>& p)
+{
+	double best = 1e9;
+	int32_t sink = 0;
+
+	for (int run = 0; run < 5; run++) {
+		F f;
+		auto t0 = std::chrono::steady_clock::now();
+		for (int32_t in : p) {
+			int32_t out;
+			if (f.Update(in, &out))
+				sink += out;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / p.size());
+	}
+	EXPECT_NE(sink, 1);
+	return best;
+}
+
+TEST(BandPass, Taps)
+{
+	int32_t sum = 0;
+
+	for (size_t i = 0; i < RX_FILTER_TAPS; i++) {
+		sum += RxFilter::TAPS[i];
+		EXPECT_EQ(RxFilter::TAPS[i], RxFilter::TAPS[RX_FILTER_TAPS - 1 - i]);
+	}
+	EXPECT_EQ(sum, 1 << 15);
+	// Same pole as the DCblock
+	EXPECT_EQ(RxFilter::POLE, (int32_t)(0.995 * 256));
+}
+
+TEST(BandPass, DCOffset)
+{
+	BandPass f;
+	int32_t out = 0;
+	size_t settled = 0;
+
+	for (size_t i = 0; i < 4096; i++) {
+		if (!f.Update(1000, &out))
+			continue;
+		if (settled == 0 && abs(out) < 10)
+			settled = i;
+	}
+	std::cerr << "[          ] DC offset removed after " << settled << " ADC samples" << std::endl;
+	EXPECT_LT(abs(out), 2);
+	EXPECT_GT(settled, 0);
+	EXPECT_LT(settled, 2048);
+}
+
+TEST(BandPass, Response)
+{
+	const int steps[] = {1, 16, 32, 64, 92, 127};
+
+	for (int freq : steps) {
+		int32_t in[1024];
+		double rms_in = 0, rms_out = 0;
+		size_t n_in = 0, n_out = 0;
+		BandPass f;
+
+		for (size_t j = 0; j < 1024; j++)
+			in[j] = sin((double)j * 2 * M_PI / 256 * freq) * 1000;
+		for (size_t j = 0; j < 1024; j++) {
+			int32_t out;
+			const bool valid = f.Update(in[j], &out);
+			// Skip the settling of the DC block
+			if (j < 512)
+				continue;
+			rms_in += (double)in[j] * in[j];
+			n_in++;
+			if (!valid)
+				continue;
+			rms_out += (double)out * out;
+			n_out++;
+		}
+		EXPECT_EQ(n_out, n_in / DECIMATION);
+		const double gain = sqrt(rms_out / n_out / (rms_in / n_in));
+		std::cerr << "[          ] " << freq * FIR_OVERSAMPLING_RATE * UART_BAUD_RATE / 256 <<
+			" Hz: gain " << gain << std::endl;
+
+		switch (freq) {
+			case 1: EXPECT_GT(gain, 0.95); break;
+			case 16: EXPECT_GT(gain, 0.95); break;
+			case 32: EXPECT_GT(gain, 0.85); break;
+			case 64: EXPECT_LT(gain, 0.5); break;
+			case 92: EXPECT_LT(gain, 0.15); break;
+			case 127: EXPECT_LT(gain, 0.15); break;
+		}
+	}
+}
+
+// Compares the band pass decimator with the FIRFilter, Resample and DCblock chain
+TEST(BandPass, Benchmark)
+{
+	std::mt19937 rng(1);
+	const size_t bytes = 200;
+	std::vector<uint8_t> data(bytes);
+	double margin_legacy = 0, margin_bandpass = 0;
+	size_t errors_legacy = 0, errors_bandpass = 0;
+
+	for (auto& d : data)
+		d = rng();
+
+	// CPU time
+	const std::vector<int32_t> clean = genSignal(data, 0);
+	const double ns_legacy = cpuTime<Legacy>(clean);
+	const double ns_bandpass = cpuTime<BandPass>(clean);
+	std::cerr << "[          ] CPU: FIR+Resample+DCblock " << ns_legacy << " ns, band pass " <<
+		ns_bandpass << " ns per ADC sample" << std::endl;
+
+	// Group delay
+	const double delay_legacy = groupDelay<Legacy>();
+	const double delay_bandpass = groupDelay<BandPass>();
+	std::cerr << "[          ] group delay: FIR+Resample+DCblock " << delay_legacy <<
+		", band pass " << delay_bandpass << " ADC samples" << std::endl;
+	EXPECT_NEAR(delay_bandpass, RxFilter::DELAY, 0.5);
+	// Longer filters add delay
+	EXPECT_NEAR(delay_bandpass - delay_legacy, (RX_FILTER_TAPS - 7) / 2, 0.5);
+
+	// Decode margin with a DC offset and noise at the ADC. Every byte is
+	// decoded by a fresh receiver so that errors don't add up.
+	for (double sigma = 400; sigma <= 1400; sigma += 200) {
+		std::normal_distribution<double> noise(0, sigma);
+		size_t e_legacy = 0, e_bandpass = 0;
+
+		for (uint8_t d : data) {
+			std::vector<int32_t> p = genSignal({d}, 400);
+			for (auto& s : p)
+				s += noise(rng);
+			e_legacy += !decode<Legacy>(p, d);
+			e_bandpass += !decode<BandPass>(p, d);
+		}
+		std::cerr << "[          ] noise " << sigma << " mV: byte errors FIR+Resample+DCblock " <<
+			e_legacy << ", band pass " << e_bandpass << " of " << bytes << std::endl;
+		if (e_legacy == 0)
+			margin_legacy = sigma;
+		if (e_bandpass == 0)
+			margin_bandpass = sigma;
+		errors_legacy += e_legacy;
+		errors_bandpass += e_bandpass;
+	}
+	std::cerr << "[          ] error free up to: FIR+Resample+DCblock " << margin_legacy <<
+		" mV, band pass " << margin_bandpass << " mV" << std::endl;
+	EXPECT_GE(margin_bandpass, margin_legacy);
+	EXPECT_LE(errors_bandpass, errors_legacy + errors_legacy / 10 + 5);
+}
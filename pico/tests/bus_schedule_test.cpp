@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <random>
+
+#include "bus_schedule.hpp"
+#include "uart.hpp"
+
+// Returns the time of length bytes on the bus in micro seconds
+static uint32_t us(size_t length)
+{
+	return length * UART_BITS_PARITY * 1000000 / UART_BAUD_RATE;
+}
+
+// Returns a packet with the header src, dst, type of length bytes starting
+// at start
+static Message frame(uint8_t src, uint8_t dst, uint8_t type, uint32_t start, uint8_t length = 22)
+{
+	Message m;
+
+	m.Data[0] = src;
+	m.Data[1] = dst;
+	m.Data[2] = type;
+	m.Length = length;
+	m.Timestamp = start;
+	m.Duration = us(length);
+	return m;
+}
+
+TEST(BusSchedule, Learn)
+{
+	BusSchedule s;
+	uint32_t t = 1000, at;
+
+	// The main controller waits 150 msec for the answer to 35h
+	for (int i = 0; i < 4; i++) {
+		EXPECT_EQ(s.Next(&at), i >= 3);
+		s.Frame(frame(0x00, 0xf1, 0x35, t));
+		t += us(22);
+		ASSERT_EQ(s.Next(&at), i >= 2);
+		if (i >= 2) {
+			EXPECT_EQ(at, t + 150000);
+		}
+		t += 150000;
+	}
+	EXPECT_EQ(s.Learned(), 1);
+
+	// The shortest gap wins
+	s.Frame(frame(0x00, 0xf1, 0x35, t));
+	t += us(22) + 140000;
+	s.Frame(frame(0x00, 0xf1, 0x35, t));
+	t += us(22) + 200000;
+	s.Frame(frame(0x00, 0xf1, 0x35, t));
+	t += us(22);
+	ASSERT_EQ(s.Next(&at), true);
+	EXPECT_EQ(at, t + 140000);
+}
+
+// The gap after the same request to another address is used
+TEST(BusSchedule, Fallback)
+{
+	BusSchedule s;
+	uint32_t t = 0, at;
+
+	for (int i = 0; i < 3; i++) {
+		s.Frame(frame(0x00, 0xf1, 0x35, t));
+		t += us(22) + 150000;
+	}
+	s.Frame(frame(0x00, 0xf0, 0x35, t));
+	ASSERT_EQ(s.Next(&at), true);
+	EXPECT_EQ(at, t + us(22) + 150000);
+
+	// Not for another type or source
+	s.Frame(frame(0x00, 0xf0, 0x36, t + 200000));
+	EXPECT_EQ(s.Next(&at), false);
+	s.Frame(frame(0x40, 0xf0, 0x35, t + 400000));
+	EXPECT_EQ(s.Next(&at), false);
+}
+
+// Packets with errors are neither learned nor used for a prediction
+TEST(BusSchedule, Errors)
+{
+	BusSchedule s;
+	uint32_t t = 0, at;
+
+	for (int i = 0; i < 3; i++) {
+		Message m = frame(0x00, 0xf1, 0x35, t);
+		m.Status = Message::STATUS_ERR_PARITY;
+		s.Frame(m);
+		t += us(22) + 150000;
+	}
+	EXPECT_EQ(s.Learned(), 0);
+
+	for (int i = 0; i < 3; i++) {
+		s.Frame(frame(0x00, 0xf1, 0x35, t));
+		t += us(22) + 150000;
+	}
+	Message m = frame(0x40, 0xf1, 0x35, t);
+	m.Status = Message::STATUS_ERR_BUS_COLLISION;
+	s.Frame(m);
+	EXPECT_EQ(s.Next(&at), false);
+	EXPECT_EQ(s.Fits(t, 32), true);
+}
+
+TEST(BusSchedule, Fits)
+{
+	BusSchedule s;
+	uint32_t t = 0;
+
+	for (int i = 0; i < 3; i++) {
+		s.Frame(frame(0x00, 0xf1, 0x35, t));
+		t += us(22) + 150000;
+	}
+	s.Frame(frame(0x00, 0xf0, 0x35, t));
+	t += us(22);
+
+	const uint32_t last = t + 150000 - us(22) - BUS_SCHEDULE_MARGIN_US;
+	EXPECT_EQ(s.Fits(t, 22), true);
+	EXPECT_EQ(s.Fits(last, 22), true);
+	EXPECT_EQ(s.Fits(last + 1, 22), false);
+	EXPECT_EQ(s.Fits(t + 150000 - us(23) - BUS_SCHEDULE_MARGIN_US, 23), true);
+	EXPECT_EQ(s.Fits(t + 150000 - us(23) - BUS_SCHEDULE_MARGIN_US + 1, 23), false);
+	EXPECT_EQ(s.Fits(last + 1, 21), true);
+
+	// Wraps with the micro second timer
+	BusSchedule w;
+	t = 0xffffffff - 200000;
+	for (int i = 0; i < 3; i++) {
+		w.Frame(frame(0x00, 0xf1, 0x35, t));
+		t += us(22) + 150000;
+	}
+	w.Frame(frame(0x00, 0xf0, 0x35, t));
+	t += us(22);
+	EXPECT_EQ(w.Fits(t + 100000, 22), true);
+	EXPECT_EQ(w.Fits(t + 140000, 22), false);
+}
+
+// Simulates the 35h requests of the main controller to 0xF0 and 0xF1. Only
+// 0xF0 is answered, after a random delay as i.e. while the line driver
+// powers on. The main controller sends the next request 25 msec after the
+// answer or 150 msec after the request if there's none, without checking
+// the bus. Returns the collisions in cycles.
+static size_t simulate(bool gated, size_t cycles, size_t *skipped)
+{
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<uint32_t> delay(5000, 150000);
+	BusSchedule s;
+	uint32_t t = 0;
+	size_t collisions = 0;
+
+	*skipped = 0;
+	for (size_t i = 0; i < cycles; i++) {
+		for (uint8_t dst = 0xf0; dst <= 0xf1; dst++) {
+			s.Frame(frame(0x00, dst, 0x35, t));
+			const uint32_t end = t + us(22);
+			const uint32_t deadline = end + 150000;
+			t = deadline;
+			if (dst != 0xf0)
+				continue;
+
+			const uint32_t start = end + delay(rng);
+			if (gated && !s.Fits(start, 22)) {
+				(*skipped)++;
+				continue;
+			}
+			if (start + us(22) > deadline) {
+				// Garbled by the next request
+				Message m = frame(0x40, dst, 0x35, start);
+				m.Status = Message::STATUS_ERR_BUS_COLLISION;
+				s.Frame(m);
+				collisions++;
+				continue;
+			}
+			s.Frame(frame(0x40, dst, 0x35, start));
+			t = start + us(22) + 25000;
+		}
+	}
+	return collisions;
+}
+
+TEST(BusSchedule, Collisions)
+{
+	const size_t cycles = 1000;
+	size_t skipped_free, skipped_gated;
+	const size_t free = simulate(false, cycles, &skipped_free);
+	const size_t gated = simulate(true, cycles, &skipped_gated);
+
+	std::cerr << "[          ] " << cycles << " answers: " << free << " collisions without schedule, " <<
+		gated << " with schedule, " << skipped_gated << " skipped" << std::endl;
+	EXPECT_EQ(skipped_free, 0);
+	EXPECT_GT(free, cycles / 10);
+	// Only before the timeout has been learned
+	EXPECT_LE(gated, 2);
+	// Mostly the answers that would have collided are skipped, the others
+	// end within the margin
+	EXPECT_LT(skipped_gated, free + cycles / 50);
+}
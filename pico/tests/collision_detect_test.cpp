@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "collision_detect.hpp"
+#include "uart_bit_detect_fast.hpp"
+#include "waveform.hpp"
+
+#define OVERSAMPLING 16
+// Idle samples before the packet
+#define LEAD OVERSAMPLING
+
+// Generates the P1P2 waveform of the packet as transmitted by the PIO
+static std::vector<int16_t> genPacket(const uint8_t *data, size_t len)
+{
+	std::vector<int16_t> p(LEAD, 0);
+
+	for (size_t n = 0; n < len; n++) {
+		int polarity = 1;
+		genByte(p, data[n], OVERSAMPLING, 3300, &polarity);
+	}
+	p.insert(p.end(), 4 * OVERSAMPLING, 0);
+	return p;
+}
+
+// Adds a pulse of another device at bit position pos
+static void injectPulse(std::vector<int16_t>& p, size_t pos, int polarity)
+{
+	for (size_t i = 0; i < OVERSAMPLING / 2; i++)
+		p[LEAD + pos * OVERSAMPLING + i] += 3300 * polarity;
+}
+
+// Runs the waveform through UARTBit and CollisionDetect.
+// Returns the sample index the collision was detected or -1.
+static ssize_t run(const std::vector<int16_t>& p, const uint8_t *data, size_t len,
+		   CollisionDetect& c)
+{
+	int32_t buf1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf2[UART_OVERSAMPLING_RATE * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> b(buf1, buf2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+	int32_t signal;
+
+	c.Arm(data, len);
+	for (size_t i = 0; i < p.size(); i++) {
+		b.Update(p[i], &signal);
+		if (c.Update(signal))
+			return i;
+	}
+	return -1;
+}
+
+TEST(CollisionDetect, NoCollision)
+{
+	CollisionDetect c;
+
+	for (uint16_t v = 0; v <= 0xff; v++) {
+		uint8_t data[3] = {(uint8_t)v, (uint8_t)~v, 0x00};
+		std::vector<int16_t> p = genPacket(data, sizeof(data));
+
+		EXPECT_EQ(run(p, data, sizeof(data), c), -1) << "v = " << v;
+		EXPECT_EQ(c.Armed(), false);
+	}
+
+	uint8_t packet[] = {0x00, 0x00, 0x10, 0x01, 0x81, 0x01, 0x00, 0x00, 0x00, 0x00, 0x15,
+		0x00, 0x40, 0x00, 0x00, 0x08, 0x00, 0x00, 0x18, 0x00, 0x40, 0x30, 0x00, 0x6d};
+	std::vector<int16_t> p = genPacket(packet, sizeof(packet));
+	EXPECT_EQ(run(p, packet, sizeof(packet), c), -1);
+}
+
+// Another device sends a pulse where a '1' is transmitted
+TEST(CollisionDetect, ExtraPulse)
+{
+	uint8_t data[] = {0x40, 0xf0, 0x30, 0xff};
+	CollisionDetect c;
+
+	for (size_t pos = 1; pos < sizeof(data) * 11; pos++) {
+		std::vector<int16_t> p = genPacket(data, sizeof(data));
+		const size_t byte = pos / 11;
+		const size_t b = pos % 11;
+		bool one;
+
+		if (b == 0)
+			continue;
+		else if (b <= 8)
+			one = data[byte] & (1 << (b - 1));
+		else if (b == 9)
+			one = __builtin_popcount(data[byte]) & 1;
+		else
+			one = true;
+		if (!one)
+			continue;
+
+		injectPulse(p, pos, 1);
+		ssize_t i = run(p, data, sizeof(data), c);
+		ASSERT_GE(i, 0) << "pos = " << pos;
+		EXPECT_EQ(c.Bit(), pos);
+
+		// Detected within two bit times after the bit started
+		ssize_t latency = i - (LEAD + pos * OVERSAMPLING);
+		EXPECT_LE(latency, 2 * OVERSAMPLING) << "pos = " << pos;
+	}
+}
+
+// The pulse of another device cancels out or inverts a transmitted pulse
+TEST(CollisionDetect, WrongPolarity)
+{
+	uint8_t data[] = {0x00, 0x10, 0x01};
+	std::vector<int16_t> clean = genPacket(data, sizeof(data));
+	CollisionDetect c;
+
+	for (size_t pos = 1; pos < sizeof(data) * 11; pos++) {
+		const size_t off = LEAD + pos * OVERSAMPLING;
+		if (clean[off] == 0)
+			continue;
+
+		// Inverted
+		std::vector<int16_t> p = clean;
+		for (size_t i = 0; i < OVERSAMPLING / 2; i++)
+			p[off + i] = -p[off + i];
+		ssize_t i = run(p, data, sizeof(data), c);
+		ASSERT_GE(i, 0) << "pos = " << pos;
+		EXPECT_EQ(c.Bit(), pos);
+		EXPECT_LE(i - (ssize_t)off, 2 * OVERSAMPLING);
+
+		// Cancelled
+		p = clean;
+		for (size_t i = 0; i < OVERSAMPLING / 2; i++)
+			p[off + i] = 0;
+		i = run(p, data, sizeof(data), c);
+		ASSERT_GE(i, 0) << "pos = " << pos;
+		// Missing start bit is detected at the end of the search window
+		EXPECT_EQ(c.Bit(), pos);
+	}
+}
+
+TEST(CollisionDetect, Timeout)
+{
+	uint8_t data[] = {0x00};
+	std::vector<int16_t> p(COLLISION_START_TIMEOUT + OVERSAMPLING, 0);
+	CollisionDetect c;
+
+	EXPECT_EQ(run(p, data, sizeof(data), c), -1);
+	EXPECT_EQ(c.Armed(), false);
+
+	c.Arm(data, 0);
+	EXPECT_EQ(c.Armed(), false);
+}
+
+// Short spikes must not be reported as collision
+TEST(CollisionDetect, Spike)
+{
+	uint8_t data[] = {0xcc, 0x33};
+	std::vector<int16_t> clean = genPacket(data, sizeof(data));
+	CollisionDetect c;
+
+	for (size_t noise = LEAD; noise < clean.size() - 1; noise++) {
+		std::vector<int16_t> p = clean;
+
+		p[noise] += 2500;
+		p[noise + 1] -= 2500;
+		EXPECT_EQ(run(p, data, sizeof(data), c), -1) << "noise = " << noise;
+	}
+}
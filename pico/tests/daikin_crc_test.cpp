@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "daikin_crc.hpp"
+#include "message.hpp"
+
+// Packets captured from the bus
+static const char *captured[] = {
+	"00001001810100000000150040000008000018004030006d",
+	"400010018021013000180015005a00000000000040000073",
+	"0000111098000000000000cf",
+	"00f0300100000002010000000000000000ec",
+	"40f03000000000010000010000000000007a",
+	"00f035240000250000260000270001280000290000ee",
+	"00f03614005e01ffffffffffffffffffffffffffffffffd8",
+};
+
+// The bitwise loop of the external controller emulation
+static uint8_t crcBitwise(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0;
+	for (size_t j = 0; j < len; j++) {
+		uint32_t c = data[j];
+		for (size_t i = 0; i < 8; i++) {
+			if ((crc ^ c) & 0x01) {
+				crc = (crc >> 1) ^ 0xd9;
+			} else {
+				crc = (crc >> 1);
+			}
+			c >>= 1;
+		}
+	}
+	return crc & 0xff;
+}
+
+TEST(DaikinCRC, Table)
+{
+	for (size_t crc = 0; crc < 256; crc++) {
+		for (size_t data = 0; data < 256; data++) {
+			const uint8_t d = data;
+			EXPECT_EQ(DaikinCRC::Update(crc, data), DaikinCRC::UpdateBitwise(crc, data));
+			if (crc == 0) {
+				EXPECT_EQ(DaikinCRC::Update(crc, data), crcBitwise(&d, 1));
+			}
+		}
+	}
+}
+
+TEST(DaikinCRC, Captured)
+{
+	for (size_t i = 0; i < sizeof(captured)/sizeof(captured[0]); i++) {
+		char line[128];
+		strcpy(line, captured[i]);
+		Message m(line);
+
+		EXPECT_EQ(DaikinCRC::Valid(m.Data, m.Length), true) << captured[i];
+		EXPECT_EQ(DaikinCRC::Calc(m.Data, m.Length - 1), crcBitwise(m.Data, m.Length - 1));
+
+		// Every single bit error is detected
+		for (size_t b = 0; b < m.Length * 8u; b++) {
+			m.Data[b / 8] ^= 1 << (b % 8);
+			EXPECT_EQ(DaikinCRC::Valid(m.Data, m.Length), false) << captured[i] << " bit " << b;
+			m.Data[b / 8] ^= 1 << (b % 8);
+		}
+	}
+	// Too short for a CRC
+	const uint8_t zero = 0;
+	EXPECT_EQ(DaikinCRC::Valid(&zero, 1), false);
+	EXPECT_EQ(DaikinCRC::Valid(&zero, 0), false);
+}
+
+// Returns the time per byte in ns
+template <class F>
+static double cpuTime(const std::vector<uint8_t>& data, F crc)
+{
+	double best = 1e9;
+	uint32_t sink = 0;
+
+	for (int run = 0; run < 5; run++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t off = 0; off + MAX_PACKET_SIZE <= data.size(); off += MAX_PACKET_SIZE)
+			sink += crc(&data[off], MAX_PACKET_SIZE);
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / data.size());
+	}
+	EXPECT_NE(sink, 1);
+	return best;
+}
+
+// Compares the table with the bitwise loop
+TEST(DaikinCRC, Benchmark)
+{
+	std::mt19937 rng(1);
+	std::vector<uint8_t> data(MAX_PACKET_SIZE * 4096);
+
+	for (auto& d : data)
+		d = rng();
+
+	const double ns_bitwise = cpuTime(data, crcBitwise);
+	const double ns_table = cpuTime(data, [](const uint8_t *d, size_t len) {
+		return DaikinCRC::Calc(d, len);
+	});
+	std::cerr << "[          ] CPU: bitwise " << ns_bitwise << " ns, table " << ns_table <<
+		" ns per byte, " << ns_bitwise / ns_table << " times faster" << std::endl;
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include "dual_bus_split.hpp"
+
+// Signal of channel ch at time t in ADC samples. Both channels of a bus
+// carry half of the differential signal.
+static double channel(uint8_t ch, double t)
+{
+	const double period[2] = {60, 44};
+	const uint8_t b = ch >> 1;
+
+	return 1000 * sin(2 * M_PI * t / period[b]) * (ch & 1 ? 0.6 : 0.4) + (ch & 1 ? 100 : -100);
+}
+
+static double differential(uint8_t b, double t)
+{
+	return channel(2 * b, t) + channel(2 * b + 1, t);
+}
+
+TEST(DualBusSplit, Sequence)
+{
+	DualBusSplit split;
+	const uint8_t expected[] = {0, 0, 1, 1, 0, 0, 1, 1};
+
+	for (size_t i = 0; i < sizeof(expected); i++) {
+		int32_t out;
+		uint8_t bus;
+
+		split.Update(0, &out, &bus);
+		EXPECT_EQ(bus, expected[i]) << "i = " << i;
+	}
+
+	// Restarts with the first bus
+	int32_t out;
+	uint8_t bus;
+	split.Update(0, &out, &bus);
+	split.Reset();
+	split.Update(0, &out, &bus);
+	EXPECT_EQ(bus, 0);
+}
+
+// The differential samples of a bus must be evenly spaced even though the
+// channels of a pair are sampled one after another.
+TEST(DualBusSplit, Interpolation)
+{
+	DualBusSplit split;
+	double err[2] = {0, 0};
+	size_t n[2] = {0, 0};
+
+	for (size_t t = 0; t < 1024; t++) {
+		const uint8_t ch = t & 3;
+		const uint8_t b = ch >> 1;
+		int32_t out;
+		uint8_t bus;
+
+		split.Update(round(channel(ch, t)), &out, &bus);
+		ASSERT_EQ(bus, b);
+		// Wait until all samples have been filled
+		if (t < 8)
+			continue;
+
+		// An even channel completes the sample 3.5 samples ago, an odd one
+		// the sample 2.5 samples ago.
+		const double at = ch & 1 ? t - 2.5 : t - 3.5;
+		err[b] = std::max(err[b], fabs(out - differential(b, at)));
+		n[b]++;
+	}
+	std::cerr << "[          ] max error: bus 0 " << err[0] << " bus 1 " << err[1] << std::endl;
+	EXPECT_EQ(n[0], n[1]);
+	// The linear interpolation error of a full scale sine wave
+	EXPECT_LT(err[0], 25);
+	EXPECT_LT(err[1], 45);
+}
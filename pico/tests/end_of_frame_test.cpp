@@ -0,0 +1,248 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "daikin_crc.hpp"
+#include "end_of_frame.hpp"
+#include "uart.hpp"
+#include "uart_bit_detect_fast.hpp"
+#include "waveform.hpp"
+
+#define OVERSAMPLING 16
+// Idle samples between two packets
+#define PACKET_GAP (200 * OVERSAMPLING)
+// Samples from the last byte in low latency mode to the end of a packet
+// closed by its length. The stop bit is checked one bit time later.
+#define FAST_LATENCY (OVERSAMPLING + 2)
+
+// Returns a packet of len bytes with valid CRC
+static std::vector<uint8_t> genPacket(uint8_t cmd, uint8_t addr, uint8_t type, size_t len)
+{
+	std::vector<uint8_t> data(len);
+
+	data[0] = cmd;
+	data[1] = addr;
+	data[2] = type;
+	for (size_t i = 3; i < len - 1; i++)
+		data[i] = i * 7;
+	data[len - 1] = DaikinCRC::Calc(data.data(), len - 1);
+	return data;
+}
+
+// Appends the P1P2 waveform of the packet. gap is the number of idle
+// samples between two bytes.
+static void genSignal(std::vector<int16_t>& p, const std::vector<uint8_t>& data, size_t gap)
+{
+	p.insert(p.end(), PACKET_GAP, 0);
+	for (size_t n = 0; n < data.size(); n++) {
+		int polarity = 1;
+		genByte(p, data[n], OVERSAMPLING, 3300, &polarity);
+		p.insert(p.end(), gap, 0);
+	}
+}
+
+struct Result {
+	// Number of bytes decoded
+	size_t bytes;
+	// Number of EVENT_FREE
+	size_t frames;
+	// Samples between the last byte and EVENT_FREE of every packet
+	std::vector<size_t> latency;
+	// Number of stop bits found broken after the byte
+	size_t corrections;
+};
+
+// Runs the waveform through UARTBit, UART and EndOfFrame in the same
+// order as core1 does.
+static Result run(const std::vector<int16_t>& p, EndOfFrame& eof)
+{
+	int32_t buf1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf2[UART_OVERSAMPLING_RATE * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> b(buf1, buf2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+	int16_t buf[UART_BUFFER_LEN * 2];
+	UART u(buf, UART::PARITY_EVEN);
+	Result r = {0, 0, {}, 0};
+	size_t last_byte = 0;
+	int32_t signal;
+	uint8_t out;
+	bool err;
+
+	u.SetEarly(true);
+	for (size_t i = 0; i < p.size(); i++) {
+		b.Update(p[i], &signal);
+		if (eof.Update(u.Receiving(), u.StopPending()) == EndOfFrame::EVENT_FREE) {
+			r.frames++;
+			r.latency.push_back(i - last_byte);
+		}
+		if (u.Update(signal, &out, &err)) {
+			EXPECT_EQ(err, false);
+			eof.Byte(out, err);
+			r.bytes++;
+			last_byte = i;
+		} else if (u.Correction()) {
+			eof.Correction();
+			r.corrections++;
+		}
+	}
+	return r;
+}
+
+TEST(EndOfFrame, KnownLength)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+
+	genSignal(p, genPacket(0x40, 0xf0, 0x30, 18), 0);
+	genSignal(p, genPacket(0x40, 0xf0, 0x36, 24), 0);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	EXPECT_EQ(r.bytes, 18 + 24);
+	// The first EVENT_FREE is the startup
+	ASSERT_EQ(r.frames, 3);
+	EXPECT_EQ(r.latency[1], FAST_LATENCY);
+	EXPECT_EQ(r.latency[2], FAST_LATENCY);
+	EXPECT_EQ(eof.FastCount(), 2);
+}
+
+// The known lengths apply to the second external controller address
+TEST(EndOfFrame, SecondAddress)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+	const uint8_t f1[3] = {0x40, 0xf1, 0x35};
+	const uint8_t f2[3] = {0x40, 0xf2, 0x35};
+
+	EXPECT_EQ(eof.Length(f1), 22);
+	EXPECT_EQ(eof.Length(f2), 0);
+
+	genSignal(p, genPacket(0x40, 0xf1, 0x30, 18), 0);
+	genSignal(p, genPacket(0x40, 0xf1, 0x36, 24), 0);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	ASSERT_EQ(r.frames, 3);
+	EXPECT_EQ(r.latency[1], FAST_LATENCY);
+	EXPECT_EQ(r.latency[2], FAST_LATENCY);
+	EXPECT_EQ(eof.FastCount(), 2);
+}
+
+TEST(EndOfFrame, LearnLength)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+	std::vector<uint8_t> pkt = genPacket(0x00, 0x00, 0x10, 20);
+
+	EXPECT_EQ(eof.Length(pkt.data()), 0);
+	for (int i = 0; i < 3; i++)
+		genSignal(p, pkt, 0);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	ASSERT_EQ(r.frames, 4);
+	// Closed by the default idle timeout
+	EXPECT_GE(r.latency[1], EOF_MAX_IDLE);
+	EXPECT_EQ(r.latency[2], FAST_LATENCY);
+	EXPECT_EQ(r.latency[3], FAST_LATENCY);
+	EXPECT_EQ(eof.Length(pkt.data()), 20);
+	EXPECT_EQ(eof.FastCount(), 2);
+
+	std::cerr << "[          ] end of frame after " << r.latency[1] << " samples, learned " <<
+		r.latency[2] << " samples" << std::endl;
+}
+
+// A broken stop bit of the last byte is found after the byte has been
+// passed. The packet isn't closed by its length then.
+TEST(EndOfFrame, BrokenStopBit)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+
+	genSignal(p, genPacket(0x40, 0xf0, 0x30, 18), 0);
+	// Pulse in the stop bit of the last byte
+	const size_t stop = p.size() - OVERSAMPLING;
+	for (size_t i = 0; i < OVERSAMPLING / 2; i++)
+		p[stop + i] = 3300;
+	genSignal(p, genPacket(0x40, 0xf0, 0x30, 18), 0);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	EXPECT_EQ(r.bytes, 2 * 18);
+	EXPECT_EQ(r.corrections, 1);
+	ASSERT_EQ(r.frames, 3);
+	// Closed by the idle timeout, the next packet by its length again
+	EXPECT_GE(r.latency[1], EOF_MAX_IDLE);
+	EXPECT_EQ(r.latency[2], FAST_LATENCY);
+	EXPECT_EQ(eof.FastCount(), 1);
+}
+
+TEST(EndOfFrame, InvalidCRC)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+	std::vector<uint8_t> pkt = genPacket(0x40, 0xf0, 0x30, 18);
+
+	pkt[17] ^= 1;
+	genSignal(p, pkt, 0);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	EXPECT_EQ(r.bytes, 18);
+	ASSERT_EQ(r.frames, 2);
+	EXPECT_GE(r.latency[1], EOF_MAX_IDLE);
+	EXPECT_EQ(eof.FastCount(), 0);
+	// Invalid packets don't change the idle timeout
+	EXPECT_EQ(eof.IdleTimeout(), EOF_MAX_IDLE);
+}
+
+TEST(EndOfFrame, AdaptiveIdle)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+
+	// Bytes sent back to back
+	genSignal(p, genPacket(0x00, 0x00, 0x10, 20), 0);
+	// Unknown packet type with a gap of 2 bits between the bytes must not be split
+	genSignal(p, genPacket(0x00, 0x00, 0x11, 20), 2 * OVERSAMPLING);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	EXPECT_EQ(r.bytes, 40);
+	ASSERT_EQ(r.frames, 3);
+	// Closed by the default and by the learned idle time
+	EXPECT_GE(r.latency[1], EOF_MAX_IDLE);
+	EXPECT_LT(r.latency[2], EOF_MAX_IDLE);
+	EXPECT_GE(r.latency[2], EOF_MIN_IDLE);
+	// The larger gaps increase the idle time
+	EXPECT_GT(eof.IdleTimeout(), 4 * OVERSAMPLING);
+}
+
+TEST(EndOfFrame, WrongLength)
+{
+	EndOfFrame eof;
+	std::vector<int16_t> p;
+	std::vector<uint8_t> pkt = genPacket(0x00, 0x00, 0x12, 20);
+
+	// The CRC is also valid after 6 bytes
+	pkt[5] = DaikinCRC::Calc(pkt.data(), 5);
+	pkt[19] = DaikinCRC::Calc(pkt.data(), 19);
+	eof.Learn(pkt.data(), 6);
+
+	for (int i = 0; i < 3; i++)
+		genSignal(p, pkt, 0);
+	p.insert(p.end(), PACKET_GAP, 0);
+
+	Result r = run(p, eof);
+
+	EXPECT_EQ(r.bytes, 60);
+	// The first packet is split, then the length is learned again
+	ASSERT_EQ(r.frames, 5);
+	EXPECT_GT(r.latency[3], FAST_LATENCY);
+	EXPECT_EQ(r.latency[4], FAST_LATENCY);
+	EXPECT_EQ(eof.Length(pkt.data()), 20);
+}
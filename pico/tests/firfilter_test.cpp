@@ -1,8 +1,13 @@
 #include <gtest/gtest.h>
 #include <math.h>
+#include <chrono>
+#include <random>
 
+#include "defines.hpp"
 #include "fir_filter.hpp"
 
+#define RATE_HZ (FIR_OVERSAMPLING_RATE * UART_BAUD_RATE)
+
 static float SignalRMS(int32_t *signal, size_t len)
 {
 	float ret = 0;
@@ -13,11 +18,10 @@ static float SignalRMS(int32_t *signal, size_t len)
 
 TEST(FIRfilter, Filter)
 {
-	int32_t buf_a[7 * 2];
-	int32_t buf_b[7 * 2];
+	int32_t buf[RX_FILTER_TAPS * 2];
 	const int steps[] = {1, 16, 32, 48, 64, 92, 127};
 
-	FIRFilter f(buf_a, buf_b);
+	FIRFilter<RX_FILTER_TAPS, RX_FILTER_HIGH_HZ, RATE_HZ, RX_FILTER_WINDOW> f(buf);
 
 	for (size_t j = 0; j < 7; j++) {
 		const size_t freq = steps[j];
@@ -44,3 +48,91 @@ TEST(FIRfilter, Filter)
 	}
 
 }
+
+TEST(FIRfilter, Design)
+{
+	constexpr auto taps = FIRDesign::LowPass<15>(RX_FILTER_HIGH_HZ, RATE_HZ, FIRDesign::BLACKMAN);
+	static_assert(taps[7] > taps[6] && taps[6] > taps[5], "Not a low pass");
+	int32_t sum = 0;
+
+	for (size_t i = 0; i < taps.size(); i++) {
+		sum += taps[i];
+		EXPECT_EQ(taps[i], taps[taps.size() - 1 - i]);
+	}
+	EXPECT_EQ(sum, 1 << 15);
+	EXPECT_NEAR(FIRDesign::Sin(1.0), sin(1.0), 1e-12);
+	EXPECT_NEAR(FIRDesign::Sin(-7.0), sin(-7.0), 1e-12);
+	EXPECT_NEAR(FIRDesign::Cos(2.5), cos(2.5), 1e-12);
+}
+
+// Returns the gain at freq / 256 of the sample rate
+template <class F>
+static double gain(const size_t freq)
+{
+	int32_t buf[64 * 2];
+	double rms_in = 0, rms_out = 0;
+	F f(buf);
+
+	for (size_t i = 0; i < 1024; i++) {
+		const int32_t in = sin((double)i * 2 * M_PI / 256 * freq) * 1000;
+		int32_t out;
+
+		f.Update(in, &out);
+		if (i < 256)
+			continue;
+		rms_in += (double)in * in;
+		rms_out += (double)out * out;
+	}
+	return sqrt(rms_out / rms_in);
+}
+
+// Returns the time per sample in ns
+template <class F>
+static double cpuTime(void)
+{
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int32_t> sample(-3000, 3000);
+	std::vector<int32_t> in(100000);
+	int32_t buf[64 * 2];
+	int32_t sink = 0;
+	double best = 1e9;
+
+	for (auto& s : in)
+		s = sample(rng);
+	for (int run = 0; run < 5; run++) {
+		F f(buf);
+		auto t0 = std::chrono::steady_clock::now();
+		for (int32_t s : in) {
+			int32_t out;
+			f.Update(s, &out);
+			sink += out;
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / in.size());
+	}
+	EXPECT_NE(sink, 1);
+	return best;
+}
+
+template <class F>
+static void report(const char *name)
+{
+	std::cerr << "[          ] " << name << ": pass " << gain<F>(16) << ", stop " <<
+		gain<F>(92) << " / " << gain<F>(127) << ", " << F::MULTIPLICATIONS << " multiplications, " <<
+		cpuTime<F>() << " ns" << std::endl;
+}
+
+// Filter quality against cycles for the tap count and window
+TEST(FIRfilter, Tradeoff)
+{
+	report<FIRFilter<7, RX_FILTER_HIGH_HZ, RATE_HZ, FIRDesign::RECTANGULAR>>(" 7 taps rectangular");
+	report<FIRFilter<7, RX_FILTER_HIGH_HZ, RATE_HZ, FIRDesign::HAMMING>>(" 7 taps hamming    ");
+	report<FIRFilter<11, RX_FILTER_HIGH_HZ, RATE_HZ, FIRDesign::HAMMING>>("11 taps hamming    ");
+	report<FIRFilter<15, RX_FILTER_HIGH_HZ, RATE_HZ, FIRDesign::HAMMING>>("15 taps hamming    ");
+	report<FIRFilter<15, RX_FILTER_HIGH_HZ, RATE_HZ, FIRDesign::BLACKMAN>>("15 taps blackman   ");
+
+	EXPECT_LT((gain<FIRFilter<15, RX_FILTER_HIGH_HZ, RATE_HZ>>(92)),
+		(gain<FIRFilter<7, RX_FILTER_HIGH_HZ, RATE_HZ>>(92)));
+	EXPECT_EQ((FIRFilter<7, RX_FILTER_HIGH_HZ, RATE_HZ>::MULTIPLICATIONS), 4);
+	EXPECT_EQ((FIRFilter<15, RX_FILTER_HIGH_HZ, RATE_HZ>::MULTIPLICATIONS), 8);
+}
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <chrono>
+
+#include "frame.hpp"
+#include "defines.hpp"
+
+// Packets captured from the bus
+static const char *captured[] = {
+	"00001001810100000000150040000008000018004030006d",
+	"400010018021013000180015005a00000000000040000073",
+	"0000111098000000000000cf",
+	"00f0300100000002010000000000000000ec",
+	"40f03000000000010000010000000000007a",
+	"00f035240000250000260000270001280000290000ee",
+	"00f03614005e01ffffffffffffffffffffffffffffffffd8",
+};
+
+static void expectEqual(const Message& a, const Message& b)
+{
+	EXPECT_EQ(a.Status, b.Status);
+	EXPECT_EQ(a.Timestamp, b.Timestamp);
+	EXPECT_EQ(a.Duration, b.Duration);
+	EXPECT_EQ(a.Gap, b.Gap);
+	EXPECT_EQ(a.Bus, b.Bus);
+	ASSERT_EQ(a.Length, b.Length);
+	for (size_t i = 0; i < a.Length; i++)
+		EXPECT_EQ(a.Data[i], b.Data[i]);
+}
+
+TEST(Frame, CRC16)
+{
+	const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+	// CRC-16/CCITT-FALSE check value
+	EXPECT_EQ(Frame::CRC16(check, sizeof(check)), 0x29b1);
+}
+
+TEST(Frame, RoundTrip)
+{
+	uint8_t buf[FRAME_MAX_ENCODED_SIZE];
+
+	for (size_t i = 0; i < sizeof(captured)/sizeof(captured[0]); i++) {
+		char line[128];
+		strcpy(line, captured[i]);
+		Message m(line);
+		Message out;
+		size_t len;
+
+		m.Status = Message::STATUS_ERR_PARITY;
+		m.Timestamp = 0x12003400 + i;
+		m.Duration = 25000 + i;
+		m.Gap = 0x00100000 + i;
+		m.Bus = i & 1;
+		len = Frame::Encode(m, buf, sizeof(buf));
+		ASSERT_GT(len, 0);
+
+		// Only the delimiter is zero
+		for (size_t j = 0; j < len - 1; j++)
+			EXPECT_NE(buf[j], 0);
+		EXPECT_EQ(buf[len - 1], 0);
+
+		EXPECT_EQ(Frame::Decode(buf, len - 1, &out), true);
+		expectEqual(m, out);
+	}
+}
+
+TEST(Frame, MaxLength)
+{
+	uint8_t buf[FRAME_MAX_ENCODED_SIZE];
+	uint8_t data[MAX_PACKET_SIZE];
+	Message out;
+	size_t len;
+
+	memset(data, 0, sizeof(data));
+	Message zero(0, data, sizeof(data));
+	len = Frame::Encode(zero, buf, sizeof(buf));
+	ASSERT_GT(len, 0);
+	EXPECT_EQ(Frame::Decode(buf, len - 1, &out), true);
+	expectEqual(zero, out);
+
+	memset(data, 0xff, sizeof(data));
+	Message ones(0, data, sizeof(data));
+	len = Frame::Encode(ones, buf, sizeof(buf));
+	ASSERT_GT(len, 0);
+	EXPECT_EQ(Frame::Decode(buf, len - 1, &out), true);
+	expectEqual(ones, out);
+
+	// The bus flag must not be taken as length
+	ones.Bus = 1;
+	len = Frame::Encode(ones, buf, sizeof(buf));
+	ASSERT_GT(len, 0);
+	EXPECT_EQ(Frame::Decode(buf, len - 1, &out), true);
+	expectEqual(ones, out);
+
+	// Output buffer too small
+	EXPECT_EQ(Frame::Encode(ones, buf, 10), 0);
+}
+
+TEST(Frame, Corrupted)
+{
+	uint8_t buf[FRAME_MAX_ENCODED_SIZE];
+	char line[128];
+	Message out;
+	size_t len;
+
+	strcpy(line, captured[0]);
+	Message m(line);
+	len = Frame::Encode(m, buf, sizeof(buf));
+	ASSERT_GT(len, 0);
+
+	for (size_t i = 0; i < len - 1; i++) {
+		uint8_t old = buf[i];
+		buf[i] ^= 0x10;
+		if (buf[i] != 0) {
+			EXPECT_EQ(Frame::Decode(buf, len - 1, &out), false) << "i = " << i;
+		}
+		buf[i] = old;
+	}
+
+	// Truncated
+	EXPECT_EQ(Frame::Decode(buf, len - 2, &out), false);
+	EXPECT_EQ(Frame::Decode(buf, 0, &out), false);
+}
+
+// Compares the binary format against the ASCII format
+TEST(Frame, Throughput)
+{
+	const size_t loops = 2000;
+	const size_t num = sizeof(captured)/sizeof(captured[0]);
+	uint8_t buf[FRAME_MAX_ENCODED_SIZE];
+	size_t ascii_bytes = 0, binary_bytes = 0;
+	Message msgs[num];
+
+	for (size_t i = 0; i < num; i++) {
+		char line[128];
+		strcpy(line, captured[i]);
+		msgs[i] = Message(line);
+		msgs[i].Timestamp = 1234567890 + i * 100000;
+		msgs[i].Duration = 20000;
+		msgs[i].Gap = 80000;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t l = 0; l < loops; l++) {
+		for (size_t i = 0; i < num; i++) {
+			char line[128];
+			// Line is terminated by CR/LF
+			ascii_bytes += strlen(msgs[i].c_str(true)) + 2;
+			strcpy(line, msgs[i].c_str(true));
+			Message m(line);
+			EXPECT_EQ(m.Length, msgs[i].Length);
+		}
+	}
+	auto ascii = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (size_t l = 0; l < loops; l++) {
+		for (size_t i = 0; i < num; i++) {
+			Message m;
+			size_t len = Frame::Encode(msgs[i], buf, sizeof(buf));
+			binary_bytes += len;
+			EXPECT_EQ(Frame::Decode(buf, len - 1, &m), true);
+			EXPECT_EQ(m.Length, msgs[i].Length);
+		}
+	}
+	auto binary = std::chrono::steady_clock::now() - start;
+
+	std::cerr << "[          ] ASCII:  " << ascii_bytes / (loops * num) << " bytes/packet, " <<
+		std::chrono::duration_cast<std::chrono::nanoseconds>(ascii).count() / (loops * num) <<
+		" ns/packet" << std::endl;
+	std::cerr << "[          ] Binary: " << binary_bytes / (loops * num) << " bytes/packet, " <<
+		std::chrono::duration_cast<std::chrono::nanoseconds>(binary).count() / (loops * num) <<
+		" ns/packet" << std::endl;
+
+	// Both formats carry the packet timing
+	EXPECT_LT(binary_bytes, ascii_bytes * 3 / 4);
+}
+
+TEST(Frame, StreamByte)
+{
+	uint8_t buf[FRAME_BYTE_ENCODED_SIZE];
+	uint8_t status, data, bus;
+	uint32_t timestamp;
+	Message m;
+
+	for (uint16_t b = 0; b <= 0xff; b++) {
+		const uint32_t t = 0x01000000 * b + b;
+		size_t len = Frame::EncodeByte(b & 1 ? Message::STATUS_ERR_PARITY : 0, b, t, (b >> 1) & 1,
+					       buf, sizeof(buf));
+
+		ASSERT_EQ(len, sizeof(buf));
+		EXPECT_EQ(buf[len - 1], 0);
+		ASSERT_EQ(Frame::DecodeByte(buf, len - 1, &status, &data, &timestamp, &bus), true);
+		EXPECT_EQ(status, b & 1 ? Message::STATUS_ERR_PARITY : 0);
+		EXPECT_EQ(data, b);
+		EXPECT_EQ(timestamp, t);
+		EXPECT_EQ(bus, (b >> 1) & 1);
+		// Must not be accepted as regular frame
+		EXPECT_EQ(Frame::Decode(buf, len - 1, &m), false);
+	}
+
+	// Corrupted
+	size_t len = Frame::EncodeByte(0, 0x5a, 1234567, 0, buf, sizeof(buf));
+	for (size_t i = 0; i < len - 1; i++) {
+		uint8_t old = buf[i];
+		buf[i] ^= 0x10;
+		if (buf[i] != 0) {
+			EXPECT_EQ(Frame::DecodeByte(buf, len - 1, &status, &data, &timestamp, &bus), false) << "i = " << i;
+		}
+		buf[i] = old;
+	}
+	EXPECT_EQ(Frame::EncodeByte(0, 0x5a, 1234567, 0, buf, sizeof(buf) - 1), 0);
+}
+
+TEST(Frame, TxResult)
+{
+	uint8_t buf[FRAME_TX_RESULT_ENCODED_SIZE];
+	uint8_t type, writes, attempts;
+	uint8_t status, data, bus;
+	uint32_t timestamp;
+	bool ok;
+	Message m;
+
+	for (int i = 0; i < 2; i++) {
+		size_t len = Frame::EncodeTxResult(i == 0, 0x35, 7, 2, buf, sizeof(buf));
+
+		ASSERT_EQ(len, sizeof(buf));
+		EXPECT_EQ(buf[len - 1], 0);
+		ASSERT_EQ(Frame::DecodeTxResult(buf, len - 1, &ok, &type, &writes, &attempts), true);
+		EXPECT_EQ(ok, i == 0);
+		EXPECT_EQ(type, 0x35);
+		EXPECT_EQ(writes, 7);
+		EXPECT_EQ(attempts, 2);
+		// Must not be accepted as another frame type
+		EXPECT_EQ(Frame::Decode(buf, len - 1, &m), false);
+		EXPECT_EQ(Frame::DecodeByte(buf, len - 1, &status, &data, &timestamp, &bus), false);
+	}
+
+	// Other frame types aren't accepted as result
+	uint8_t byte[FRAME_BYTE_ENCODED_SIZE];
+	size_t len = Frame::EncodeByte(0, 0x5a, 1234567, 0, byte, sizeof(byte));
+	ASSERT_EQ(len, sizeof(byte));
+	EXPECT_EQ(Frame::DecodeTxResult(byte, len - 1, &ok, &type, &writes, &attempts), false);
+
+	// Corrupted
+	len = Frame::EncodeTxResult(true, 0x35, 7, 2, buf, sizeof(buf));
+	for (size_t i = 0; i < len - 1; i++) {
+		uint8_t old = buf[i];
+		buf[i] ^= 0x10;
+		if (buf[i] != 0) {
+			EXPECT_EQ(Frame::DecodeTxResult(buf, len - 1, &ok, &type, &writes, &attempts), false) << "i = " << i;
+		}
+		buf[i] = old;
+	}
+	EXPECT_EQ(Frame::EncodeTxResult(true, 0x35, 7, 2, buf, sizeof(buf) - 1), 0);
+}
+
+TEST(Frame, StreamEnd)
+{
+	uint8_t buf[FRAME_MAX_ENCODED_SIZE];
+	uint8_t status, data, bus;
+	uint32_t timestamp;
+	Message end, out;
+
+	end.Status = Frame::FRAME_STREAM_END | Message::STATUS_ERR_BUS_COLLISION;
+	end.Timestamp = 1234567890;
+	end.Duration = 20000;
+	end.Gap = 80000;
+
+	size_t len = Frame::Encode(end, buf, sizeof(buf));
+	ASSERT_GT(len, 0);
+	ASSERT_EQ(Frame::Decode(buf, len - 1, &out), true);
+	expectEqual(end, out);
+	EXPECT_EQ(Frame::DecodeByte(buf, len - 1, &status, &data, &timestamp, &bus), false);
+}
+
+// The byte stream must keep up with a fully loaded bus on the hardware UART
+TEST(Frame, StreamThroughput)
+{
+	const size_t bus_bytes_per_sec = UART_BAUD_RATE / 11;
+	// 8N1 on the host UART
+	const size_t host_bytes_per_sec = HOST_UART_BAUD_RATE / 10;
+	uint8_t buf[FRAME_BYTE_ENCODED_SIZE];
+
+	size_t len = Frame::EncodeByte(0, 0x00, 0, 0, buf, sizeof(buf));
+	std::cerr << "[          ] Binary: " << len << " bytes/byte, " <<
+		100 * len * bus_bytes_per_sec / host_bytes_per_sec << "% of the host UART" << std::endl;
+	EXPECT_LT(len * bus_bytes_per_sec, host_bytes_per_sec);
+}
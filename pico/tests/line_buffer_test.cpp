@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "line_buffer.hpp"
+
+static void write(LineBuffer<32>& b, const char *str)
+{
+	b.Write((const uint8_t *)str, strlen(str));
+}
+
+TEST(LineBuffer, SplitLines)
+{
+	LineBuffer<32> b;
+	size_t len;
+	char *line;
+
+	write(b, "0102\r\n0304\n05");
+	line = b.Pop(&len, false);
+	ASSERT_NE(line, nullptr);
+	EXPECT_STREQ(line, "0102");
+	EXPECT_EQ(len, 4);
+
+	// Empty lines are skipped
+	line = b.Pop(&len, false);
+	ASSERT_NE(line, nullptr);
+	EXPECT_STREQ(line, "0304");
+	EXPECT_EQ(len, 4);
+
+	// Partial line
+	EXPECT_EQ(b.Pop(&len, false), nullptr);
+	EXPECT_EQ(b.Length(), 2);
+
+	write(b, "06\r");
+	line = b.Pop(&len, false);
+	ASSERT_NE(line, nullptr);
+	EXPECT_STREQ(line, "0506");
+	EXPECT_EQ(b.Pop(&len, false), nullptr);
+	EXPECT_EQ(b.Drops(), 0);
+}
+
+TEST(LineBuffer, ZeroCopy)
+{
+	LineBuffer<32> b;
+	size_t space, len;
+	uint8_t *ptr;
+	char *line;
+
+	ptr = b.WritePtr(&space);
+	EXPECT_EQ(space, 32);
+	memcpy(ptr, "abc\n", 4);
+	b.Commit(4);
+
+	line = b.Pop(&len, false);
+	ASSERT_NE(line, nullptr);
+	// The line is terminated in place
+	EXPECT_EQ((uint8_t *)line, ptr);
+	EXPECT_STREQ(line, "abc");
+}
+
+TEST(LineBuffer, Binary)
+{
+	LineBuffer<32> b;
+	const uint8_t frame[] = {0x03, '\r', '\n', 0x00, 0x02, 0x01, 0x00};
+	size_t len;
+	char *line;
+
+	b.Write(frame, sizeof(frame));
+	line = b.Pop(&len, true);
+	ASSERT_NE(line, nullptr);
+	EXPECT_EQ(len, 3);
+	EXPECT_EQ(line[1], '\r');
+
+	line = b.Pop(&len, true);
+	ASSERT_NE(line, nullptr);
+	EXPECT_EQ(len, 2);
+	EXPECT_EQ(b.Pop(&len, true), nullptr);
+}
+
+TEST(LineBuffer, Compact)
+{
+	LineBuffer<32> b;
+	size_t len;
+	char *line;
+
+	// Fill the buffer many times. Partial lines are moved to the front.
+	for (size_t i = 0; i < 100; i++) {
+		write(b, "0123456789");
+		write(b, "abcdef\n");
+		line = b.Pop(&len, false);
+		ASSERT_NE(line, nullptr);
+		EXPECT_STREQ(line, "0123456789abcdef");
+	}
+	EXPECT_EQ(b.Drops(), 0);
+}
+
+TEST(LineBuffer, Overflow)
+{
+	LineBuffer<32> b;
+	size_t len;
+	char *line;
+
+	// Line too long for the buffer
+	write(b, "0123456789012345678901234567890123456789");
+	EXPECT_EQ(b.Pop(&len, false), nullptr);
+	EXPECT_EQ(b.Drops(), 1);
+
+	// Next line is received correctly
+	write(b, "\nabcd\n");
+	line = b.Pop(&len, false);
+	ASSERT_NE(line, nullptr);
+	EXPECT_STREQ(line, "abcd");
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "line_busy.hpp"
+#include "level_detect.hpp"
+#include "uart.hpp"
+#include "uart_bit_detect_fast.hpp"
+#include "waveform.hpp"
+
+#define OVERSAMPLING 16
+// Idle samples before every packet
+#define LEAD (20 * OVERSAMPLING)
+
+// Adds gaussian noise and single sample spikes to the signal
+static void addNoise(std::vector<int32_t>& p, std::mt19937& rng, double sigma, size_t spike_interval)
+{
+	std::normal_distribution<double> noise(0, sigma);
+
+	for (size_t i = 0; i < p.size(); i++) {
+		p[i] += noise(rng);
+		if (spike_interval && i % spike_interval == spike_interval / 2)
+			p[i] += i & 1 ? 2500 : -2500;
+	}
+}
+
+struct Detector {
+	int32_t buf1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf2[UART_OVERSAMPLING_RATE * 2];
+	int16_t buf[UART_BUFFER_LEN * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> bit;
+	UART uart;
+	Level<int32_t> level;
+	LineBusy<UART_OVERSAMPLING_RATE> carrier;
+
+	Detector() : bit(buf1, buf2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0),
+		uart(buf, UART::PARITY_EVEN), carrier(BUS_HIGH_MV) {}
+
+	// Runs one sample through the core1 pipeline after the DC block
+	void Update(int32_t in, bool *carrier_busy, bool *receiving) {
+		int32_t hysteresis, prob;
+		uint8_t out;
+		bool err;
+
+		this->carrier.Update(in);
+		this->level.Update(in, &hysteresis);
+		this->bit.Update(hysteresis, &prob);
+		this->uart.Update(prob, &out, &err);
+		*carrier_busy = this->carrier.Busy();
+		*receiving = this->uart.Receiving();
+	}
+};
+
+// Reaction time on the first start bit of a packet
+TEST(LineBusy, ReactionTime)
+{
+	std::mt19937 rng(1);
+	size_t carrier_sum = 0, uart_sum = 0, carrier_max = 0, uart_max = 0;
+	const size_t packets = 100;
+
+	for (size_t n = 0; n < packets; n++) {
+		Detector d;
+		std::vector<int32_t> p(LEAD, 0);
+		int polarity = n & 1 ? 1 : -1;
+		ssize_t carrier_at = -1, uart_at = -1;
+
+		for (size_t i = 0; i < 4; i++)
+			genByte(p, rng(), OVERSAMPLING, 3000, &polarity);
+		addNoise(p, rng, 150, 0);
+
+		for (size_t i = 0; i < p.size(); i++) {
+			bool carrier, receiving;
+			d.Update(p[i], &carrier, &receiving);
+			// The UART starts in WAIT_FOR_IDLE, ignore the first samples
+			if (i < LEAD / 2)
+				continue;
+			if (carrier && carrier_at < 0)
+				carrier_at = i - LEAD;
+			if (receiving && uart_at < 0)
+				uart_at = i - LEAD;
+		}
+		ASSERT_GE(carrier_at, 0);
+		ASSERT_GE(uart_at, 0);
+		carrier_sum += carrier_at;
+		uart_sum += uart_at;
+		carrier_max = std::max(carrier_max, (size_t)carrier_at);
+		uart_max = std::max(uart_max, (size_t)uart_at);
+	}
+
+	std::cerr << "[          ] carrier sense: avg " << carrier_sum / packets << " max " <<
+		carrier_max << " samples" << std::endl;
+	std::cerr << "[          ] UART:          avg " << uart_sum / packets << " max " <<
+		uart_max << " samples" << std::endl;
+
+	// Busy after 3 samples of the start bit
+	EXPECT_LE(carrier_max, 3);
+	EXPECT_GE(uart_sum - carrier_sum, packets * OVERSAMPLING / 2);
+}
+
+// Samples signaled busy on an idle line with noise and spikes
+TEST(LineBusy, FalsePositives)
+{
+	std::mt19937 rng(2);
+	const size_t len = 1000 * OVERSAMPLING;
+
+	for (double sigma : {100.0, 300.0, 600.0}) {
+		Detector d;
+		std::vector<int32_t> p(len, 0);
+		size_t carrier_busy = 0, uart_busy = 0;
+
+		addNoise(p, rng, sigma, 5 * OVERSAMPLING);
+		for (size_t i = 0; i < p.size(); i++) {
+			bool carrier, receiving;
+			d.Update(p[i], &carrier, &receiving);
+			if (i < LEAD)
+				continue;
+			carrier_busy += carrier;
+			uart_busy += receiving;
+		}
+
+		std::cerr << "[          ] noise " << sigma << " mV: carrier sense " <<
+			100.0 * carrier_busy / len << "%, UART " << 100.0 * uart_busy / len <<
+			"% of the samples busy" << std::endl;
+		if (sigma <= 300.0) {
+			EXPECT_EQ(carrier_busy, 0);
+		}
+		EXPECT_LT(carrier_busy, len / 100);
+	}
+}
+
+// The window count must match a full recount
+TEST(LineBusy, Incremental)
+{
+	std::mt19937 rng(3);
+	std::uniform_int_distribution<int> sample(-3000, 3000);
+	LineBusy<16> l(BUS_HIGH_MV);
+	std::vector<int32_t> hist;
+
+	for (size_t i = 0; i < 10000; i++) {
+		int32_t in = sample(rng);
+		size_t cnt = 0;
+
+		l.Update(in);
+		hist.push_back(in);
+		for (size_t j = hist.size() > 16 ? hist.size() - 16 : 0; j < hist.size(); j++)
+			cnt += hist[j] > BUS_HIGH_MV || hist[j] < -BUS_HIGH_MV;
+		EXPECT_EQ(l.Busy(), cnt > 2 && cnt <= 10) << "i = " << i;
+	}
+}
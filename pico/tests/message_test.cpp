@@ -35,6 +35,63 @@ TEST(Message, cstr)
 	cmp("010203 # ff  ", m4.c_str());
 }
 
+TEST(Message, cstrCRC)
+{
+	uint8_t test_data[3] = {1,2,3};
+	Message m1(Message::STATUS_ERR_CRC, test_data, sizeof(test_data));
+	cmp("010203 # 06 K", m1.c_str());
+}
+
+TEST(Message, cstrRepaired)
+{
+	uint8_t test_data[3] = {1,2,3};
+	Message m1(Message::STATUS_REPAIRED, test_data, sizeof(test_data));
+	cmp("010203 # 07 R", m1.c_str());
+}
+
+TEST(Message, cstrTimestamp)
+{
+	uint8_t test_data[3] = {1,2,3};
+	Message m1(0, test_data, sizeof(test_data));
+	m1.Timestamp = 123456;
+	m1.Duration = 3437;
+	m1.Gap = 25000;
+	cmp("010203 ; t=123456 d=3437 g=25000", m1.c_str(true));
+	cmp("010203", m1.c_str());
+
+	m1.Status = Message::STATUS_ERR_PARITY;
+	cmp("010203 # 03 P ; t=123456 d=3437 g=25000", m1.c_str(true));
+
+	// The timing must be ignored when parsing the line
+	char buf[128];
+	strcpy(buf, m1.c_str(true));
+	Message m2(buf);
+	EXPECT_EQ(m2.Length, 3);
+	EXPECT_EQ(m2.Data[2], 3);
+}
+
+TEST(Message, cstrBus)
+{
+	uint8_t test_data[3] = {1,2,3};
+	Message m1(0, test_data, sizeof(test_data));
+	m1.Timestamp = 123456;
+	m1.Duration = 3437;
+	m1.Gap = 25000;
+	m1.Bus = 1;
+	cmp("010203 ; b=1", m1.c_str(false, true));
+	cmp("010203 ; t=123456 d=3437 g=25000 b=1", m1.c_str(true, true));
+
+	// The bus is kept by Clear
+	m1.Clear();
+	EXPECT_EQ(m1.Bus, 1);
+
+	char buf[128];
+	strcpy(buf, "010203 ; b=1");
+	Message m2(buf);
+	EXPECT_EQ(m2.Length, 3);
+	EXPECT_EQ(m2.Bus, 0);
+}
+
 TEST(Message, parsing)
 {
 	char buf1[] = "010203";
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "daikin_crc.hpp"
+#include "message.hpp"
+#include "packet_repair.hpp"
+#include "rx_pipeline.hpp"
+#include "waveform.hpp"
+
+// Packets captured from the bus
+static const char *captured[] = {
+	"00001001810100000000150040000008000018004030006d",
+	"400010018021013000180015005a00000000000040000073",
+	"0000111098000000000000cf",
+	"00f0300100000002010000000000000000ec",
+	"40f03000000000010000010000000000007a",
+	"00f035240000250000260000270001280000290000ee",
+};
+
+// Returns the packet with bit b flipped and the status as received
+static Message flipped(const char *hex, size_t b)
+{
+	char line[128];
+	strcpy(line, hex);
+	Message m(line);
+
+	m.Data[b / 8] ^= 1 << (b % 8);
+	m.Status = Message::STATUS_ERR_PARITY;
+	return m;
+}
+
+// Feeds the bytes of m to r, byte pos has a parity error
+static void feed(PacketRepair& r, const Message& m, size_t pos, uint8_t first, uint8_t second)
+{
+	for (size_t i = 0; i < m.Length; i++)
+		r.Byte(i == pos, i == pos, first, second);
+}
+
+TEST(PacketRepair, SingleBit)
+{
+	PacketRepair r;
+
+	for (size_t i = 0; i < sizeof(captured)/sizeof(captured[0]); i++) {
+		char line[128];
+		strcpy(line, captured[i]);
+		const Message orig(line);
+
+		for (size_t b = 0; b < orig.Length * 8u; b++) {
+			Message m = flipped(captured[i], b);
+
+			// The broken bit is the second suspect
+			feed(r, m, b / 8, (b + 1) % 8, b % 8);
+			ASSERT_EQ(r.Repair(&m), true) << captured[i] << " bit " << b;
+			EXPECT_EQ(m.Status, Message::STATUS_REPAIRED);
+			EXPECT_EQ(memcmp(m.Data, orig.Data, m.Length), 0);
+		}
+	}
+	EXPECT_EQ(r.Failed(), 0);
+}
+
+TEST(PacketRepair, WrongSuspects)
+{
+	PacketRepair r;
+	Message m = flipped(captured[0], 13);
+
+	feed(r, m, 1, 0, 1);
+	EXPECT_EQ(r.Repair(&m), false);
+	EXPECT_EQ(m.Status, Message::STATUS_ERR_PARITY);
+	// The packet is unchanged
+	EXPECT_EQ(m.Data[1], 0x20);
+	EXPECT_EQ(r.Failed(), 1);
+	EXPECT_EQ(r.Repaired(), 0);
+}
+
+TEST(PacketRepair, NotRepairable)
+{
+	PacketRepair r;
+
+	// Two bytes with errors
+	Message m = flipped(captured[0], 13);
+	for (size_t i = 0; i < m.Length; i++)
+		r.Byte(i == 1 || i == 3, true, 5, 5);
+	EXPECT_EQ(r.Repair(&m), false);
+
+	// Stop bit error
+	m = flipped(captured[0], 13);
+	feed(r, m, 1, 5, 5);
+	r.Invalidate();
+	EXPECT_EQ(r.Repair(&m), false);
+
+	// The error wasn't a parity error
+	m = flipped(captured[0], 13);
+	for (size_t i = 0; i < m.Length; i++)
+		r.Byte(i == 1, false, 5, 5);
+	EXPECT_EQ(r.Repair(&m), false);
+
+	// Bytes missing
+	m = flipped(captured[0], 13);
+	feed(r, m, 1, 5, 5);
+	m.Length--;
+	EXPECT_EQ(r.Repair(&m), false);
+
+	// Packets without errors are left alone
+	char line[128];
+	strcpy(line, captured[0]);
+	Message ok(line);
+	feed(r, ok, MAX_PACKET_SIZE, 5, 5);
+	EXPECT_EQ(r.Repair(&ok), false);
+	EXPECT_EQ(ok.Status, Message::STATUS_OK);
+
+	EXPECT_EQ(r.Repaired(), 0);
+	EXPECT_EQ(r.Failed(), 0);
+
+	// The state has been cleared for the next packet
+	m = flipped(captured[0], 13);
+	feed(r, m, 1, 5, 5);
+	EXPECT_EQ(r.Repair(&m), true);
+}
+
+// Only the parity bit is broken, the data is valid
+TEST(PacketRepair, ParityBit)
+{
+	PacketRepair r;
+	char line[128];
+	strcpy(line, captured[2]);
+	Message m(line);
+
+	m.Status = Message::STATUS_ERR_PARITY;
+	feed(r, m, 4, 3, 8);
+	EXPECT_EQ(r.Repair(&m), true);
+	EXPECT_EQ(m.Status, Message::STATUS_REPAIRED);
+	EXPECT_EQ(DaikinCRC::Valid(m.Data, m.Length), true);
+}
+
+// Returns the P1P2 waveform of the packet at ADC_OVERSAMPLING_RATE
+static std::vector<int32_t> genPacket(const Message& m)
+{
+	std::vector<int32_t> p(10 * ADC_OVERSAMPLING_RATE, 0);
+
+	genBytes(p, m.Data, m.Length, ADC_OVERSAMPLING_RATE, 3000);
+	p.insert(p.end(), 60 * ADC_OVERSAMPLING_RATE, 0);
+	return p;
+}
+
+// Receives noisy packets like Core0Receive does and counts how many packets
+// with a parity error have been repaired.
+TEST(PacketRepair, NoisyWaveform)
+{
+	std::mt19937 rng(1);
+	// Background noise and a short burst of interference per packet,
+	// mostly hitting a single bit
+	std::normal_distribution<double> noise(0, 300);
+	std::uniform_int_distribution<size_t> pick(0, sizeof(captured)/sizeof(captured[0]) - 1);
+	size_t parity = 0, tried = 0, repaired = 0, wrong = 0;
+
+	for (size_t n = 0; n < 300; n++) {
+		char line[128];
+		strcpy(line, captured[pick(rng)]);
+		const Message orig(line);
+		std::vector<int32_t> adc = genPacket(orig);
+
+		for (auto& a : adc)
+			a += noise(rng);
+		const size_t at = 10 * ADC_OVERSAMPLING_RATE + rng() % (orig.Length * 11 * ADC_OVERSAMPLING_RATE);
+		const int32_t burst = rng() & 1 ? 2500 : -2500;
+		for (size_t i = at; i < at + ADC_OVERSAMPLING_RATE / 2; i++)
+			adc[i] += burst;
+
+		RxPipeline<2> rx;
+		PacketRepair r;
+		Message m;
+		for (int32_t in : adc) {
+			RxPipeline<2>::Event ev;
+
+			if (!rx.Update(in, &ev))
+				continue;
+			if (ev.Correction) {
+				if (m.Status == Message::STATUS_OK)
+					m.Status = Message::STATUS_ERR_PARITY;
+				r.Invalidate();
+			}
+			if (ev.Byte) {
+				if (ev.Error)
+					m.Status = Message::STATUS_ERR_PARITY;
+				m.Append(ev.Data);
+				r.Byte(ev.Error, ev.ParityFailed, ev.Suspects[0], ev.Suspects[1]);
+			}
+		}
+		if (m.Status != Message::STATUS_ERR_PARITY)
+			continue;
+		parity++;
+		const bool ok = r.Repair(&m);
+		tried += ok || r.Failed();
+		if (!ok)
+			continue;
+		if (m.Length == orig.Length && memcmp(m.Data, orig.Data, m.Length) == 0)
+			repaired++;
+		else
+			wrong++;
+	}
+	std::cerr << "[          ] " << parity << " packets with parity errors, " << tried <<
+		" with a single one, " << repaired << " repaired, " << wrong << " wrong" << std::endl;
+	EXPECT_GT(parity, 50);
+	EXPECT_GT(repaired * 2, parity);
+	EXPECT_GT(repaired * 4, tried * 3);
+	EXPECT_EQ(wrong, 0);
+}
@@ -1,4 +1,5 @@
 typedef long absolute_time_t;
 
 absolute_time_t make_timeout_time_us(long timeout);
+absolute_time_t make_timeout_time_ms(long timeout);
 bool time_reached(absolute_time_t time);
@@ -0,0 +1,290 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "dual_bus_split.hpp"
+#include "message.hpp"
+#include "rx_pipeline.hpp"
+#include "spsc_ring.hpp"
+#include "waveform.hpp"
+
+// Idle bits before the first byte
+#define LEAD_BITS 40
+
+typedef RxPipeline<2> SingleBus;
+typedef RxPipeline<1> DualBus;
+
+// Returns the P1P2 waveform of the packet at ADC_OVERSAMPLING_RATE.
+// The packet starts after lead idle bits.
+static std::vector<int32_t> genPacket(const std::vector<uint8_t>& data, size_t lead)
+{
+	std::vector<int32_t> p(lead * ADC_OVERSAMPLING_RATE, 0);
+
+	genBytes(p, data.data(), data.size(), ADC_OVERSAMPLING_RATE, 3000);
+	p.insert(p.end(), 200 * ADC_OVERSAMPLING_RATE, 0);
+	return p;
+}
+
+// Returns the round robin samples of ADC0 - ADC3. Bus b is connected to
+// ADC(2b) and ADC(2b + 1), the PIO negates the samples of the even channels.
+static std::vector<int32_t> interleave(const std::vector<int32_t>& bus0, const std::vector<int32_t>& bus1)
+{
+	std::vector<int32_t> out(std::min(bus0.size(), bus1.size()));
+
+	for (size_t t = 0; t < out.size(); t++) {
+		const std::vector<int32_t>& p = t & 2 ? bus1 : bus0;
+		out[t] = t & 1 ? p[t] / 2 : p[t] - p[t] / 2;
+	}
+	return out;
+}
+
+struct Received {
+	std::vector<uint8_t> Data;
+	std::vector<uint64_t> ByteStart;
+	size_t Errors;
+	size_t Frames;
+	uint64_t FrameStart;
+	uint64_t FrameEnd;
+
+	Received() : Errors(0), Frames(0), FrameStart(0), FrameEnd(0) {}
+
+	void Add(const RxPipeline<1>::Event& ev) {
+		this->Add(ev.Frame, ev.FrameStart, ev.FrameEnd, ev.Byte, ev.Data, ev.Error, ev.ByteStart);
+	}
+
+	void Add(const RxPipeline<2>::Event& ev) {
+		this->Add(ev.Frame, ev.FrameStart, ev.FrameEnd, ev.Byte, ev.Data, ev.Error, ev.ByteStart);
+	}
+
+	void Add(bool frame, uint64_t start, uint64_t end, bool byte, uint8_t data, bool err,
+		 uint64_t byte_start) {
+		if (frame) {
+			this->Frames++;
+			this->FrameStart = start;
+			this->FrameEnd = end;
+		}
+		if (!byte)
+			return;
+		this->Data.push_back(data);
+		this->ByteStart.push_back(byte_start);
+		this->Errors += err;
+	}
+};
+
+// Checks the bytes and the timing of a packet started after lead idle bits
+static void expectPacket(const Received& r, const std::vector<uint8_t>& data, size_t lead)
+{
+	ASSERT_EQ(r.Data.size(), data.size());
+	EXPECT_EQ(r.Errors, 0);
+	for (size_t i = 0; i < data.size(); i++) {
+		EXPECT_EQ(r.Data[i], data[i]) << "i = " << i;
+		EXPECT_NEAR((double)r.ByteStart[i],
+			    (lead + i * UART_BITS_PARITY) * UART_OVERSAMPLING_RATE, 1) << "i = " << i;
+	}
+	EXPECT_EQ(r.Frames, 1);
+	EXPECT_EQ(r.FrameStart, r.ByteStart[0]);
+	EXPECT_EQ(r.FrameEnd, r.ByteStart.back() + UART_BITS_PARITY * UART_OVERSAMPLING_RATE);
+}
+
+static const std::vector<uint8_t> packet0 = {0x40, 0x00, 0x10, 0x01, 0x81, 0x01, 0x2a};
+static const std::vector<uint8_t> packet1 = {0x00, 0x00, 0x10, 0x00, 0x00, 0x36, 0xa5};
+
+TEST(RxPipeline, SingleBus)
+{
+	const std::vector<int32_t> p = genPacket(packet0, LEAD_BITS);
+	SingleBus rx;
+	Received r;
+
+	for (int32_t in : p) {
+		SingleBus::Event ev;
+
+		if (rx.Update(in, &ev))
+			r.Add(ev);
+	}
+	EXPECT_EQ(rx.Samples(), p.size() / 2);
+	expectPacket(r, packet0, LEAD_BITS);
+}
+
+// Two packets overlapping in time on both buses must be decoded
+// independently from the interleaved ADC samples.
+TEST(RxPipeline, DualBus)
+{
+	const std::vector<int32_t> adc = interleave(genPacket(packet0, LEAD_BITS),
+						    genPacket(packet1, LEAD_BITS + 3));
+	DualBusSplit split;
+	DualBus rx[2];
+	Received r[2];
+
+	for (int32_t in : adc) {
+		DualBus::Event ev;
+		int32_t sample;
+		uint8_t bus;
+
+		split.Update(in, &sample, &bus);
+		if (rx[bus].Update(sample, &ev))
+			r[bus].Add(ev);
+	}
+	EXPECT_EQ(rx[0].Samples(), adc.size() / 2);
+	EXPECT_EQ(rx[1].Samples(), adc.size() / 2);
+	expectPacket(r[0], packet0, LEAD_BITS);
+	expectPacket(r[1], packet1, LEAD_BITS + 3);
+}
+
+// Returns all events of the pipeline that carry more than the bit
+template <class E>
+static void record(std::vector<E>& events, const E& ev)
+{
+	if (ev.Line == EndOfFrame::EVENT_NONE && !ev.Byte && !ev.Correction)
+		return;
+	events.push_back(ev);
+}
+
+// Running the front end and the back end in different threads must decode
+// the same bytes at the same time as a single pipeline.
+TEST(RxPipeline, SplitCores)
+{
+	std::mt19937 rng(1);
+	std::normal_distribution<double> noise(0, 600);
+	std::vector<int32_t> adc;
+	std::vector<SingleBus::Event> single, split;
+
+	for (size_t i = 0; i < 20; i++) {
+		std::vector<uint8_t> data(1 + rng() % MAX_PACKET_SIZE);
+		for (auto& d : data)
+			d = rng();
+		const std::vector<int32_t> p = genPacket(data, 5 + rng() % 30);
+		adc.insert(adc.end(), p.begin(), p.end());
+	}
+	for (auto& a : adc)
+		a += noise(rng);
+
+	SingleBus rx;
+	for (int32_t in : adc) {
+		SingleBus::Event ev;
+		if (rx.Update(in, &ev))
+			record(single, ev);
+	}
+
+	SingleBus front_back;
+	SpscRing<RxSample, RX_SPLIT_RING_LEN> ring;
+	std::thread back([&front_back, &ring, &split]() {
+		RxSample block[RX_SPLIT_BLOCK];
+		size_t len;
+
+		for (;;) {
+			while ((len = ring.Pop(block, RX_SPLIT_BLOCK)) == 0)
+				std::this_thread::yield();
+			for (size_t i = 0; i < len; i++) {
+				SingleBus::Event ev;
+
+				// End marker
+				if (block[i].Bit == INT32_MIN)
+					return;
+				front_back.UpdateBack(block[i], &ev);
+				record(split, ev);
+			}
+		}
+	});
+	RxSample block[RX_SPLIT_BLOCK];
+	size_t len = 0;
+	for (int32_t in : adc) {
+		if (!front_back.UpdateFront(in, &block[len]))
+			continue;
+		if (++len < RX_SPLIT_BLOCK)
+			continue;
+		while (!ring.Push(block, len))
+			std::this_thread::yield();
+		len = 0;
+	}
+	block[len++].Bit = INT32_MIN;
+	while (!ring.Push(block, len))
+		std::this_thread::yield();
+	back.join();
+
+	EXPECT_EQ(front_back.Samples(), rx.Samples());
+	ASSERT_EQ(split.size(), single.size());
+	size_t bytes = 0;
+	for (size_t i = 0; i < single.size(); i++) {
+		const SingleBus::Event& a = single[i];
+		const SingleBus::Event& b = split[i];
+
+		EXPECT_EQ(a.Line, b.Line) << "i = " << i;
+		EXPECT_EQ(a.Frame, b.Frame) << "i = " << i;
+		if (a.Frame && b.Frame) {
+			EXPECT_EQ(a.FrameStart, b.FrameStart) << "i = " << i;
+			EXPECT_EQ(a.FrameEnd, b.FrameEnd) << "i = " << i;
+		}
+		EXPECT_EQ(a.Byte, b.Byte) << "i = " << i;
+		if (a.Byte && b.Byte) {
+			EXPECT_EQ(a.Data, b.Data) << "i = " << i;
+			EXPECT_EQ(a.Error, b.Error) << "i = " << i;
+			EXPECT_EQ(a.ByteStart, b.ByteStart) << "i = " << i;
+		}
+		EXPECT_EQ(a.Correction, b.Correction) << "i = " << i;
+		bytes += a.Byte;
+	}
+	std::cerr << "[          ] " << single.size() << " events, " << bytes << " bytes" << std::endl;
+	EXPECT_GT(bytes, 20);
+}
+
+// Returns the time per ADC sample in ns
+template <class F>
+static double cpuTime(const std::vector<int32_t>& adc, F update)
+{
+	double best = 1e9;
+
+	for (int run = 0; run < 5; run++) {
+		auto t0 = std::chrono::steady_clock::now();
+		update(adc);
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / adc.size());
+	}
+	return best;
+}
+
+// Compares the CPU time of one bus with the time of two buses sharing the ADC.
+// The ADC delivers the same number of samples in both modes, the dual bus
+// mode runs the pipeline on every sample instead of every second.
+TEST(RxPipeline, Benchmark)
+{
+	std::mt19937 rng(1);
+	std::vector<uint8_t> data0(MAX_PACKET_SIZE), data1(MAX_PACKET_SIZE);
+	size_t bytes = 0;
+
+	for (auto& d : data0)
+		d = rng();
+	for (auto& d : data1)
+		d = rng();
+
+	const std::vector<int32_t> single = genPacket(data0, LEAD_BITS);
+	const std::vector<int32_t> dual = interleave(single, genPacket(data1, LEAD_BITS + 5));
+
+	const double ns_single = cpuTime(single, [&bytes](const std::vector<int32_t>& adc) {
+		SingleBus rx;
+		for (int32_t in : adc) {
+			SingleBus::Event ev;
+			if (rx.Update(in, &ev))
+				bytes += ev.Byte;
+		}
+	});
+	const double ns_dual = cpuTime(dual, [&bytes](const std::vector<int32_t>& adc) {
+		DualBusSplit split;
+		DualBus rx[2];
+		for (int32_t in : adc) {
+			DualBus::Event ev;
+			int32_t sample;
+			uint8_t bus;
+
+			split.Update(in, &sample, &bus);
+			if (rx[bus].Update(sample, &ev))
+				bytes += ev.Byte;
+		}
+	});
+	// Every run decodes both packets
+	EXPECT_EQ(bytes, 5 * MAX_PACKET_SIZE * 3);
+
+	std::cerr << "[          ] CPU: one bus " << ns_single << " ns, two buses " << ns_dual <<
+		" ns per ADC sample, " << ns_dual / ns_single << " times the time of one bus" << std::endl;
+}
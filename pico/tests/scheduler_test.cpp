@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+
+#include "scheduler.hpp"
+
+/* MOCK CLOCK */
+class VirtualClock
+{
+  public:
+	static uint32_t now;
+	// Time of the next simulated interrupt
+	static uint32_t irq_at;
+	static bool irq_armed;
+	// Set by the simulated interrupt, polled by a source
+	static bool irq_fired;
+	static uint32_t sleeps;
+
+	static uint32_t Now(void) {
+		return now;
+	}
+
+	// Sleep until deadline or the next interrupt
+	static void Sleep(uint32_t deadline) {
+		sleeps++;
+		if (irq_armed && (int32_t)(irq_at - deadline) < 0) {
+			if ((int32_t)(irq_at - now) > 0)
+				now = irq_at;
+			irq_armed = false;
+			irq_fired = true;
+		} else if ((int32_t)(deadline - now) > 0) {
+			now = deadline;
+		}
+	}
+
+	static void Reset(uint32_t start) {
+		now = start;
+		irq_armed = false;
+		irq_fired = false;
+		sleeps = 0;
+	}
+};
+
+uint32_t VirtualClock::now;
+uint32_t VirtualClock::irq_at;
+bool VirtualClock::irq_armed;
+bool VirtualClock::irq_fired;
+uint32_t VirtualClock::sleeps;
+
+typedef Scheduler<VirtualClock, 4> TestScheduler;
+
+struct Counter {
+	uint32_t runs;
+	uint32_t last;
+	// Time spent in the task
+	uint32_t work;
+};
+
+static void CountTask(void *ctx)
+{
+	Counter *c = (Counter *)ctx;
+	c->runs++;
+	c->last = VirtualClock::now;
+	VirtualClock::now += c->work;
+}
+
+static bool IrqSource(void *ctx)
+{
+	bool fired = VirtualClock::irq_fired;
+	VirtualClock::irq_fired = false;
+	return fired;
+}
+
+TEST(Scheduler, Deadline)
+{
+	TestScheduler s;
+	Counter c = {};
+	int id;
+
+	VirtualClock::Reset(0);
+	id = s.Add(CountTask, &c, 0);
+	ASSERT_GE(id, 0);
+
+	// Nothing to do, sleep for the maximum time
+	EXPECT_EQ(s.RunOnce(), 0);
+	EXPECT_EQ(VirtualClock::now, SCHEDULER_MAX_SLEEP_US);
+
+	s.SetDeadline(id, VirtualClock::now + 5000);
+	EXPECT_EQ(s.RunOnce(), 0);
+	EXPECT_EQ(c.runs, 0);
+	EXPECT_EQ(VirtualClock::now, SCHEDULER_MAX_SLEEP_US + 5000);
+
+	// Runs exactly once on the deadline
+	EXPECT_EQ(s.RunOnce(), 1);
+	EXPECT_EQ(c.runs, 1);
+	EXPECT_EQ(c.last, SCHEDULER_MAX_SLEEP_US + 5000);
+	EXPECT_EQ(s.RunOnce(), 0);
+	EXPECT_EQ(c.runs, 1);
+
+	EXPECT_EQ(s.Runs(), 1);
+	EXPECT_EQ(s.LatencyMax(), 0);
+
+	// Deadline in the past runs immediately
+	s.SetDeadline(id, VirtualClock::now - 10);
+	EXPECT_EQ(s.RunOnce(), 1);
+	EXPECT_EQ(s.LatencyMax(), 10);
+
+	s.SetDeadline(id, VirtualClock::now + 10);
+	s.ClearDeadline(id);
+	s.RunOnce();
+	EXPECT_EQ(c.runs, 2);
+}
+
+TEST(Scheduler, Signal)
+{
+	TestScheduler s;
+	Counter a = {}, b = {};
+
+	VirtualClock::Reset(1000);
+	s.Add(CountTask, &a, 1 << 0);
+	s.Add(CountTask, &b, (1 << 1) | (1 << 2));
+
+	s.Signal(1 << 2);
+	s.Signal(1 << 1);
+	VirtualClock::now += 30;
+	EXPECT_EQ(s.RunOnce(), 1);
+	EXPECT_EQ(a.runs, 0);
+	EXPECT_EQ(b.runs, 1);
+	// Latency is measured from the first signal
+	EXPECT_EQ(s.LatencyMax(), 30);
+	EXPECT_EQ(VirtualClock::sleeps, 0);
+
+	// Tasks run in order of registration, the second waits for the first
+	a.work = 50;
+	s.Signal((1 << 0) | (1 << 1));
+	EXPECT_EQ(s.RunOnce(), 2);
+	EXPECT_EQ(a.runs, 1);
+	EXPECT_EQ(b.runs, 2);
+	EXPECT_EQ(s.LatencyMax(), 50);
+	EXPECT_EQ(s.LatencyAvg(), (30 + 0 + 50) / 3);
+
+	s.ResetStats();
+	EXPECT_EQ(s.Runs(), 0);
+	EXPECT_EQ(s.LatencyMax(), 0);
+}
+
+TEST(Scheduler, Source)
+{
+	TestScheduler s;
+	Counter c = {};
+
+	VirtualClock::Reset(0);
+	s.Add(CountTask, &c, 1 << 3);
+	s.AddSource(IrqSource, nullptr, 1 << 3);
+
+	// The interrupt wakes the core before the maximum sleep time
+	VirtualClock::irq_at = 700;
+	VirtualClock::irq_armed = true;
+	EXPECT_EQ(s.RunOnce(), 0);
+	EXPECT_EQ(VirtualClock::now, 700);
+	EXPECT_EQ(s.RunOnce(), 1);
+	EXPECT_EQ(c.last, 700);
+	EXPECT_EQ(s.LatencyMax(), 0);
+}
+
+TEST(Scheduler, Wraparound)
+{
+	TestScheduler s;
+	Counter c = {};
+	int id;
+
+	VirtualClock::Reset(0xffffff00);
+	id = s.Add(CountTask, &c, 0);
+	s.SetDeadline(id, 0x100);
+
+	EXPECT_EQ(s.RunOnce(), 0);
+	EXPECT_EQ(VirtualClock::now, 0x100);
+	EXPECT_EQ(s.RunOnce(), 1);
+	EXPECT_EQ(c.runs, 1);
+	EXPECT_EQ(s.LatencyMax(), 0);
+}
+
+TEST(Scheduler, Full)
+{
+	TestScheduler s;
+
+	for (size_t i = 0; i < 4; i++) {
+		EXPECT_EQ(s.Add(CountTask, nullptr, 0), (int)i);
+		EXPECT_EQ(s.AddSource(IrqSource, nullptr, 0), true);
+	}
+	EXPECT_EQ(s.Add(CountTask, nullptr, 0), -1);
+	EXPECT_EQ(s.AddSource(IrqSource, nullptr, 0), false);
+}
+
+// Compares the latency of interrupt driven events against the 1 msec
+// polling loop used before.
+TEST(Scheduler, Latency)
+{
+	const size_t events = 1000;
+	TestScheduler s;
+	Counter c = {};
+	uint64_t polled_sum = 0;
+	uint32_t polled_max = 0;
+	uint32_t t = 0;
+
+	VirtualClock::Reset(0);
+	s.Add(CountTask, &c, 1);
+	s.AddSource(IrqSource, nullptr, 1);
+
+	srand(1);
+	for (size_t i = 0; i < events; i++) {
+		t += 1000 + rand() % 5000;
+
+		// Polling every msec handles the event on the next full msec
+		uint32_t polled = (t / 1000 + 1) * 1000 - t;
+		polled_sum += polled;
+		if (polled > polled_max)
+			polled_max = polled;
+
+		VirtualClock::irq_at = t;
+		VirtualClock::irq_armed = true;
+		while (c.runs == i)
+			s.RunOnce();
+		EXPECT_EQ(c.last, t);
+	}
+
+	std::cerr << "[          ] Polling:   avg " << polled_sum / events << " us, max " <<
+		polled_max << " us" << std::endl;
+	std::cerr << "[          ] Scheduler: avg " << s.LatencyAvg() << " us, max " <<
+		s.LatencyMax() << " us" << std::endl;
+
+	EXPECT_EQ(s.Runs(), events);
+	EXPECT_LT(s.LatencyMax(), polled_sum / events);
+}
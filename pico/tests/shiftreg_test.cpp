@@ -105,4 +105,20 @@ TEST(Shiftreg, Convolute)
 		result = ShiftReg<int16_t, 3>::Convolute<int16_t,int16_t, 3, 3>(s, t);
 		EXPECT_EQ(result, -1);
 	}
-}
\ No newline at end of file
+}
+
+TEST(Shiftreg, ConvoluteSymmetric)
+{
+	int32_t buf_a[7 * 2], buf_b[7 * 2], buf_c[6 * 2], buf_d[6 * 2];
+	const int32_t odd[7] = {-3, 5, 20, 31, 20, 5, -3};
+	const int32_t even[6] = {2, -7, 40, 40, -7, 2};
+	ShiftReg<int32_t, 7> a(buf_a), coeff_a(buf_b, odd);
+	ShiftReg<int32_t, 6> c(buf_c), coeff_c(buf_d, even);
+
+	for (int32_t i = 0; i < 100; i++) {
+		a.Update(i * 37 % 101 - 50);
+		c.Update(i * 53 % 89 - 44);
+		EXPECT_EQ(a.ConvoluteSymmetric(odd), (ShiftReg<int32_t, 7>::Convolute<int32_t, int32_t, 7, 7>(a, coeff_a)));
+		EXPECT_EQ(c.ConvoluteSymmetric(even), (ShiftReg<int32_t, 6>::Convolute<int32_t, int32_t, 6, 6>(c, coeff_c)));
+	}
+}
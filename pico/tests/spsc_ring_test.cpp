@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include <thread>
+
+#include "spsc_ring.hpp"
+
+TEST(SpscRing, PushPop)
+{
+	SpscRing<int32_t, 8> r;
+	const int32_t in[5] = {1, 2, 3, 4, 5};
+	int32_t out[8];
+
+	EXPECT_EQ(r.Length(), 0);
+	EXPECT_EQ(r.Pop(out, 8), 0);
+
+	EXPECT_EQ(r.Push(in, 5), true);
+	EXPECT_EQ(r.Length(), 5);
+	EXPECT_EQ(r.Pop(out, 2), 2);
+	EXPECT_EQ(out[0], 1);
+	EXPECT_EQ(out[1], 2);
+	EXPECT_EQ(r.Pop(out, 8), 3);
+	EXPECT_EQ(out[2], 5);
+	EXPECT_EQ(r.Length(), 0);
+}
+
+TEST(SpscRing, Wrap)
+{
+	SpscRing<int32_t, 8> r;
+	const int32_t in[5] = {1, 2, 3, 4, 5};
+	int32_t out[8];
+
+	for (int i = 0; i < 10; i++) {
+		ASSERT_EQ(r.Push(in, 5), true);
+		ASSERT_EQ(r.Pop(out, 8), 5);
+		for (int j = 0; j < 5; j++)
+			EXPECT_EQ(out[j], in[j]);
+	}
+	EXPECT_EQ(r.Dropped(), 0);
+}
+
+TEST(SpscRing, DropWholeBlocks)
+{
+	SpscRing<int32_t, 8> r;
+	const int32_t in[5] = {1, 2, 3, 4, 5};
+	int32_t out[8];
+
+	EXPECT_EQ(r.Push(in, 5), true);
+	// Doesn't fit, nothing is queued
+	EXPECT_EQ(r.Push(in, 5), false);
+	EXPECT_EQ(r.Length(), 5);
+	EXPECT_EQ(r.Dropped(), 1);
+	// Fits exactly
+	EXPECT_EQ(r.Push(in, 3), true);
+	EXPECT_EQ(r.Pop(out, 8), 8);
+	EXPECT_EQ(out[4], 5);
+	EXPECT_EQ(out[5], 1);
+}
+
+// A producer and a consumer thread must see every element exactly once
+// and in order.
+TEST(SpscRing, Threads)
+{
+	SpscRing<uint32_t, 64> r;
+	const uint32_t blocks = 10000;
+	uint32_t errors = 0;
+
+	std::thread consumer([&r, &errors]() {
+		uint32_t out[16];
+		uint32_t expected = 0;
+
+		while (expected < blocks * 4) {
+			const size_t n = r.Pop(out, 16);
+			if (n == 0)
+				std::this_thread::yield();
+			for (size_t i = 0; i < n; i++)
+				errors += out[i] != expected++;
+		}
+	});
+	for (uint32_t b = 0; b < blocks; b++) {
+		const uint32_t in[4] = {b * 4, b * 4 + 1, b * 4 + 2, b * 4 + 3};
+		while (!r.Push(in, 4))
+			std::this_thread::yield();
+	}
+	consumer.join();
+	EXPECT_EQ(errors, 0);
+	EXPECT_EQ(r.Length(), 0);
+}
@@ -0,0 +1,891 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "daikin_crc.hpp"
+#include "standalone.hpp"
+
+/* MOCK TIME */
+// time_reached() is mocked in tx_statemachine_test.cpp with a time close
+// to 0. Timeouts created with a negative base have expired already.
+static long base_us;
+
+absolute_time_t make_timeout_time_ms(long timeout)
+{
+	return base_us + timeout * 1000;
+}
+
+#define EXPIRED (-(1L << 40))
+
+// Switches ctrl to the operating state
+static void operating(StandaloneController& ctrl)
+{
+	base_us = EXPIRED;
+	ctrl.BusCollision();
+	ctrl.Check();
+	base_us = 0;
+	ctrl.Check();
+}
+
+// Returns a request of type to addr with a random payload
+static Message request(std::mt19937& rng, uint8_t addr, uint8_t type, uint8_t len)
+{
+	Message m;
+
+	m.Data[0] = P1P2_DAIKIN_CMD_REQUEST;
+	m.Data[1] = addr;
+	m.Data[2] = type;
+	for (size_t i = 3; i < len - 1u; i++)
+		m.Data[i] = rng() & 1 ? rng() : 0;
+	m.Data[len - 1] = DaikinCRC::Calc(m.Data, len - 1);
+	m.Length = len;
+	return m;
+}
+
+// Returns the answer to in, Length is 0 if there is none. The answer is
+// transmitted successfully, writes is set to the number of host messages
+// sent with it.
+static Message answer(StandaloneController& ctrl, const Message& in, uint8_t *writes = nullptr)
+{
+	Message out;
+	uint8_t w = 0;
+
+	ctrl.Receive(&in);
+	if (ctrl.HasTxData()) {
+		ctrl.TxAnswer(&out);
+		w = ctrl.TxDone(true).Writes;
+	}
+	if (writes)
+		*writes = w;
+	return out;
+}
+
+static void expectHeader(const Message& m, uint8_t addr, uint8_t type)
+{
+	EXPECT_EQ(m.Data[0], P1P2_DAIKIN_CMD_ANSWER);
+	EXPECT_EQ(m.Data[1], addr);
+	EXPECT_EQ(m.Data[2], type);
+	EXPECT_EQ(DaikinCRC::Valid(m.Data, m.Length), true);
+}
+
+TEST(Standalone, Sense)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	char line[] = "40f0350000000000000000000000000000000000000000";
+	Message cached(line);
+
+	operating(ctrl);
+	Message req = request(rng, 0xF0, 0x30, 18);
+	req.Data[7] = 0;
+	req.Data[req.Length - 1] = DaikinCRC::Calc(req.Data, req.Length - 1);
+
+	Message a = answer(ctrl, req);
+	ASSERT_EQ(a.Length, 18);
+	expectHeader(a, 0xF0, 0x30);
+	EXPECT_EQ(memcmp(&a.Data[3], &req.Data[3], 14), 0);
+
+	// A cached 35h packet is requested
+	EXPECT_EQ(ctrl.CacheTxMessage(cached), true);
+	a = answer(ctrl, req);
+	ASSERT_EQ(a.Length, 18);
+	expectHeader(a, 0xF0, 0x30);
+	EXPECT_EQ(a.Data[7], 1);
+
+	// Requests for other addresses are ignored
+	req = request(rng, 0xF1, 0x30, 18);
+	EXPECT_EQ(answer(ctrl, req).Length, 0);
+}
+
+TEST(Standalone, Status)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+
+	operating(ctrl);
+	const Message req = request(rng, 0xF0, 0x31, 16);
+	const Message a = answer(ctrl, req);
+	ASSERT_EQ(a.Length, 16);
+	expectHeader(a, 0xF0, 0x31);
+	EXPECT_EQ(a.Data[7], 0xB4);
+	EXPECT_EQ(a.Data[8], 0x10);
+	for (size_t i = 3; i < 15; i++) {
+		if (i != 7 && i != 8) {
+			EXPECT_EQ(a.Data[i], req.Data[i]) << "i = " << i;
+		}
+	}
+}
+
+TEST(Standalone, Null3xh)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+
+	operating(ctrl);
+	for (uint8_t type = 0x32; type <= 0x3f; type++) {
+		const Message a = answer(ctrl, request(rng, 0xF0, type, 20));
+		uint8_t len = 0;
+
+		if (type == 0x35 || type == 0x3a || type == 0x38 || type == 0x39 || type == 0x3d)
+			len = 22;
+		else if (type == 0x36 || type == 0x3b || type == 0x37 || type == 0x3c)
+			len = 24;
+		ASSERT_EQ(a.Length, len) << std::hex << (int)type;
+		if (!len)
+			continue;
+		expectHeader(a, 0xF0, type);
+		for (size_t i = 3; i < len - 1u; i++)
+			EXPECT_EQ(a.Data[i], 0xff);
+	}
+}
+
+TEST(Standalone, Cached3xh)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	// Address and CRC are filled in by the controller
+	char line[] = "40000000112233445566778899aabbccddeeff001122334400";
+	char other[] = "00001001810100000000150040000008000018004030006d";
+	Message cached(line), non3xh(other);
+
+	operating(ctrl);
+	cached.Data[2] = 0x33;
+	EXPECT_EQ(ctrl.CacheTxMessage(cached), true);
+	// Queued behind the first one
+	EXPECT_EQ(ctrl.CacheTxMessage(cached), true);
+
+	for (int i = 0; i < 2; i++) {
+		Message a = answer(ctrl, request(rng, 0xF0, 0x33, 20));
+		ASSERT_EQ(a.Length, cached.Length);
+		expectHeader(a, 0xF0, 0x33);
+		EXPECT_EQ(memcmp(&a.Data[3], &cached.Data[3], cached.Length - 4), 0);
+	}
+	// Sent once only
+	EXPECT_EQ(answer(ctrl, request(rng, 0xF0, 0x33, 20)).Length, 0);
+
+	// A non 3xh packet replaces the next answer
+	non3xh.Data[non3xh.Length - 1] = 0;
+	EXPECT_EQ(ctrl.CacheTxMessage(non3xh), true);
+	EXPECT_EQ(ctrl.Non3xhPacketWaitForTransmission(), true);
+	Message a = answer(ctrl, request(rng, 0xF0, 0x35, 22));
+	ASSERT_EQ(a.Length, non3xh.Length);
+	EXPECT_EQ(memcmp(a.Data, non3xh.Data, non3xh.Length - 1), 0);
+	EXPECT_EQ(DaikinCRC::Valid(a.Data, a.Length), true);
+	EXPECT_EQ(ctrl.Non3xhPacketWaitForTransmission(), false);
+}
+
+// Returns a host write of 35h with the 8 bit parameters in params
+static Message write35(const std::vector<std::pair<uint16_t, uint8_t>>& params)
+{
+	Message m;
+
+	m.Data[0] = P1P2_DAIKIN_CMD_ANSWER;
+	m.Data[1] = 0xF0;
+	m.Data[2] = 0x35;
+	memset(&m.Data[3], 0xff, 19);
+	for (size_t i = 0; i < params.size(); i++) {
+		m.Data[3 + i * 3] = params[i].first & 0xff;
+		m.Data[4 + i * 3] = params[i].first >> 8;
+		m.Data[5 + i * 3] = params[i].second;
+	}
+	m.Length = 22;
+	return m;
+}
+
+// Returns the value of param in the 35h packet m or -1
+static int param35(const Message& m, uint16_t param)
+{
+	for (size_t i = 3; i + 3 < m.Length; i += 3) {
+		if (m.Data[i] == (param & 0xff) && m.Data[i + 1] == (param >> 8))
+			return m.Data[i + 2];
+	}
+	return -1;
+}
+
+// Parameter writes to the same packet are merged, a later value of the
+// same parameter wins
+TEST(Standalone, Coalesce)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	uint8_t writes;
+
+	operating(ctrl);
+	for (int i = 0; i < 10; i++) {
+		Message w = write35({{0x0031, (uint8_t)i}});
+		EXPECT_EQ(ctrl.TxQueueFull(w), false);
+		EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	}
+	Message w = write35({{0x0032, 7}, {0x0040, 8}});
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+
+	Message a = answer(ctrl, request(rng, 0xF0, 0x35, 22), &writes);
+	ASSERT_EQ(a.Length, 22);
+	expectHeader(a, 0xF0, 0x35);
+	EXPECT_EQ(param35(a, 0x0031), 9);
+	EXPECT_EQ(param35(a, 0x0032), 7);
+	EXPECT_EQ(param35(a, 0x0040), 8);
+	EXPECT_EQ(param35(a, 0xffff), 0xff);
+	EXPECT_EQ(writes, 11);
+
+	// Nothing left
+	a = answer(ctrl, request(rng, 0xF0, 0x35, 22), &writes);
+	EXPECT_EQ(param35(a, 0x0031), -1);
+	EXPECT_EQ(writes, 0);
+}
+
+// Parameters that don't fit into the pending packet go into the next one
+TEST(Standalone, QueueFull)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	uint8_t writes;
+
+	operating(ctrl);
+	// 6 parameters fit into a 35h packet
+	for (uint16_t p = 0; p < 6 * CTRL_TX_QUEUE_LEN; p++) {
+		Message w = write35({{p, (uint8_t)p}});
+		ASSERT_EQ(ctrl.CacheTxMessage(w), true) << p;
+	}
+	Message w = write35({{0x100, 1}});
+	EXPECT_EQ(ctrl.TxQueueFull(w), true);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), false);
+	// Pending parameters can still be replaced
+	w = write35({{6 * CTRL_TX_QUEUE_LEN - 1, 0x55}});
+	EXPECT_EQ(ctrl.TxQueueFull(w), false);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+
+	// A failed transmission is repeated
+	const Message req = request(rng, 0xF0, 0x35, 22);
+	Message a;
+	ctrl.Receive(&req);
+	ASSERT_EQ(ctrl.HasTxData(), true);
+	ctrl.TxAnswer(&a);
+	EXPECT_EQ(ctrl.TxDone(false).Retry, true);
+
+	// The retry skips at most one request
+	a = answer(ctrl, req, &writes);
+	if (!writes)
+		a = answer(ctrl, req, &writes);
+	for (uint16_t n = 0; n < CTRL_TX_QUEUE_LEN; n++) {
+		if (n > 0)
+			a = answer(ctrl, req, &writes);
+		for (uint16_t p = n * 6; p < n * 6 + 6; p++)
+			EXPECT_EQ(param35(a, p), p == 6 * CTRL_TX_QUEUE_LEN - 1 ? 0x55 : p);
+		EXPECT_EQ(writes, n == CTRL_TX_QUEUE_LEN - 1 ? 7 : 6);
+	}
+}
+
+// A message for a full queue is held, the other queues still take messages
+TEST(Standalone, HoldFullQueue)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	char line[] = "40f0330102030405";
+	char other[] = "0000111098000000000000cf";
+	Message m33(line), non3xh(other);
+	uint8_t writes;
+
+	operating(ctrl);
+	for (uint16_t p = 0; p < 6 * CTRL_TX_QUEUE_LEN; p++) {
+		Message w = write35({{p, (uint8_t)p}});
+		ASSERT_EQ(ctrl.CacheTxMessage(w), true) << p;
+	}
+	const Message held = write35({{0x100, 1}});
+	EXPECT_EQ(ctrl.TxQueueFull(held), true);
+	EXPECT_EQ(ctrl.HoldTxMessage(held), true);
+
+	// Only one message is held per queue, the following ones wait for it
+	Message w = write35({{0x101, 2}});
+	EXPECT_EQ(ctrl.HoldTxMessage(w), false);
+	w = write35({{0, 0x55}});
+	EXPECT_EQ(ctrl.TxQueueFull(w), true);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), false);
+
+	// Other types are queued
+	EXPECT_EQ(ctrl.TxQueueFull(m33), false);
+	EXPECT_EQ(ctrl.CacheTxMessage(m33), true);
+	EXPECT_EQ(ctrl.TxQueueFull(non3xh), false);
+	EXPECT_EQ(ctrl.CacheTxMessage(non3xh), true);
+
+	Message a = answer(ctrl, request(rng, 0xF0, 0x33, 20), &writes);
+	EXPECT_EQ(a.Data[3], 0x01);
+	EXPECT_EQ(writes, 1);
+
+	// The held message is cached once the queue has room
+	for (uint16_t n = 0; n < CTRL_TX_QUEUE_LEN; n++) {
+		a = answer(ctrl, request(rng, 0xF0, 0x35, 22), &writes);
+		EXPECT_EQ(param35(a, n * 6), n * 6);
+		EXPECT_EQ(writes, 6);
+		// The following messages are merged again
+		if (n == 0) {
+			w = write35({{0x101, 2}});
+			EXPECT_EQ(ctrl.TxQueueFull(w), false);
+			EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+		}
+	}
+	a = answer(ctrl, request(rng, 0xF0, 0x35, 22), &writes);
+	EXPECT_EQ(param35(a, 0x100), 1);
+	EXPECT_EQ(param35(a, 0x101), 2);
+	EXPECT_EQ(writes, 2);
+	EXPECT_EQ(ctrl.Non3xhPacketWaitForTransmission(), true);
+}
+
+// The packet being transmitted isn't changed anymore
+TEST(Standalone, InFlight)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	Message w = write35({{0x0031, 1}});
+	Message a;
+
+	operating(ctrl);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	const Message req = request(rng, 0xF0, 0x35, 22);
+	ctrl.Receive(&req);
+	ctrl.TxAnswer(&a);
+	w = write35({{0x0031, 2}});
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	EXPECT_EQ(ctrl.TxDone(true).Writes, 1);
+	EXPECT_EQ(param35(a, 0x0031), 1);
+
+	a = answer(ctrl, req);
+	EXPECT_EQ(param35(a, 0x0031), 2);
+}
+
+// Answers req until the answer carries a host message and finishes its
+// transmission with ok. skipped is set to the requests answered before.
+static StandaloneController::TxResult attempt(StandaloneController& ctrl, const Message& req,
+	bool ok, size_t *skipped)
+{
+	Message a;
+
+	for (*skipped = 0; *skipped < 100; (*skipped)++) {
+		ctrl.Receive(&req);
+		EXPECT_EQ(ctrl.HasTxData(), true);
+		ctrl.TxAnswer(&a);
+		if (a.Data[3] != 0xff)
+			break;
+		EXPECT_EQ(ctrl.TxDone(true).Writes, 0);
+	}
+	return ctrl.TxDone(ok);
+}
+
+// A failed packet is sent again after a random backoff
+TEST(Standalone, Retry)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	const Message req = request(rng, 0xF0, 0x35, 22);
+	Message w = write35({{0x0031, 1}});
+	StandaloneController::TxResult r;
+	size_t skipped;
+
+	operating(ctrl);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	for (uint8_t n = 1; n < CTRL_TX_ATTEMPTS; n++) {
+		r = attempt(ctrl, req, false, &skipped);
+		EXPECT_LT(skipped, 1u << (n - 1));
+		EXPECT_EQ(r.Retry, true);
+		EXPECT_EQ(r.Writes, 1);
+		EXPECT_EQ(r.Attempts, n);
+	}
+	r = attempt(ctrl, req, true, &skipped);
+	EXPECT_LT(skipped, 1u << (CTRL_TX_ATTEMPTS - 1));
+	EXPECT_EQ(r.Retry, false);
+	EXPECT_EQ(r.Writes, 1);
+	EXPECT_EQ(r.Attempts, CTRL_TX_ATTEMPTS);
+	EXPECT_EQ(answer(ctrl, req).Data[3], 0xff);
+}
+
+// A packet is dropped after CTRL_TX_ATTEMPTS failures
+TEST(Standalone, RetryDrop)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	const Message req = request(rng, 0xF0, 0x35, 22);
+	Message w = write35({{0x0031, 1}});
+	StandaloneController::TxResult r;
+	size_t skipped;
+
+	operating(ctrl);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	w = write35({{0x0032, 2}});
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	for (uint8_t n = 1; n <= CTRL_TX_ATTEMPTS; n++)
+		r = attempt(ctrl, req, false, &skipped);
+	EXPECT_EQ(r.Retry, false);
+	EXPECT_EQ(r.Writes, 2);
+	EXPECT_EQ(r.Attempts, CTRL_TX_ATTEMPTS);
+	EXPECT_EQ(answer(ctrl, req).Data[3], 0xff);
+
+	// The answers without host messages aren't retried
+	ctrl.Receive(&req);
+	ctrl.TxAnswer(&w);
+	r = ctrl.TxDone(false);
+	EXPECT_EQ(r.Retry, false);
+	EXPECT_EQ(r.Writes, 0);
+}
+
+// A cancelled answer is sent on the next request without counting an attempt
+TEST(Standalone, TxCancel)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	const Message req = request(rng, 0xF0, 0x35, 22);
+	Message w = write35({{0x0031, 1}});
+	Message a;
+
+	operating(ctrl);
+	EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+	ctrl.Receive(&req);
+	ctrl.TxAnswer(&a);
+	ctrl.TxCancel();
+	EXPECT_EQ(ctrl.TxDone(true).Writes, 0);
+
+	ctrl.Receive(&req);
+	ctrl.TxAnswer(&a);
+	EXPECT_EQ(param35(a, 0x0031), 1);
+	StandaloneController::TxResult r = ctrl.TxDone(true);
+	EXPECT_EQ(r.Writes, 1);
+	EXPECT_EQ(r.Attempts, 1);
+}
+
+// Streams host writes while collisions hit a share of the transmissions.
+// Every host message gets exactly one final outcome.
+TEST(Standalone, RetryCollisions)
+{
+	std::mt19937 rng(1);
+	std::bernoulli_distribution collision(0.3);
+	StandaloneController ctrl;
+	const Message req = request(rng, 0xF0, 0x36, 24);
+	size_t queued = 0, acked = 0, dropped = 0, attempts = 0, packets = 0, requests = 0;
+
+	operating(ctrl);
+	while (acked + dropped < 500 && requests < 10000) {
+		// One new parameter per request, 7 fit into a 36h packet
+		if (queued < 500) {
+			Message w;
+			w.Data[0] = P1P2_DAIKIN_CMD_ANSWER;
+			w.Data[1] = 0xF0;
+			w.Data[2] = 0x36;
+			memset(&w.Data[3], 0xff, 20);
+			w.Data[3] = queued & 0xff;
+			w.Data[4] = queued >> 8;
+			w.Data[5] = 1;
+			w.Data[6] = 0;
+			w.Length = 24;
+			if (!ctrl.TxQueueFull(w)) {
+				EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+				queued++;
+			}
+		}
+		requests++;
+		ctrl.Receive(&req);
+		if (!ctrl.HasTxData())
+			continue;
+		Message a;
+		ctrl.TxAnswer(&a);
+		const bool ok = !collision(rng);
+		StandaloneController::TxResult r = ctrl.TxDone(ok);
+		if (!r.Writes || r.Retry)
+			continue;
+		EXPECT_LE(r.Attempts, CTRL_TX_ATTEMPTS);
+		packets++;
+		attempts += r.Attempts;
+		if (ok)
+			acked += r.Writes;
+		else
+			dropped += r.Writes;
+	}
+	std::cerr << "[          ] " << requests << " requests, " << packets << " packets, " <<
+		(double)attempts / packets << " attempts per packet, " << acked << " writes acked, " <<
+		dropped << " dropped" << std::endl;
+	EXPECT_EQ(queued, 500);
+	EXPECT_EQ(acked + dropped, 500);
+	// Without retries 30% would be lost
+	EXPECT_LT(dropped * 20, 500);
+}
+
+// Packets of an unknown layout and non 3xh packets are queued as they are
+TEST(Standalone, QueueWhole)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	char line[] = "40f0330102030405";
+	char other[] = "0000111098000000000000cf";
+	Message m33(line), non3xh(other);
+	uint8_t writes;
+
+	operating(ctrl);
+	for (int i = 0; i < CTRL_TX_QUEUE_LEN; i++) {
+		m33.Data[3] = i;
+		EXPECT_EQ(ctrl.CacheTxMessage(m33), true);
+		non3xh.Data[3] = i;
+		EXPECT_EQ(ctrl.CacheTxMessage(non3xh), true);
+	}
+	EXPECT_EQ(ctrl.TxQueueFull(m33), true);
+	EXPECT_EQ(ctrl.TxQueueFull(non3xh), true);
+	EXPECT_EQ(ctrl.CacheTxMessage(non3xh), false);
+
+	for (int i = 0; i < CTRL_TX_QUEUE_LEN; i++) {
+		Message a = answer(ctrl, request(rng, 0xF0, 0x33, 20), &writes);
+		EXPECT_EQ(a.Data[2], 0x33);
+		EXPECT_EQ(a.Data[3], i);
+		EXPECT_EQ(writes, 1);
+		a = answer(ctrl, request(rng, 0xF0, 0x35, 22), &writes);
+		EXPECT_EQ(a.Data[2], 0x11);
+		EXPECT_EQ(a.Data[3], i);
+		EXPECT_EQ(writes, 1);
+	}
+	EXPECT_EQ(ctrl.Non3xhPacketWaitForTransmission(), false);
+}
+
+// The prepared answers follow a change of the address
+TEST(Standalone, AddressChange)
+{
+	std::mt19937 rng(1);
+	char line[] = "40f0360000000000000000000000000000000000000000000000";
+	Message cached(line);
+
+	base_us = EXPIRED;
+	StandaloneController ctrl;
+	EXPECT_EQ(ctrl.CacheTxMessage(cached), true);
+
+	// Another external controller answers on 0xF0 during the bus scan
+	base_us = 0;
+	ctrl.Check();
+	Message conflict = request(rng, 0xF0, 0x30, 18);
+	conflict.Data[0] = P1P2_DAIKIN_CMD_ANSWER;
+	conflict.Data[17] = DaikinCRC::Calc(conflict.Data, 17);
+	ctrl.Receive(&conflict);
+	operating(ctrl);
+
+	EXPECT_EQ(answer(ctrl, request(rng, 0xF0, 0x30, 18)).Length, 0);
+	expectHeader(answer(ctrl, request(rng, 0xF1, 0x30, 18)), 0xF1, 0x30);
+	expectHeader(answer(ctrl, request(rng, 0xF1, 0x31, 16)), 0xF1, 0x31);
+	expectHeader(answer(ctrl, request(rng, 0xF1, 0x36, 24)), 0xF1, 0x36);
+	expectHeader(answer(ctrl, request(rng, 0xF1, 0x35, 22)), 0xF1, 0x35);
+}
+
+// Replays a bus log on ctrl. The lines hold the packets without CRC.
+// ctrl transmits its answer to a request unless another device answered
+// first, the echo is received like on the bus. Returns the answers of ctrl.
+static std::vector<Message> replay(StandaloneController& ctrl, const std::vector<const char *>& log)
+{
+	std::vector<Message> sent;
+
+	for (size_t i = 0; i < log.size(); i++) {
+		char line[128];
+		strcpy(line, log[i]);
+		Message m(line);
+		m.Data[m.Length] = DaikinCRC::Calc(m.Data, m.Length);
+		m.Length++;
+
+		ctrl.Receive(&m);
+		ctrl.Check();
+		if (i + 1 < log.size() && log[i + 1][0] == '4')
+			continue;
+		if (ctrl.HasTxData()) {
+			Message a;
+			ctrl.TxAnswer(&a);
+			ctrl.Receive(&a);
+			ctrl.TxDone(true);
+			sent.push_back(a);
+		}
+	}
+	return sent;
+}
+
+// One cycle of the external controller requests on address 0xF0
+static const std::vector<const char *> cycle = {
+	"400010000000000000000000000000000000000000",
+	"00f030 0000000000000000000000000000",
+	"00f031 000000000000000000000000",
+	"00f035 ffffffffffffffffffffffffffffffffffff",
+};
+
+static void expectAnswers(const std::vector<Message>& sent, size_t n, uint8_t addr)
+{
+	ASSERT_EQ(sent.size(), n);
+	for (const Message& m : sent) {
+		EXPECT_EQ(m.Data[1], addr);
+		EXPECT_EQ(DaikinCRC::Valid(m.Data, m.Length), true);
+	}
+}
+
+// The echo of our own answers isn't a conflict
+TEST(Standalone, ReplayNoConflict)
+{
+	StandaloneController ctrl;
+
+	operating(ctrl);
+	for (int i = 0; i < 5; i++)
+		expectAnswers(replay(ctrl, cycle), 3, 0xF0);
+}
+
+// The operation isn't interrupted by periodic bus scans
+TEST(Standalone, ReplayNoScan)
+{
+	StandaloneController ctrl;
+
+	operating(ctrl);
+	base_us = EXPIRED;
+	ctrl.Check();
+	ctrl.Check();
+	base_us = 0;
+	expectAnswers(replay(ctrl, cycle), 3, 0xF0);
+}
+
+// Another external controller on 0xF0 answers before us
+TEST(Standalone, ReplayCompetitorFirst)
+{
+	StandaloneController ctrl;
+
+	operating(ctrl);
+	expectAnswers(replay(ctrl, cycle), 3, 0xF0);
+	// No answer on the old address, not even to the request the competitor
+	// answered
+	expectAnswers(replay(ctrl, {
+		"00f030 0000000000000000000000000000",
+		"40f030 0000000000000000000000000000 # competitor",
+		"00f031 000000000000000000000000",
+		"40f031 000000000000000000000000 # competitor",
+	}), 0, 0xF1);
+	// The main controller polls the new address, answered right away
+	expectAnswers(replay(ctrl, {
+		"00f130 0000000000000000000000000000",
+		"00f131 000000000000000000000000",
+		"00f135 ffffffffffffffffffffffffffffffffffff",
+		"00f030 0000000000000000000000000000",
+		"40f030 0000000000000000000000000000 # competitor",
+	}), 3, 0xF1);
+}
+
+// Another external controller on 0xF0 answers after us
+TEST(Standalone, ReplayCompetitorLate)
+{
+	StandaloneController ctrl;
+
+	operating(ctrl);
+	expectAnswers(replay(ctrl, {"00f030 0000000000000000000000000000"}), 1, 0xF0);
+	// The competitor answers once the bus is free
+	expectAnswers(replay(ctrl, {
+		"40f030 0000000000000000000000000000 # competitor",
+		"00f130 0000000000000000000000000000",
+	}), 1, 0xF1);
+}
+
+// One cycle of the external controller requests on address 0xF1
+static const std::vector<const char *> cycleF1 = {
+	"400010000000000000000000000000000000000000",
+	"00f130 0000000000000000000000000000",
+	"00f131 000000000000000000000000",
+	"00f135 ffffffffffffffffffffffffffffffffffff",
+};
+
+// Both addresses are served, each in its own cycle
+TEST(Standalone, TwoAddresses)
+{
+	StandaloneController ctrl(2);
+
+	operating(ctrl);
+	EXPECT_EQ(ctrl.Address(0), 0xF0);
+	EXPECT_EQ(ctrl.Address(1), 0xF1);
+	for (int i = 0; i < 3; i++) {
+		expectAnswers(replay(ctrl, cycle), 3, 0xF0);
+		expectAnswers(replay(ctrl, cycleF1), 3, 0xF1);
+	}
+}
+
+// Host writes to 0xF1 are sent in the cycle of the second address
+TEST(Standalone, TwoAddressesWrites)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl(2), single;
+	Message w0 = write35({{0x0031, 1}});
+	Message w1 = write35({{0x0031, 2}});
+	uint8_t writes;
+
+	w1.Data[1] = 0xF1;
+	operating(ctrl);
+	EXPECT_EQ(ctrl.CacheTxMessage(w0), true);
+	EXPECT_EQ(ctrl.CacheTxMessage(w1), true);
+	Message a = answer(ctrl, request(rng, 0xF1, 0x35, 22), &writes);
+	expectHeader(a, 0xF1, 0x35);
+	EXPECT_EQ(param35(a, 0x0031), 2);
+	EXPECT_EQ(writes, 1);
+	a = answer(ctrl, request(rng, 0xF0, 0x35, 22), &writes);
+	expectHeader(a, 0xF0, 0x35);
+	EXPECT_EQ(param35(a, 0x0031), 1);
+	EXPECT_EQ(writes, 1);
+
+	// A single address sends both in its own cycle
+	operating(single);
+	EXPECT_EQ(single.CacheTxMessage(w0), true);
+	EXPECT_EQ(single.CacheTxMessage(w1), true);
+	EXPECT_EQ(answer(single, request(rng, 0xF1, 0x35, 22)).Length, 0);
+	a = answer(single, request(rng, 0xF0, 0x35, 22), &writes);
+	expectHeader(a, 0xF0, 0x35);
+	EXPECT_EQ(param35(a, 0x0031), 2);
+	EXPECT_EQ(writes, 2);
+}
+
+// A taken address isn't served
+TEST(Standalone, TwoAddressesTaken)
+{
+	StandaloneController ctrl(2);
+
+	operating(ctrl);
+	expectAnswers(replay(ctrl, {
+		"00f130 0000000000000000000000000000",
+		"40f130 0000000000000000000000000000 # competitor",
+	}), 0, 0xF1);
+	EXPECT_EQ(ctrl.Address(0), 0xF0);
+	EXPECT_EQ(ctrl.Address(1), 0);
+	expectAnswers(replay(ctrl, cycle), 3, 0xF0);
+	expectAnswers(replay(ctrl, cycleF1), 0, 0xF1);
+
+	// The bus scan skips the taken address
+	operating(ctrl);
+	EXPECT_EQ(ctrl.Address(0), 0xF0);
+	EXPECT_EQ(ctrl.Address(1), 0);
+}
+
+// Returns the number of polling rounds of both addresses needed to transmit
+// packets full 35h packets. The host spreads its writes over the addresses.
+static size_t rounds(uint8_t addresses, size_t packets)
+{
+	StandaloneController ctrl(addresses);
+	size_t queued = 0, sent = 0, r;
+
+	operating(ctrl);
+	for (r = 0; sent < packets && r < 100; r++) {
+		for (int n = 0; n < 2; n++) {
+			while (queued < packets) {
+				std::vector<std::pair<uint16_t, uint8_t>> params;
+				for (uint16_t p = 0; p < 6; p++)
+					params.push_back({queued * 6 + p, 1});
+				Message w = write35(params);
+				w.Data[1] = 0xF0 + queued % 2;
+				if (ctrl.TxQueueFull(w))
+					break;
+				EXPECT_EQ(ctrl.CacheTxMessage(w), true);
+				queued++;
+			}
+			for (const Message& m : replay(ctrl, n ? cycleF1 : cycle))
+				sent += m.Data[2] == 0x35 && m.Data[3] != 0xff;
+		}
+	}
+	return r;
+}
+
+TEST(Standalone, TwoAddressesThroughput)
+{
+	const size_t one = rounds(1, 16), two = rounds(2, 16);
+
+	std::cerr << "[          ] 16 packets: " << one << " rounds on one address, " <<
+		two << " rounds on two addresses" << std::endl;
+	EXPECT_EQ(one, 16);
+	EXPECT_EQ(two, 8);
+}
+
+// Builds the answer to a 30h request at request time with the bitwise CRC
+// as done before the answers were prepared.
+static void referenceSense(const Message& in, Message *out)
+{
+	out->Data[0] = P1P2_DAIKIN_CMD_ANSWER;
+	out->Data[1] = in.Data[1];
+	out->Data[2] = P1P2_DAIKIN_TYPE_SENSE_EXT_CTRL;
+	for (int i = 3; i < 17; i++)
+		out->Data[i] = in.Data[i];
+	out->Length = 18;
+
+	uint8_t crc = 0;
+	for (int i = 0; i < out->Length - 1; i++)
+		crc = DaikinCRC::UpdateBitwise(crc, out->Data[i]);
+	out->Data[out->Length - 1] = crc;
+}
+
+// Same for the NULL answer to a 3xh request
+static void referenceNull(const Message& in, Message *out)
+{
+	const uint8_t type = in.Data[2];
+	int len;
+
+	if (type == 0x35 || type == 0x3a || type == 0x38 || type == 0x39 || type == 0x3d)
+		len = 22;
+	else if (type == 0x36 || type == 0x3b || type == 0x37 || type == 0x3c)
+		len = 24;
+	else
+		return;
+	out->Data[0] = P1P2_DAIKIN_CMD_ANSWER;
+	out->Data[1] = in.Data[1];
+	out->Data[2] = type;
+	for (int i = 3; i < len - 1; i++)
+		out->Data[i] = 0xff;
+	out->Length = len;
+
+	uint8_t crc = 0;
+	for (int i = 0; i < out->Length - 1; i++)
+		crc = DaikinCRC::UpdateBitwise(crc, out->Data[i]);
+	out->Data[out->Length - 1] = crc;
+}
+
+// Returns the time from a valid request to the answer being ready for the
+// transmitter in ns
+template <class F>
+static double latency(const Message& req, F f)
+{
+	const size_t runs = 100000;
+	double best = 1e9;
+	uint32_t sink = 0;
+
+	for (int run = 0; run < 5; run++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < runs; i++) {
+			Message out;
+			f(req, &out);
+			sink += out.Data[out.Length - 1];
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / runs);
+	}
+	EXPECT_NE(sink, 1);
+	return best;
+}
+
+TEST(Standalone, Latency)
+{
+	std::mt19937 rng(1);
+	StandaloneController ctrl;
+	auto prepared = [&ctrl](const Message& in, Message *out) {
+		ctrl.GenerateAnswer(&in);
+		ctrl.TxAnswer(out);
+	};
+
+	operating(ctrl);
+	const Message sense = request(rng, 0xF0, 0x30, 18);
+	const Message null = request(rng, 0xF0, 0x36, 24);
+	Message a, b;
+
+	// Both give the same answers
+	prepared(sense, &a);
+	referenceSense(sense, &b);
+	ASSERT_EQ(a.Length, b.Length);
+	EXPECT_EQ(memcmp(a.Data, b.Data, a.Length), 0);
+	prepared(null, &a);
+	referenceNull(null, &b);
+	ASSERT_EQ(a.Length, b.Length);
+	EXPECT_EQ(memcmp(a.Data, b.Data, a.Length), 0);
+
+	const double sense_ref = latency(sense, referenceSense);
+	const double sense_prep = latency(sense, prepared);
+	const double null_ref = latency(null, referenceNull);
+	const double null_prep = latency(null, prepared);
+	std::cerr << "[          ] 30h: at request time " << sense_ref << " ns, prepared " <<
+		sense_prep << " ns" << std::endl;
+	std::cerr << "[          ] 3xh NULL: at request time " << null_ref << " ns, prepared " <<
+		null_prep << " ns" << std::endl;
+}
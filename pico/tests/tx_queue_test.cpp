@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include "tx_queue.hpp"
+
+struct Events {
+	size_t started;
+	size_t done;
+	size_t aborted;
+	uint8_t last;
+};
+
+static void callback(const Message& m, const enum TxQueue<4>::EVENT ev, void *ctx)
+{
+	Events *e = (Events *)ctx;
+
+	switch (ev) {
+	case TxQueue<4>::EVENT_STARTED:
+		e->started++;
+		break;
+	case TxQueue<4>::EVENT_DONE:
+		e->done++;
+		break;
+	case TxQueue<4>::EVENT_ABORTED:
+		e->aborted++;
+		break;
+	}
+	e->last = m.Data[0];
+}
+
+static Message packet(uint8_t id)
+{
+	uint8_t data[3] = {id, 0xf0, 0x30};
+	return Message(0, data, sizeof(data));
+}
+
+TEST(TxQueue, Single)
+{
+	TxQueue<4> q(5000);
+	Events ev = {};
+	uint32_t next;
+	const Message *m;
+
+	EXPECT_EQ(q.Update(0, false, &next), nullptr);
+	EXPECT_EQ(next, 0);
+
+	EXPECT_EQ(q.Push(packet(1), callback, &ev), true);
+	m = q.Update(100, false, &next);
+	ASSERT_NE(m, nullptr);
+	EXPECT_EQ(m->Data[0], 1);
+	EXPECT_EQ(ev.started, 1);
+	EXPECT_EQ(next, 100 + TX_QUEUE_POLL_US);
+
+	// Hardware is transmitting
+	EXPECT_EQ(q.Update(next, true, &next), nullptr);
+	EXPECT_EQ(ev.done, 0);
+	EXPECT_EQ(q.Empty(), false);
+
+	// Done, wait for the gap to end
+	EXPECT_EQ(q.Update(4000, false, &next), nullptr);
+	EXPECT_EQ(ev.done, 1);
+	EXPECT_EQ(ev.last, 1);
+	EXPECT_EQ(q.Empty(), true);
+	EXPECT_EQ(next, 9000);
+
+	EXPECT_EQ(q.Update(next, false, &next), nullptr);
+	EXPECT_EQ(next, 0);
+}
+
+// A burst of packets goes out without the caller being involved
+TEST(TxQueue, Burst)
+{
+	const uint32_t gap = 5000;
+	TxQueue<4> q(gap);
+	Events ev = {};
+	uint32_t next, now = 1000;
+	uint32_t end = 0, busy_until = 0;
+	uint8_t expected = 1;
+	const Message *m;
+
+	for (uint8_t i = 1; i <= 4; i++)
+		EXPECT_EQ(q.Push(packet(i), callback, &ev), true);
+	EXPECT_EQ(q.Push(packet(5), callback, &ev), false);
+	EXPECT_EQ(q.Length(), 4);
+
+	// Simulate the hardware. Every packet takes 3 bytes * 1.15 msec.
+	next = now;
+	while (next) {
+		now = next;
+		m = q.Update(now, now < busy_until, &next);
+		if (m) {
+			EXPECT_EQ(m->Data[0], expected++);
+			if (end) {
+				EXPECT_GE(now - end, gap);
+			}
+			busy_until = now + m->Length * 1146;
+			end = busy_until;
+		}
+	}
+	EXPECT_EQ(ev.started, 4);
+	EXPECT_EQ(ev.done, 4);
+	EXPECT_EQ(q.Empty(), true);
+}
+
+// The gap is kept for packets pushed after the queue became empty
+TEST(TxQueue, GapAfterEmpty)
+{
+	TxQueue<4> q(5000);
+	Events ev = {};
+	uint32_t next;
+
+	q.Push(packet(1), callback, &ev);
+	EXPECT_NE(q.Update(0, false, &next), nullptr);
+	EXPECT_EQ(q.Update(3000, false, &next), nullptr);
+	EXPECT_EQ(next, 8000);
+
+	q.Push(packet(2), callback, &ev);
+	EXPECT_EQ(q.Update(4000, false, &next), nullptr);
+	EXPECT_EQ(next, 8000);
+	EXPECT_NE(q.Update(8000, false, &next), nullptr);
+	EXPECT_EQ(ev.started, 2);
+
+	// Time wraps around
+	q.SetGap(0x200);
+	EXPECT_EQ(q.Update(0xffffff00, false, &next), nullptr);
+	EXPECT_EQ(next, 0x100);
+}
+
+TEST(TxQueue, Abort)
+{
+	TxQueue<4> q(5000);
+	Events ev = {};
+	uint32_t next;
+
+	q.Push(packet(1), callback, &ev);
+	q.Push(packet(2), callback, &ev);
+	EXPECT_NE(q.Update(0, false, &next), nullptr);
+
+	q.Abort();
+	EXPECT_EQ(ev.aborted, 2);
+	EXPECT_EQ(ev.done, 0);
+	EXPECT_EQ(q.Empty(), true);
+
+	// No callback
+	q.Push(packet(3), nullptr, nullptr);
+	EXPECT_NE(q.Update(100, false, &next), nullptr);
+	EXPECT_EQ(q.Update(200, false, &next), nullptr);
+	EXPECT_EQ(q.Empty(), true);
+}
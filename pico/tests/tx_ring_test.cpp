@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include "tx_ring.hpp"
+
+static bool push(TxRing<16>& r, const char *str)
+{
+	return r.Push((const uint8_t *)str, strlen(str));
+}
+
+TEST(TxRing, PushConsume)
+{
+	TxRing<16> r;
+
+	EXPECT_EQ(r.Length(), 0);
+	EXPECT_EQ(r.Free(), 16);
+
+	EXPECT_EQ(push(r, "0102\r\n"), true);
+	EXPECT_EQ(r.Length(), 6);
+	EXPECT_EQ(r.Contiguous(), 6);
+	EXPECT_EQ(memcmp(r.ReadPtr(), "0102\r\n", 6), 0);
+
+	r.Consume(4);
+	EXPECT_EQ(r.Length(), 2);
+	EXPECT_EQ(memcmp(r.ReadPtr(), "\r\n", 2), 0);
+	r.Consume(2);
+	EXPECT_EQ(r.Length(), 0);
+	EXPECT_EQ(r.Sent(), 6);
+	EXPECT_EQ(r.Dropped(), 0);
+}
+
+TEST(TxRing, Wrap)
+{
+	TxRing<16> r;
+
+	EXPECT_EQ(push(r, "0123456789ab"), true);
+	r.Consume(12);
+
+	// Message wraps at the end of the buffer
+	EXPECT_EQ(push(r, "cdefghij"), true);
+	EXPECT_EQ(r.Length(), 8);
+	EXPECT_EQ(r.Contiguous(), 4);
+	EXPECT_EQ(memcmp(r.ReadPtr(), "cdef", 4), 0);
+	r.Consume(4);
+	EXPECT_EQ(r.Contiguous(), 4);
+	EXPECT_EQ(memcmp(r.ReadPtr(), "ghij", 4), 0);
+	r.Consume(4);
+	EXPECT_EQ(r.Length(), 0);
+}
+
+TEST(TxRing, DropWholeMessages)
+{
+	TxRing<16> r;
+
+	EXPECT_EQ(push(r, "0123456789"), true);
+	// Doesn't fit, nothing is queued
+	EXPECT_EQ(push(r, "abcdefgh"), false);
+	EXPECT_EQ(r.Length(), 10);
+	EXPECT_EQ(r.Dropped(), 1);
+	// Fits exactly
+	EXPECT_EQ(push(r, "abcdef"), true);
+	EXPECT_EQ(r.Free(), 0);
+
+	// Disconnected consumer
+	r.Discard();
+	EXPECT_EQ(r.Length(), 0);
+	EXPECT_EQ(r.Dropped(), 2);
+	r.Discard();
+	EXPECT_EQ(r.Dropped(), 2);
+}
+
+// A slow consumer doesn't affect the other interface
+TEST(TxRing, Independent)
+{
+	TxRing<16> fast;
+	TxRing<16> slow;
+
+	for (size_t i = 0; i < 10; i++) {
+		EXPECT_EQ(push(fast, "0102\r\n"), true);
+		push(slow, "0102\r\n");
+		fast.Consume(fast.Length());
+	}
+	EXPECT_EQ(fast.Dropped(), 0);
+	EXPECT_EQ(fast.Sent(), 60);
+	EXPECT_EQ(slow.Dropped(), 8);
+	EXPECT_EQ(slow.Length(), 12);
+}
@@ -97,9 +97,10 @@ TEST(TxStateMachine, LineIsBusyForTooLong)
 
 TEST(TxStateMachine, States)
 {
+	uint8_t data[8] = {1, 1, 1, 1, 1, 1, 1, 1};
 	UARTPio Pio;
 	TxStateMachine SM(Pio);
-	Message Msg;
+	Message Msg(0, data, sizeof(data));
 	size_t i;
 
 	mock_reset_timebase();
@@ -131,7 +132,10 @@ TEST(TxStateMachine, States)
 
 	for (i = 0; i < 8; i++) {
 		SM.Update(true, false, true, 1);
-		EXPECT_EQ(SM.GetState(), TxState::RUNNING_CHECK_DATA);
+		if (i < 7)
+			EXPECT_EQ(SM.GetState(), TxState::RUNNING_CHECK_DATA);
+		else
+			EXPECT_EQ(SM.GetState(), TxState::RUNNING_WAIT_FOR_IDLE);
 		SM.Update(true, false, false, 0);
 		mock_add_usec_to_now(100);
 	}
@@ -140,4 +144,185 @@ TEST(TxStateMachine, States)
 
 	SM.Update(false, false, false, 0);
 	EXPECT_EQ(SM.GetState(), TxState::IDLE);
-}
\ No newline at end of file
+}
+
+// Runs a transmission of Msg starting on an idle line.
+// Returns the time in usec between line free and sending the first byte.
+static long transmit(TxStateMachine& SM, UARTPio& Pio, Message& Msg)
+{
+	size_t sent = Pio.MokSent();
+	long start;
+
+	SM.WakeAndTransmit(Msg);
+	SM.Update(true, false, false, 0);
+	EXPECT_EQ(SM.GetState(), TxState::IDLE_WAIT_LINEFREE);
+
+	// Line becomes free
+	start = now;
+	while (Pio.MokSent() == sent && now - start < 100000) {
+		SM.Update(false, false, false, 0);
+		if (Pio.MokSent() == sent)
+			mock_add_usec_to_now(100);
+	}
+	EXPECT_EQ(SM.GetState(), TxState::STARTED_WAIT_FOR_BUSY);
+	EXPECT_EQ(Pio.MokShutdown(), false);
+	long latency = now - start;
+
+	for (size_t i = 0; i < Msg.Length; i++) {
+		SM.Update(true, false, true, Msg.Data[i]);
+		mock_add_usec_to_now(1000);
+	}
+	EXPECT_EQ(SM.GetState(), TxState::RUNNING_WAIT_FOR_IDLE);
+	SM.Update(false, false, false, 0);
+	EXPECT_EQ(SM.GetState(), TxState::IDLE);
+	EXPECT_EQ(SM.Error(), false) << "status " << SM.RxMsg.Status;
+
+	return latency;
+}
+
+TEST(TxStateMachine, ColdStart)
+{
+	uint8_t data[4] = {0x40, 0xf0, 0x30, 0x00};
+	UARTPio Pio;
+	TxStateMachine SM(Pio);
+	Message Msg(0, data, sizeof(data));
+	long latency;
+
+	mock_reset_timebase();
+	EXPECT_EQ(Pio.MokShutdown(), true);
+
+	// Without burst mode the line driver is powered for every packet
+	for (size_t i = 0; i < 3; i++) {
+		latency = transmit(SM, Pio, Msg);
+		EXPECT_GE(latency, TX_POWERON_TIMEOUT_US);
+		EXPECT_EQ(Pio.MokShutdown(), true);
+		EXPECT_EQ(SM.IsPoweredOn(), false);
+		EXPECT_EQ(SM.HasDeadline(), false);
+		mock_add_usec_to_now(30000);
+	}
+}
+
+TEST(TxStateMachine, Burst)
+{
+	uint8_t data[4] = {0x40, 0xf0, 0x30, 0x00};
+	UARTPio Pio;
+	TxStateMachine SM(Pio);
+	Message Msg(0, data, sizeof(data));
+	long latency;
+
+	mock_reset_timebase();
+	SM.KeepWarm(true);
+
+	// First packet needs to wait for the line driver
+	latency = transmit(SM, Pio, Msg);
+	std::cerr << "[          ] cold start latency " << latency << " usec" << std::endl;
+	EXPECT_GE(latency, TX_POWERON_TIMEOUT_US);
+
+	// Following packets start immediately
+	for (size_t i = 0; i < 5; i++) {
+		EXPECT_EQ(Pio.MokShutdown(), false);
+		EXPECT_EQ(SM.IsWarm(), true);
+		mock_add_usec_to_now(30000);
+		SM.Update(false, false, false, 0);
+		EXPECT_EQ(Pio.MokShutdown(), false);
+
+		latency = transmit(SM, Pio, Msg);
+		EXPECT_LT(latency, TX_ONE_CHAR_TIMEOUT_US);
+	}
+	std::cerr << "[          ] warm start latency " << latency << " usec" << std::endl;
+
+	// Power off after the hold time
+	EXPECT_EQ(SM.HasDeadline(), true);
+	mock_add_usec_to_now(TX_WARM_HOLD_US + 1);
+	SM.Update(false, false, false, 0);
+	EXPECT_EQ(Pio.MokShutdown(), true);
+	EXPECT_EQ(SM.IsPoweredOn(), false);
+	EXPECT_EQ(SM.HasDeadline(), false);
+
+	latency = transmit(SM, Pio, Msg);
+	EXPECT_GE(latency, TX_POWERON_TIMEOUT_US);
+}
+
+// A warm transmission keeps the turnaround time after the last packet
+// received
+TEST(TxStateMachine, Turnaround)
+{
+	uint8_t data[4] = {0x40, 0xf0, 0x30, 0x00};
+	UARTPio Pio;
+	TxStateMachine SM(Pio);
+	Message Msg(0, data, sizeof(data));
+	long latency;
+
+	mock_reset_timebase();
+	SM.KeepWarm(true);
+	transmit(SM, Pio, Msg);
+
+	// The request just ended
+	SM.FrameEnd(0);
+	latency = transmit(SM, Pio, Msg);
+	EXPECT_GE(latency, TX_TURNAROUND_US);
+	EXPECT_LT(latency, TX_TURNAROUND_US + 200);
+
+	// The line became free late
+	mock_add_usec_to_now(30000);
+	SM.FrameEnd(TX_TURNAROUND_US - 2000);
+	latency = transmit(SM, Pio, Msg);
+	EXPECT_GE(latency, 2000);
+	EXPECT_LT(latency, 2200);
+
+	// Already passed
+	mock_add_usec_to_now(30000);
+	SM.FrameEnd(TX_TURNAROUND_US);
+	latency = transmit(SM, Pio, Msg);
+	EXPECT_LT(latency, TX_ONE_CHAR_TIMEOUT_US);
+}
+
+TEST(TxStateMachine, BurstEnds)
+{
+	uint8_t data[4] = {0x40, 0xf0, 0x30, 0x00};
+	UARTPio Pio;
+	TxStateMachine SM(Pio);
+	Message Msg(0, data, sizeof(data));
+
+	mock_reset_timebase();
+	SM.KeepWarm(true);
+	transmit(SM, Pio, Msg);
+	EXPECT_EQ(Pio.MokShutdown(), false);
+
+	// No more packets expected
+	SM.KeepWarm(false);
+	EXPECT_EQ(Pio.MokShutdown(), true);
+
+	// Hold time of 0 disables burst mode
+	SM.KeepWarm(true);
+	SM.SetHoldTime(0);
+	transmit(SM, Pio, Msg);
+	EXPECT_EQ(Pio.MokShutdown(), true);
+}
+
+TEST(TxStateMachine, PowerOnInProgress)
+{
+	uint8_t data[4] = {0x40, 0xf0, 0x30, 0x00};
+	UARTPio Pio;
+	TxStateMachine SM(Pio);
+	Message Msg(0, data, sizeof(data));
+
+	mock_reset_timebase();
+	SM.KeepWarm(true);
+	SM.WakeAndTransmit(Msg);
+	SM.Update(false, false, false, 0);
+	EXPECT_EQ(SM.GetState(), TxState::WAIT_POWERON);
+	EXPECT_EQ(SM.Deadline(), TX_POWERON_TIMEOUT_US);
+
+	// The line becomes busy, the power on time is kept
+	mock_add_usec_to_now(10000);
+	SM.Update(true, false, false, 0);
+	EXPECT_EQ(SM.Error(), true);
+	EXPECT_EQ(SM.IsPoweredOn(), true);
+	EXPECT_EQ(SM.IsWarm(), false);
+
+	SM.WakeAndTransmit(Msg);
+	SM.Update(false, false, false, 0);
+	EXPECT_EQ(SM.GetState(), TxState::WAIT_POWERON);
+	EXPECT_EQ(SM.Deadline(), TX_POWERON_TIMEOUT_US);
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
 
 #include "uart_bit_detect_fast.hpp"
 #include "level_detect.hpp"
@@ -246,4 +249,126 @@ TEST(UartBitDetect, DCLevel)
 		b.Update(data[i], &out[i]);
 	}
 	EXPECT_EQ(out[14], 0);
-}
\ No newline at end of file
+}
+// UARTBit without the idle gate
+template <class T, size_t N>
+class UARTBitReference
+{
+  public:
+	UARTBitReference(const int32_t receiver_level) : data{}, data_abs{},
+		receiver_level(receiver_level), off(0) {}
+
+	void Update(const T in, T *probability) {
+		int32_t result_abs, result_high, h, l;
+		size_t i;
+
+		this->data[this->off] = this->data[this->off + N] = in;
+		this->data_abs[this->off] = this->data_abs[this->off + N] = abs(in);
+		this->off = (this->off + 1) % N;
+
+		const T *const ptr = &this->data[this->off];
+		const T *const ptr_abs = &this->data_abs[this->off];
+
+		result_abs = ptr_abs[0];
+		result_high = 0;
+		for (i = 1; i < N/2; i++)
+			result_high += ptr[i];
+		for (i+=2; i < N; i++)
+			result_abs += ptr_abs[i];
+
+		h = result_high - result_abs;
+		l = -result_high - result_abs;
+
+		if (h >= this->receiver_level)
+			*probability = h;
+		else if (l >= this->receiver_level)
+			*probability = -l;
+		else
+			*probability = 0;
+	}
+
+  private:
+	T data[N * 2];
+	T data_abs[N * 2];
+	int32_t receiver_level;
+	size_t off;
+};
+
+// The idle gate must not change the output. Measures the CPU time on a bus
+// with 25% load: a packet of 20 bytes every 90 msec.
+TEST(UartBitDetect, IdleGate)
+{
+	const size_t packet = 20 * 11 * 16;
+	const size_t period = 90 * 9600 * 16 / 1000;
+	const size_t loops = 20;
+	int32_t buf_a[16 * 2];
+	int32_t buf_b[16 * 2];
+	UARTBit<int32_t, 16> b(buf_a, buf_b, BUS_HIGH_MV, BUS_LOW_MV, 0xe0);
+	// Same receiver level as calculated by UARTBit
+	UARTBitReference<int32_t, 16> ref((7 * BUS_HIGH_MV - 7 * BUS_LOW_MV) * 0xe1 >> 8);
+	Level<int32_t> l;
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> noise(-300, 300);
+	std::uniform_int_distribution<int> bit(0, 1);
+	std::vector<int32_t> signal;
+	size_t idle = 0, pulses = 0;
+
+	// Random pulses with alternating polarity followed by the idle line.
+	// All signals pass the Level stage as on core1.
+	for (size_t p = 0; p < 4; p++) {
+		int polarity = 1;
+		for (size_t i = 0; i < period; i += 16) {
+			const bool pulse = i < packet && bit(rng);
+			for (size_t j = 0; j < 16; j++) {
+				int32_t in = noise(rng), out;
+				if (pulse && j < 8)
+					in += 3000 * polarity;
+				l.Update(in, &out);
+				signal.push_back(out);
+			}
+			if (pulse)
+				polarity = -polarity;
+		}
+	}
+
+	for (size_t i = 0; i < signal.size(); i++) {
+		int32_t out, expected;
+		b.Update(signal[i], &out);
+		ref.Update(signal[i], &expected);
+		ASSERT_EQ(out, expected) << "i = " << i;
+		idle += b.Idle();
+		pulses += out != 0;
+	}
+	EXPECT_GT(pulses, 0);
+
+	volatile int32_t sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t n = 0; n < loops; n++) {
+		for (size_t i = 0; i < signal.size(); i++) {
+			int32_t out;
+			ref.Update(signal[i], &out);
+			sink += out;
+		}
+	}
+	auto full = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (size_t n = 0; n < loops; n++) {
+		for (size_t i = 0; i < signal.size(); i++) {
+			int32_t out;
+			b.Update(signal[i], &out);
+			sink += out;
+		}
+	}
+	auto gated = std::chrono::steady_clock::now() - start;
+
+	std::cerr << "[          ] idle samples: " << 100 * idle / signal.size() << "%" << std::endl;
+	std::cerr << "[          ] without gate: " <<
+		std::chrono::duration_cast<std::chrono::nanoseconds>(full).count() / (loops * signal.size()) <<
+		" ns/sample, with gate: " <<
+		std::chrono::duration_cast<std::chrono::nanoseconds>(gated).count() / (loops * signal.size()) <<
+		" ns/sample" << std::endl;
+
+	// The line is idle outside of the packets
+	EXPECT_GT(idle, signal.size() * 7 / 10);
+}
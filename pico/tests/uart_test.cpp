@@ -1017,6 +1017,40 @@ TEST(UART, TestPulseNoise)
 	}
 }
 
+TEST(UART, TestStartPhase)
+{
+	int32_t buf_uart_bit1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf_uart_bit2[UART_OVERSAMPLING_RATE * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> b(buf_uart_bit1, buf_uart_bit2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+	int16_t buf[UART_BUFFER_LEN * 2];
+	UART u(buf, UART::PARITY_EVEN);
+	int16_t p[OVERSAMPLING * 13];
+	int32_t signal;
+	uint8_t out;
+	bool err;
+
+	for (size_t delay = 0; delay < OVERSAMPLING; delay++) {
+		int16_t shifted[OVERSAMPLING * 14] = {0};
+
+		genTestData(0x5a, UART::PARITY_EVEN, p);
+		memcpy(&shifted[delay], p, sizeof(p));
+
+		for (size_t i = 0; i < OVERSAMPLING * 14; i++) {
+			b.Update(shifted[i], &signal);
+			if (u.Update(signal, &out, &err)) {
+				// genTestData places the start bit at sample OVERSAMPLING.
+				// Without the ADC and FIR filter delay it must match exactly.
+				size_t start = i - UART_BUFFER_LEN + u.Phase() -
+					(UART_OVERSAMPLING_RATE - 2);
+				EXPECT_EQ(err, false);
+				EXPECT_EQ(out, 0x5a);
+				EXPECT_EQ(start, OVERSAMPLING + delay);
+				break;
+			}
+		}
+	}
+}
+
 TEST(UART, TestCapturedTestData)
 {
 	int32_t buf_uart_bit1[UART_OVERSAMPLING_RATE * 2];
@@ -1050,3 +1084,128 @@ TEST(UART, TestCapturedTestData)
 	EXPECT_EQ(count, 3);
 
 }
+
+TEST(UART, TestEarlyDecode)
+{
+	int32_t buf_uart_bit1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf_uart_bit2[UART_OVERSAMPLING_RATE * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> b(buf_uart_bit1, buf_uart_bit2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+	int16_t buf[UART_BUFFER_LEN * 2];
+	int16_t p[OVERSAMPLING * 13];
+	int32_t signal;
+	uint8_t out;
+	bool err;
+
+	for (auto parity : {UART::PARITY_NONE, UART::PARITY_EVEN}) {
+		UART u(buf, parity);
+
+		for (uint16_t testbyte = 0; testbyte <= 0xff; testbyte++) {
+			size_t done_at[2] = {0, 0};
+			uint8_t result[2] = {0, 0};
+
+			genTestData(testbyte, parity, p);
+
+			for (int early = 0; early < 2; early++) {
+				u.SetEarly(early);
+				for (size_t i = 0; i < OVERSAMPLING * 13; i++) {
+					out = 0;
+					err = false;
+					b.Update(p[i], &signal);
+					if (u.Update(signal, &out, &err)) {
+						EXPECT_EQ(err, false);
+						EXPECT_EQ(done_at[early], 0);
+						done_at[early] = i;
+						result[early] = out;
+					}
+					EXPECT_EQ(u.Correction(), false);
+				}
+			}
+			EXPECT_EQ(result[0], testbyte);
+			EXPECT_EQ(result[1], testbyte);
+			// One bit time and the STOP state are saved
+			EXPECT_EQ(done_at[0] - done_at[1], UART_OVERSAMPLING_RATE + 1);
+		}
+	}
+}
+
+TEST(UART, TestEarlyFramingError)
+{
+	int16_t p[OVERSAMPLING * 13];
+	int32_t signal;
+	uint8_t out;
+	bool err;
+
+	for (auto parity : {UART::PARITY_NONE, UART::PARITY_EVEN}) {
+		const size_t stop = parity == UART::PARITY_NONE ? 10 : 11;
+
+		for (uint16_t testbyte = 0; testbyte <= 0xff; testbyte++) {
+			int32_t buf_uart_bit1[UART_OVERSAMPLING_RATE * 2];
+			int32_t buf_uart_bit2[UART_OVERSAMPLING_RATE * 2];
+			UARTBit<int32_t, UART_OVERSAMPLING_RATE> b(buf_uart_bit1, buf_uart_bit2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+			int16_t buf[UART_BUFFER_LEN * 2];
+			UART u(buf, parity);
+			bool done = false, correction = false;
+
+			u.SetEarly(true);
+			genTestData(testbyte, parity, p);
+
+			// Break STOP bit with a pulse of the expected polarity
+			for (size_t i = (OVERSAMPLING * stop); i < (OVERSAMPLING * stop + OVERSAMPLING/2); i++)
+				p[i] = (__builtin_popcount(testbyte) & 1) == (parity == UART::PARITY_EVEN) ? 3300 : -3300;
+
+			for (size_t i = 0; i < OVERSAMPLING * 13; i++) {
+				out = 0;
+				err = false;
+				b.Update(p[i], &signal);
+				if (u.Update(signal, &out, &err)) {
+					// The byte is returned before the stop bit is seen
+					EXPECT_EQ(done, false);
+					EXPECT_EQ(correction, false);
+					EXPECT_EQ(err, false);
+					EXPECT_EQ(out, testbyte);
+					done = true;
+				}
+				if (u.Correction()) {
+					EXPECT_EQ(done, true);
+					EXPECT_EQ(correction, false);
+					correction = true;
+				}
+			}
+			EXPECT_EQ(done, true);
+			EXPECT_EQ(correction, true) << "parity " << parity << " byte " << testbyte;
+		}
+	}
+}
+
+TEST(UART, TestEarlyStartPhase)
+{
+	int32_t buf_uart_bit1[UART_OVERSAMPLING_RATE * 2];
+	int32_t buf_uart_bit2[UART_OVERSAMPLING_RATE * 2];
+	UARTBit<int32_t, UART_OVERSAMPLING_RATE> b(buf_uart_bit1, buf_uart_bit2, BUS_HIGH_MV, BUS_LOW_MV, 0xE0);
+	int16_t buf[UART_BUFFER_LEN * 2];
+	UART u(buf, UART::PARITY_EVEN);
+	int16_t p[OVERSAMPLING * 13];
+	int32_t signal;
+	uint8_t out;
+	bool err;
+
+	u.SetEarly(true);
+	for (size_t delay = 0; delay < OVERSAMPLING; delay++) {
+		int16_t shifted[OVERSAMPLING * 14] = {0};
+
+		genTestData(0x5a, UART::PARITY_EVEN, p);
+		memcpy(&shifted[delay], p, sizeof(p));
+
+		for (size_t i = 0; i < OVERSAMPLING * 14; i++) {
+			b.Update(shifted[i], &signal);
+			if (u.Update(signal, &out, &err)) {
+				size_t start = i - u.Delay() + u.Phase() -
+					(UART_OVERSAMPLING_RATE - 2);
+				EXPECT_EQ(err, false);
+				EXPECT_EQ(out, 0x5a);
+				EXPECT_EQ(start, OVERSAMPLING + delay);
+				break;
+			}
+		}
+	}
+}
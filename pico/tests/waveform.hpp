@@ -0,0 +1,44 @@
+#pragma once
+#include <inttypes.h>
+#include <stddef.h>
+#include <vector>
+
+// Appends the P1P2 waveform of the byte data with rate samples per bit.
+// Every 0 bit is a pulse of amplitude for the first half of the bit, the
+// pulses alternate polarity. polarity is the sign of the next pulse.
+// offset is added to all samples.
+template <class T>
+static void genByte(std::vector<T>& p, const uint8_t data, const size_t rate, const int32_t amplitude,
+		    int *polarity, const T offset = 0)
+{
+	size_t ones = 0;
+
+	for (size_t b = 0; b < 11; b++) {
+		bool pulse;
+		if (b == 0)
+			pulse = true;
+		else if (b <= 8) {
+			pulse = !(data & (1 << (b - 1)));
+			ones += !pulse;
+		} else if (b == 9)
+			pulse = !(ones & 1);
+		else
+			pulse = false;
+
+		for (size_t i = 0; i < rate; i++)
+			p.push_back(offset + (pulse && i < rate / 2 ? amplitude * *polarity : 0));
+		if (pulse)
+			*polarity = -*polarity;
+	}
+}
+
+// Appends the P1P2 waveform of len bytes without gaps
+template <class T>
+static void genBytes(std::vector<T>& p, const uint8_t *data, const size_t len, const size_t rate,
+		     const int32_t amplitude, const T offset = 0)
+{
+	int polarity = 1;
+
+	for (size_t n = 0; n < len; n++)
+		genByte(p, data[n], rate, amplitude, &polarity, offset);
+}